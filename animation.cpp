@@ -0,0 +1,157 @@
+//
+// Created by elisabeth on 17.02.24.
+//
+
+#include "animation.h"
+#include "parallel.h"
+
+#include <cmath>
+
+AnimationPipeline::AnimationPipeline(int capacity, double frame_time, int n) : m_frame_time(frame_time), m_n(n),
+                                                                               m_slots(capacity) {
+    // leave one core for the render thread
+    int num_workers = std::max(1, (int) std::thread::hardware_concurrency() - 1);
+    for (int i = 0; i < num_workers; ++i) {
+        m_workers.emplace_back(&AnimationPipeline::worker, this);
+    }
+}
+
+AnimationPipeline::~AnimationPipeline() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+    }
+    m_condition.notify_all();
+    for (auto &worker: m_workers) {
+        worker.join();
+    }
+}
+
+void AnimationPipeline::start(AnimatedFunction f, double start_time, std::optional<TemporalOptions> temporal) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_function = f;
+        m_temporal = temporal;
+        m_start_time = start_time;
+        m_generation++;
+        m_next_frame = 0;
+        m_first_frame = 0;
+        for (auto &slot: m_slots) {
+            slot = Slot();
+        }
+        m_running = true;
+    }
+    m_condition.notify_all();
+}
+
+void AnimationPipeline::stop() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_generation++;
+    m_running = false;
+    m_function = nullptr;
+    for (auto &slot: m_slots) {
+        slot = Slot();
+    }
+}
+
+std::optional<AnimationFrame> AnimationPipeline::take(double time) {
+    std::optional<AnimationFrame> result;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running) {
+            return result;
+        }
+        auto capacity = (int64_t) m_slots.size();
+        auto current = (int64_t) std::floor((time - m_start_time) / m_frame_time);
+
+        // find the latest finished frame that is due
+        for (int64_t frame = std::min(current, m_next_frame - 1); frame >= m_first_frame; --frame) {
+            Slot &slot = m_slots[frame % capacity];
+            if (slot.frame == frame && slot.ready) {
+                result = AnimationFrame{frame_start(frame), std::move(slot.mesh)};
+                m_first_frame = frame + 1;
+                break;
+            }
+        }
+
+        // If the workers fell behind playback, continue with frames in the future. Frames that are still in
+        // flight stay valid as long as they fit into the ring buffer.
+        if (m_next_frame <= current) {
+            m_next_frame = current + 1;
+            m_first_frame = std::max(m_first_frame, m_next_frame - capacity);
+        }
+    }
+    m_condition.notify_all();
+    return result;
+}
+
+void AnimationPipeline::worker() {
+    // every worker keeps its scratch memory for all frames
+    MeshingContext context;
+    int64_t context_generation = -1;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_condition.wait(lock, [this] {
+            return m_shutdown || (m_running && m_next_frame < m_first_frame + (int64_t) m_slots.size());
+        });
+        if (m_shutdown) {
+            return;
+        }
+        int64_t frame = m_next_frame++;
+        int64_t generation = m_generation;
+        AnimatedFunction f = m_function;
+        std::optional<TemporalOptions> temporal = m_temporal;
+        double time = frame_start(frame);
+
+        lock.unlock();
+        if (generation != context_generation) {
+            context.reset_temporal();
+            context_generation = generation;
+        }
+        MeshingOptions options;
+        options.resolution = glm::ivec3(m_n);
+        QuadMesh mesh;
+        if (temporal) {
+            // the previous frame of this worker is usually a few frames earlier, the motion bound covers the gap
+            mesh_generator_temporal(context, KernelEvaluator{f, time}, options, *temporal, mesh);
+        } else {
+            mesh_generator(context, KernelEvaluator{f, time}, options, mesh);
+        }
+        lock.lock();
+
+        // drop the frame if the function changed or playback already skipped it
+        if (generation != m_generation || frame < m_first_frame) {
+            continue;
+        }
+        Slot &slot = m_slots[frame % (int64_t) m_slots.size()];
+        slot.frame = frame;
+        slot.ready = true;
+        slot.mesh = std::move(mesh);
+    }
+}
+
+void mesh_range(AnimatedFunction f, double t0, double t1, int frame_count, int n,
+                const std::function<void(int, QuadMesh &&)> &consume, std::optional<TemporalOptions> temporal) {
+    if (frame_count <= 0) {
+        return;
+    }
+    // Every frame is meshed on a single thread, so the frames are distributed over the cores. Temporal meshing
+    // hands out consecutive chunks of frames instead, such that a thread's previous frame is the one right before.
+    int num_threads = parallel_thread_count(frame_count);
+    int chunk_size = temporal ? (frame_count + num_threads - 1) / num_threads : 1;
+    int chunk_count = (frame_count + chunk_size - 1) / chunk_size;
+    MeshingOptions options;
+    options.resolution = glm::ivec3(n);
+    parallel_for(chunk_count, []() { return MeshingContext(); }, [&](MeshingContext &context, int chunk) {
+        for (int i = chunk * chunk_size; i < std::min(frame_count, (chunk + 1) * chunk_size); ++i) {
+            double time = frame_count == 1 ? t0 : t0 + (t1 - t0) * i / (frame_count - 1);
+            QuadMesh mesh;
+            if (temporal) {
+                mesh_generator_temporal(context, KernelEvaluator{f, time}, options, *temporal, mesh);
+            } else {
+                mesh_generator(context, KernelEvaluator{f, time}, options, mesh);
+            }
+            consume(i, std::move(mesh));
+        }
+    });
+}
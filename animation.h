@@ -0,0 +1,82 @@
+//
+// Created by elisabeth on 17.02.24.
+//
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <glm/vec3.hpp>
+
+#include "implicit_meshing.h"
+
+// Compiled function of the point and the time, e.g. Kernel::eval. The meshers call it without any indirection.
+using AnimatedFunction = double (*)(double x, double y, double z, double t);
+
+struct AnimationFrame {
+    double time;
+    QuadMesh mesh;
+};
+
+// Meshes future time steps of an animated function on worker threads ahead of playback. Finished frames are
+// kept in a ring buffer with a fixed number of slots, so the workers never run further ahead than that.
+class AnimationPipeline {
+public:
+    explicit AnimationPipeline(int capacity = 8, double frame_time = 1.0 / 30.0, int n = 100);
+
+    ~AnimationPipeline();
+
+    // Discard all frames and start meshing f at start_time, start_time + frame_time, ... With temporal options,
+    // every worker reuses the octree of its previous frame, see mesh_generator_temporal
+    void start(AnimatedFunction f, double start_time, std::optional<TemporalOptions> temporal = std::nullopt);
+
+    // Stop meshing and discard all frames
+    void stop();
+
+    bool running() const { return m_running; }
+
+    // Return the latest finished frame with a time not after the playback time. All older frames are
+    // dropped and their slots are handed back to the workers.
+    std::optional<AnimationFrame> take(double time);
+
+private:
+    struct Slot {
+        int64_t frame = -1;
+        bool ready = false;
+        QuadMesh mesh;
+    };
+
+    void worker();
+
+    double frame_start(int64_t frame) const { return m_start_time + (double) frame * m_frame_time; }
+
+    double m_frame_time;
+    int m_n;
+
+    std::vector<Slot> m_slots;
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+
+    AnimatedFunction m_function = nullptr;
+    std::optional<TemporalOptions> m_temporal;
+    double m_start_time = 0.0;
+    // Incremented on every start/stop so that workers drop frames of an outdated function
+    int64_t m_generation = 0;
+    // Next frame a worker will mesh and oldest frame that hasn't been consumed by take
+    int64_t m_next_frame = 0;
+    int64_t m_first_frame = 0;
+    bool m_running = false;
+    bool m_shutdown = false;
+};
+
+// Mesh frame_count equidistant time steps of [t0, t1] in parallel on all cores. consume is called from the
+// worker threads with the frame index and the mesh, so it has to be thread safe. With temporal options, every
+// thread meshes a consecutive range of frames and reuses the octree of its previous frame.
+void mesh_range(AnimatedFunction f, double t0, double t1, int frame_count, int n,
+                const std::function<void(int, QuadMesh &&)> &consume,
+                std::optional<TemporalOptions> temporal = std::nullopt);
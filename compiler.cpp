@@ -10,20 +10,387 @@
 #include <llvm/ExecutionEngine/MCJIT.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/IR/Intrinsics.h>
 #include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/Host.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/Object/ArchiveWriter.h>
+#include <llvm/Support/raw_ostream.h>
 #include <functional>
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <limits>
 #include <map>
 #include <vector>
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
 
 
-std::function<double(glm::dvec3)> compile(std::vector<Instruction>& instructions, std::map<int, double>& constants) {
-    // Initialize LLVM
-    llvm::InitializeNativeTarget();
-    llvm::InitializeNativeTargetAsmPrinter();
+// Evaluate a polynomial with the coefficients in increasing order using Horner's scheme
+static llvm::Value* emit_polynomial(llvm::IRBuilder<>& builder, llvm::Value* x, std::initializer_list<double> coefficients) {
+    llvm::Type* type = x->getType();
+    llvm::Value* result = nullptr;
+    for (auto it = std::rbegin(coefficients); it != std::rend(coefficients); ++it) {
+        llvm::Value* c = llvm::ConstantFP::get(type, *it);
+        result = result ? builder.CreateFAdd(builder.CreateFMul(result, x), c) : c;
+    }
+    return result;
+}
 
-    llvm::LLVMContext context;
+// Inline sin or cos of a scalar or vector value. The argument is reduced to r in [-pi/4, pi/4] with
+// x = r + k * pi/2 (Cody-Waite), then the sin or cos polynomial of r is chosen depending on the quadrant k.
+// The polynomials are the minimax ones of fdlibm (double) and Cephes (float).
+static llvm::Value* emit_sin_cos(llvm::IRBuilder<>& builder, llvm::Module* module, llvm::Value* x, bool cosine, bool fast) {
+    llvm::Type* double_type = x->getType();
+    if (fast) {
+        x = builder.CreateFPTrunc(x, double_type->getWithNewType(builder.getFloatTy()));
+    }
+    llvm::Type* type = x->getType();
+    auto constant = [&](double value) { return llvm::ConstantFP::get(type, value); };
+
+    llvm::Value* k = builder.CreateCall(llvm::Intrinsic::getDeclaration(module, llvm::Intrinsic::rint, {type}),
+                                        {builder.CreateFMul(x, constant(2.0 / M_PI))});
+    llvm::Value* r;
+    {
+        // pi/2 is split into parts with few mantissa bits, so k * part is exact. Reassociation would merge the
+        // parts again, so only contraction to fma is allowed here.
+        llvm::IRBuilder<>::FastMathFlagGuard guard(builder);
+        llvm::FastMathFlags flags;
+        flags.setAllowContract();
+        builder.setFastMathFlags(flags);
+        if (fast) {
+            r = builder.CreateFSub(x, builder.CreateFMul(k, constant(1.5703125)));
+            r = builder.CreateFSub(r, builder.CreateFMul(k, constant(4.837512969970703125e-4)));
+            r = builder.CreateFSub(r, builder.CreateFMul(k, constant(7.54978995489188216e-8)));
+        } else {
+            r = builder.CreateFSub(x, builder.CreateFMul(k, constant(1.57079632673412561417e+00)));
+            r = builder.CreateFSub(r, builder.CreateFMul(k, constant(6.07710050630396597660e-11)));
+            r = builder.CreateFSub(r, builder.CreateFMul(k, constant(2.02226624871116645580e-21)));
+        }
+    }
+
+    llvm::Value* z = builder.CreateFMul(r, r);
+    llvm::Value* s;
+    llvm::Value* c;
+    if (fast) {
+        s = emit_polynomial(builder, z, {-1.6666654611e-1, 8.3321608736e-3, -1.9515295891e-4});
+        c = emit_polynomial(builder, z, {4.166664568298827e-2, -1.388731625493765e-3, 2.443315711809948e-5});
+    } else {
+        s = emit_polynomial(builder, z, {-1.66666666666666324348e-01, 8.33333333332248946124e-03,
+                                         -1.98412698298579493134e-04, 2.75573137070700676789e-06,
+                                         -2.50507602534068634195e-08, 1.58969099521155010221e-10});
+        c = emit_polynomial(builder, z, {4.16666666666666019037e-02, -1.38888888888741095749e-03,
+                                         2.48015872894767294178e-05, -2.75573143513906633035e-07,
+                                         2.08757232129817482790e-09, -1.13596475577881948265e-11});
+    }
+    // sin(r) = r + r^3 * s(r^2), cos(r) = 1 - r^2 / 2 + r^4 * c(r^2)
+    s = builder.CreateFAdd(r, builder.CreateFMul(builder.CreateFMul(r, z), s));
+    c = builder.CreateFAdd(builder.CreateFSub(constant(1.0), builder.CreateFMul(z, constant(0.5))),
+                           builder.CreateFMul(builder.CreateFMul(z, z), c));
+
+    // cos(x) = sin(x + pi/2), so cos is shifted by one quadrant
+    llvm::Type* int_type = type->getWithNewType(builder.getInt32Ty());
+    llvm::Value* quadrant = builder.CreateFPToSI(k, int_type);
+    if (cosine) {
+        quadrant = builder.CreateAdd(quadrant, llvm::ConstantInt::get(int_type, 1));
+    }
+    llvm::Value* zero = llvm::ConstantInt::get(int_type, 0);
+    llvm::Value* swap = builder.CreateICmpNE(builder.CreateAnd(quadrant, llvm::ConstantInt::get(int_type, 1)), zero);
+    llvm::Value* negate = builder.CreateICmpNE(builder.CreateAnd(quadrant, llvm::ConstantInt::get(int_type, 2)), zero);
+    llvm::Value* result = builder.CreateSelect(swap, c, s);
+    result = builder.CreateSelect(negate, builder.CreateFNeg(result), result);
+    if (fast) {
+        result = builder.CreateFPExt(result, double_type);
+    }
+    return result;
+}
+
+// Entries of the traversal stack of a scatter set, a BVH needs at most one more than its depth
+constexpr int SCATTER_STACK_SIZE = 128;
+
+// Emit a traversal of the BVH of a scatter set returning the distance to the union of the instances. The BVH is
+// stored in constant arrays, nodes are visited closest first from a stack and skipped if their bounding box is
+// further away than the closest instance found so far.
+static llvm::Value* emit_scatter(llvm::IRBuilder<>& builder, llvm::Module* module, llvm::Function* function,
+                                 const ScatterSet& set, llvm::Value* x, llvm::Value* y, llvm::Value* z) {
+    llvm::LLVMContext& context = module->getContext();
+    llvm::Type* double_type = builder.getDoubleTy();
+    llvm::Type* int_type = builder.getInt32Ty();
+    auto constant = [&](double value) { return llvm::ConstantFP::get(double_type, value); };
+    if (set.nodes.empty()) {
+        return constant(1e10);
+    }
+
+    // constant arrays: node bounds (lower, upper), node first/count, instance type and position/size/rotation
+    std::vector<double> bounds;
+    std::vector<int> node_data;
+    for (const BVHNode& node: set.nodes) {
+        bounds.insert(bounds.end(), {node.lower.x, node.lower.y, node.lower.z, node.upper.x, node.upper.y, node.upper.z});
+        node_data.insert(node_data.end(), {node.first, node.count});
+    }
+    std::vector<int> types;
+    std::vector<double> instance_data;
+    for (const ScatterInstance& instance: set.instances) {
+        types.push_back((int) instance.primitive);
+        instance_data.insert(instance_data.end(), {instance.position.x, instance.position.y, instance.position.z,
+                                                   instance.size.x, instance.size.y, instance.size.z});
+        for (int i = 0; i < 3; ++i) {
+            instance_data.insert(instance_data.end(), {instance.rotation[i].x, instance.rotation[i].y,
+                                                       instance.rotation[i].z});
+        }
+    }
+    auto global_array = [&](llvm::Constant* data) {
+        return new llvm::GlobalVariable(*module, data->getType(), true, llvm::GlobalValue::PrivateLinkage, data);
+    };
+    llvm::GlobalVariable* bounds_array = global_array(llvm::ConstantDataArray::get(context, bounds));
+    llvm::GlobalVariable* node_array = global_array(llvm::ConstantDataArray::get(context, llvm::ArrayRef<uint32_t>((uint32_t*) node_data.data(), node_data.size())));
+    llvm::GlobalVariable* type_array = global_array(llvm::ConstantDataArray::get(context, llvm::ArrayRef<uint32_t>((uint32_t*) types.data(), types.size())));
+    llvm::GlobalVariable* instance_array = global_array(llvm::ConstantDataArray::get(context, instance_data));
+    auto load = [&](llvm::GlobalVariable* array, llvm::Type* type, llvm::Value* index) {
+        llvm::Value* pointer = builder.CreateInBoundsGEP(array->getValueType(), array, {builder.getInt32(0), index});
+        return builder.CreateLoad(type, pointer);
+    };
+    auto offset = [&](llvm::Value* index, int stride, int offset) {
+        return builder.CreateAdd(builder.CreateMul(index, builder.getInt32(stride)), builder.getInt32(offset));
+    };
+
+    // Distance from the point to the bounding box of a node, 0 inside
+    auto box_distance = [&](llvm::Value* node) {
+        llvm::Value* p[3] = {x, y, z};
+        llvm::Value* sum = constant(0.0);
+        for (int i = 0; i < 3; ++i) {
+            llvm::Value* lower = load(bounds_array, double_type, offset(node, 6, i));
+            llvm::Value* upper = load(bounds_array, double_type, offset(node, 6, i + 3));
+            llvm::Value* d = builder.CreateMaxNum(builder.CreateFSub(lower, p[i]), builder.CreateFSub(p[i], upper));
+            d = builder.CreateMaxNum(d, constant(0.0));
+            sum = builder.CreateFAdd(sum, builder.CreateFMul(d, d));
+        }
+        return builder.CreateUnaryIntrinsic(llvm::Intrinsic::sqrt, sum);
+    };
+
+    // the traversal stack lives in the entry block, the tree depth is logarithmic in the number of instances
+    llvm::IRBuilder<> entry_builder(&function->getEntryBlock(), function->getEntryBlock().begin());
+    llvm::ArrayType* stack_type = llvm::ArrayType::get(int_type, SCATTER_STACK_SIZE);
+    llvm::Value* stack = entry_builder.CreateAlloca(stack_type);
+    auto stack_pointer = [&](llvm::Value* index) {
+        return builder.CreateInBoundsGEP(stack_type, stack, {builder.getInt32(0), index});
+    };
+
+    llvm::BasicBlock* start = builder.GetInsertBlock();
+    llvm::BasicBlock* loop = llvm::BasicBlock::Create(context, "scatter_loop", function);
+    llvm::BasicBlock* pop = llvm::BasicBlock::Create(context, "scatter_pop", function);
+    llvm::BasicBlock* visit = llvm::BasicBlock::Create(context, "scatter_visit", function);
+    llvm::BasicBlock* inner = llvm::BasicBlock::Create(context, "scatter_inner", function);
+    llvm::BasicBlock* leaf = llvm::BasicBlock::Create(context, "scatter_leaf", function);
+    llvm::BasicBlock* instance = llvm::BasicBlock::Create(context, "scatter_instance", function);
+    llvm::BasicBlock* done = llvm::BasicBlock::Create(context, "scatter_done", function);
+
+    builder.CreateStore(builder.getInt32(0), stack_pointer(builder.getInt32(0)));
+    builder.CreateBr(loop);
+
+    // loop: while the stack isn't empty
+    builder.SetInsertPoint(loop);
+    llvm::PHINode* size = builder.CreatePHI(int_type, 4);
+    llvm::PHINode* best = builder.CreatePHI(double_type, 4);
+    size->addIncoming(builder.getInt32(1), start);
+    best->addIncoming(constant(1e10), start);
+    builder.CreateCondBr(builder.CreateICmpSGT(size, builder.getInt32(0)), pop, done);
+
+    // pop: skip nodes that can't contain anything closer. Inside an instance only nodes containing the point can
+    // make the distance more negative.
+    builder.SetInsertPoint(pop);
+    llvm::Value* top = builder.CreateSub(size, builder.getInt32(1));
+    llvm::Value* node = builder.CreateLoad(int_type, stack_pointer(top));
+    llvm::Value* closer = builder.CreateFCmpOLE(box_distance(node), builder.CreateMaxNum(best, constant(0.0)));
+    size->addIncoming(top, pop);
+    best->addIncoming(best, pop);
+    builder.CreateCondBr(closer, visit, loop);
+
+    builder.SetInsertPoint(visit);
+    llvm::Value* first = load(node_array, int_type, offset(node, 2, 0));
+    llvm::Value* count = load(node_array, int_type, offset(node, 2, 1));
+    builder.CreateCondBr(builder.CreateICmpSGT(count, builder.getInt32(0)), leaf, inner);
+
+    // inner: push the further child first so the closer one is visited next
+    builder.SetInsertPoint(inner);
+    llvm::Value* second = builder.CreateAdd(first, builder.getInt32(1));
+    llvm::Value* first_closer = builder.CreateFCmpOLT(box_distance(first), box_distance(second));
+    builder.CreateStore(builder.CreateSelect(first_closer, second, first), stack_pointer(top));
+    builder.CreateStore(builder.CreateSelect(first_closer, first, second), stack_pointer(size));
+    size->addIncoming(builder.CreateAdd(size, builder.getInt32(1)), inner);
+    best->addIncoming(best, inner);
+    builder.CreateBr(loop);
+
+    // leaf: minimum over the instances
+    builder.SetInsertPoint(leaf);
+    llvm::PHINode* index = builder.CreatePHI(int_type, 2);
+    llvm::PHINode* leaf_best = builder.CreatePHI(double_type, 2);
+    index->addIncoming(first, visit);
+    leaf_best->addIncoming(best, visit);
+    llvm::Value* end = builder.CreateAdd(first, count);
+    size->addIncoming(top, leaf);
+    best->addIncoming(leaf_best, leaf);
+    builder.CreateCondBr(builder.CreateICmpSLT(index, end), instance, loop);
+
+    builder.SetInsertPoint(instance);
+    llvm::Value* p[3] = {x, y, z};
+    llvm::Value* d[3];
+    llvm::Value* q[3];
+    llvm::Value* s[3];
+    for (int i = 0; i < 3; ++i) {
+        d[i] = builder.CreateFSub(p[i], load(instance_array, double_type, offset(index, 15, i)));
+        s[i] = load(instance_array, double_type, offset(index, 15, i + 3));
+    }
+    // rotate the offset into the frame of the instance, the columns of the rotation are its axes
+    for (int i = 0; i < 3; ++i) {
+        q[i] = constant(0.0);
+        for (int j = 0; j < 3; ++j) {
+            q[i] = builder.CreateFAdd(q[i], builder.CreateFMul(d[j], load(instance_array, double_type,
+                                                                          offset(index, 15, 6 + 3 * i + j))));
+        }
+    }
+    // sphere
+    llvm::Value* length = builder.CreateFAdd(builder.CreateFAdd(builder.CreateFMul(q[0], q[0]), builder.CreateFMul(q[1], q[1])),
+                                             builder.CreateFMul(q[2], q[2]));
+    llvm::Value* sphere = builder.CreateFSub(builder.CreateUnaryIntrinsic(llvm::Intrinsic::sqrt, length), s[0]);
+    // box
+    llvm::Value* outside = constant(0.0);
+    llvm::Value* inside = nullptr;
+    for (int i = 0; i < 3; ++i) {
+        llvm::Value* d = builder.CreateFSub(builder.CreateUnaryIntrinsic(llvm::Intrinsic::fabs, q[i]), s[i]);
+        inside = inside ? builder.CreateMaxNum(inside, d) : d;
+        d = builder.CreateMaxNum(d, constant(0.0));
+        outside = builder.CreateFAdd(outside, builder.CreateFMul(d, d));
+    }
+    llvm::Value* box = builder.CreateFAdd(builder.CreateUnaryIntrinsic(llvm::Intrinsic::sqrt, outside),
+                                          builder.CreateMinNum(inside, constant(0.0)));
+    llvm::Value* is_sphere = builder.CreateICmpEQ(load(type_array, int_type, index), builder.getInt32((int) ScatterPrimitive::Sphere));
+    llvm::Value* distance = builder.CreateSelect(is_sphere, sphere, box);
+    index->addIncoming(builder.CreateAdd(index, builder.getInt32(1)), instance);
+    leaf_best->addIncoming(builder.CreateMinNum(leaf_best, distance), instance);
+    builder.CreateBr(leaf);
+
+    builder.SetInsertPoint(done);
+    return best;
+}
+
+// Emit a trilinear lookup into a sparse volume without branches, so the batch loop stays vectorizable. Empty
+// bricks read the samples of brick 0 and select their constant value instead.
+static llvm::Value* emit_volume(llvm::IRBuilder<>& builder, llvm::Module* module, const SparseVolume& volume,
+                                llvm::Value* x, llvm::Value* y, llvm::Value* z) {
+    llvm::LLVMContext& context = module->getContext();
+    llvm::Type* double_type = builder.getDoubleTy();
+    llvm::Type* float_type = builder.getFloatTy();
+    llvm::Type* int_type = builder.getInt32Ty();
+    auto constant = [&](double value) {
+        return llvm::ConstantFP::get(double_type, value);
+    };
+    auto global_array = [&](llvm::Constant* data) {
+        return new llvm::GlobalVariable(*module, data->getType(), true, llvm::GlobalValue::PrivateLinkage, data);
+    };
+    llvm::GlobalVariable* index_array = global_array(llvm::ConstantDataArray::get(context, llvm::ArrayRef<uint32_t>(
+            (const uint32_t*) volume.brick_index.data(), volume.brick_index.size())));
+    llvm::GlobalVariable* value_array = global_array(llvm::ConstantDataArray::get(context, volume.brick_values));
+    llvm::GlobalVariable* sample_array = global_array(llvm::ConstantDataArray::get(context, volume.samples));
+    auto load = [&](llvm::GlobalVariable* array, llvm::Type* type, llvm::Value* index) {
+        llvm::Value* pointer = builder.CreateInBoundsGEP(array->getValueType(), array, {builder.getInt32(0), index});
+        return builder.CreateLoad(type, pointer);
+    };
+
+    // Clamp the point to the volume and split it into the cell and the position inside the cell
+    llvm::Value* p[3] = {x, y, z};
+    llvm::Value* outside = constant(0.0);
+    llvm::Value* local[3];
+    llvm::Value* t[3];
+    llvm::Value* brick = builder.getInt32(0);
+    for (int i = 0; i < 3; ++i) {
+        llvm::Value* clamped = builder.CreateMinNum(builder.CreateMaxNum(p[i], constant(volume.lower[i])),
+                                                    constant(volume.upper[i]));
+        llvm::Value* d = builder.CreateFSub(p[i], clamped);
+        outside = builder.CreateFAdd(outside, builder.CreateFMul(d, d));
+        llvm::Value* grid = builder.CreateFMul(builder.CreateFSub(clamped, constant(volume.lower[i])),
+                                               constant(1.0 / volume.spacing[i]));
+        llvm::Value* cell = builder.CreateFPToSI(grid, int_type);
+        cell = builder.CreateSelect(builder.CreateICmpSLT(cell, builder.getInt32(0)), builder.getInt32(0), cell);
+        int last = volume.bricks[i] * BRICK_SIZE - 1;
+        cell = builder.CreateSelect(builder.CreateICmpSGT(cell, builder.getInt32(last)), builder.getInt32(last), cell);
+        t[i] = builder.CreateFSub(grid, builder.CreateSIToFP(cell, double_type));
+        brick = builder.CreateAdd(builder.CreateMul(brick, builder.getInt32(volume.bricks[i])),
+                                  builder.CreateUDiv(cell, builder.getInt32(BRICK_SIZE)));
+        local[i] = builder.CreateURem(cell, builder.getInt32(BRICK_SIZE));
+    }
+    llvm::Value* index = load(index_array, int_type, brick);
+    llvm::Value* empty = builder.CreateICmpSLT(index, builder.getInt32(0));
+    index = builder.CreateSelect(empty, builder.getInt32(0), index);
+
+    // Gather the 8 corners of the cell and interpolate along z, y and x
+    constexpr int stride = BRICK_SIZE + 1;
+    llvm::Value* base = builder.CreateMul(index, builder.getInt32(BRICK_SAMPLES));
+    base = builder.CreateAdd(base, builder.CreateMul(local[0], builder.getInt32(stride * stride)));
+    base = builder.CreateAdd(base, builder.CreateMul(local[1], builder.getInt32(stride)));
+    base = builder.CreateAdd(base, local[2]);
+    auto sample = [&](int i, int j, int k) {
+        llvm::Value* offset = builder.CreateAdd(base, builder.getInt32((i * stride + j) * stride + k));
+        return builder.CreateFPExt(load(sample_array, float_type, offset), double_type);
+    };
+    auto lerp = [&](llvm::Value* a, llvm::Value* b, llvm::Value* s) {
+        return builder.CreateFAdd(a, builder.CreateFMul(s, builder.CreateFSub(b, a)));
+    };
+    llvm::Value* c00 = lerp(sample(0, 0, 0), sample(0, 0, 1), t[2]);
+    llvm::Value* c01 = lerp(sample(0, 1, 0), sample(0, 1, 1), t[2]);
+    llvm::Value* c10 = lerp(sample(1, 0, 0), sample(1, 0, 1), t[2]);
+    llvm::Value* c11 = lerp(sample(1, 1, 0), sample(1, 1, 1), t[2]);
+    llvm::Value* value = lerp(lerp(c00, c01, t[1]), lerp(c10, c11, t[1]), t[0]);
+    llvm::Value* empty_value = builder.CreateFPExt(load(value_array, float_type, brick), double_type);
+    value = builder.CreateSelect(empty, empty_value, value);
+    return builder.CreateFAdd(value, builder.CreateUnaryIntrinsic(llvm::Intrinsic::sqrt, outside));
+}
+
+// Step of the central differences of the gradient entry point, the same as the default of MeshingOptions
+constexpr double GRADIENT_STEP = 1e-4;
+
+// Registers may be reused by later instructions, so the liveness is tracked backward per register
+std::vector<bool> live_instructions(const Program& program, const std::vector<int>& outputs) {
+    std::vector<bool> needed(program.num_registers, false);
+    for (int output : outputs) {
+        needed[output] = true;
+    }
+    std::vector<bool> live(program.instructions.size(), false);
+    for (int i = (int) program.instructions.size() - 1; i >= 0; --i) {
+        const Instruction& instr = program.instructions[i];
+        if (!needed[instr.output]) {
+            continue;
+        }
+        live[i] = true;
+        needed[instr.output] = false;
+        for (int input : {instr.input1, instr.input2, instr.input3}) {
+            if (input != -1) {
+                needed[input] = true;
+            }
+        }
+    }
+    return live;
+}
+
+// Build the module with the entry points of the program: mathFunc(x, y, z, t), batchFunc(x, y, z, t, out, n),
+// gradientFunc(x, y, z, t, gradient) returning the value and writing the central differences to gradient[0..2],
+// allFunc(x, y, z, t, out) writing all outputs and outputFunc<k>(x, y, z, t) for every extra output k. If
+// profiling is given, only mathFunc is built, with the runs of instructions of every node timed into the counters
+// of profiling, which are set up here.
+static std::unique_ptr<llvm::Module> build_module(const Program& program, TrigAccuracy accuracy,
+                                                  llvm::LLVMContext& context, ProfilingKernel* profiling = nullptr) {
     llvm::IRBuilder<> builder(context);
 
     // enable fast math
@@ -34,109 +401,1084 @@ std::function<double(glm::dvec3)> compile(std::vector<Instruction>& instructions
     std::unique_ptr<llvm::Module> module(new llvm::Module("mathModule", context));
 
     // Function signature
-    std::vector<llvm::Type*> args_types(3, llvm::Type::getDoubleTy(context));
+    std::vector<llvm::Type*> args_types(4, llvm::Type::getDoubleTy(context));
     llvm::FunctionType* funcType = llvm::FunctionType::get(llvm::Type::getDoubleTy(context), args_types, false);
     llvm::Function* function = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage, "mathFunc", module.get());
 
-    // Entry Block
-    llvm::BasicBlock* entry = llvm::BasicBlock::Create(context, "entry", function);
-    builder.SetInsertPoint(entry);
+    // LLVM type of a value, vectors are lowered to LLVM vector types
+    auto llvm_type = [&](ValueType type) -> llvm::Type* {
+        switch (type) {
+            case ValueType::Vec2:
+                return llvm::FixedVectorType::get(llvm::Type::getDoubleTy(context), 2);
+            case ValueType::Vec3:
+                return llvm::FixedVectorType::get(llvm::Type::getDoubleTy(context), 3);
+            default:
+                return llvm::Type::getDoubleTy(context);
+        }
+    };
+    // Call an intrinsic overloaded on the operand type
+    auto intrinsic = [&](llvm::Intrinsic::ID id, llvm::Type* type, std::vector<llvm::Value*> args) {
+        return builder.CreateCall(llvm::Intrinsic::getDeclaration(module.get(), id, {type}), args);
+    };
+
+    // Counter of every live instruction of the main output when profiling, one per node
+    std::vector<int> counter_of(program.instructions.size(), -1);
+    if (profiling) {
+        if (program.sources.size() != program.instructions.size()) {
+            throw std::runtime_error("The program doesn't record the nodes of its instructions");
+        }
+        std::vector<bool> live = live_instructions(program, {program.output});
+        std::map<int, int> counters;
+        int previous = -1;
+        for (size_t i = 0; i < program.instructions.size(); ++i) {
+            if (!live[i]) {
+                continue;
+            }
+            auto inserted = counters.emplace(program.sources[i].node_id, (int) profiling->nodes.size());
+            if (inserted.second) {
+                profiling->nodes.push_back(program.sources[i].node_id);
+                profiling->runs.push_back(0);
+            }
+            counter_of[i] = inserted.first->second;
+            if (counter_of[i] != previous) {
+                profiling->runs[counter_of[i]]++;
+            }
+            previous = counter_of[i];
+        }
+        profiling->cycles.reset(new uint64_t[profiling->nodes.size() + 1]());
+    }
+    // Add the cycles since start to a counter, returns the current cycle count
+    auto count_cycles = [&](int counter, llvm::Value* start) {
+        llvm::Value* now = builder.CreateCall(
+                llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::readcyclecounter));
+        llvm::Value* address = builder.CreateIntToPtr(
+                builder.getInt64((uint64_t) (uintptr_t) (profiling->cycles.get() + counter)),
+                builder.getInt64Ty()->getPointerTo());
+        llvm::Value* sum = builder.CreateAdd(builder.CreateLoad(builder.getInt64Ty(), address),
+                                             builder.CreateSub(now, start));
+        builder.CreateStore(sum, address);
+        return now;
+    };
+
+    // Lower the live instructions into a new entry block of function, whose first four arguments are the point
+    // and the time. Returns the values of all registers.
+    auto lower = [&](llvm::Function* function, const std::vector<bool>& live) {
+        // Entry Block
+        llvm::BasicBlock* entry = llvm::BasicBlock::Create(context, "entry", function);
+        builder.SetInsertPoint(entry);
+
+        // Time an empty run first, its cycles are the overhead of timing a run
+        llvm::Value* start = nullptr;
+        int counter = -1;
+        if (profiling) {
+            start = builder.CreateCall(
+                    llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::readcyclecounter));
+            start = count_cycles((int) profiling->nodes.size(), start);
+        }
+
+        // A map to keep track of values (variables and constants) in the function
+        std::map<int, llvm::Value*> valueMap;
+
+        // Function arguments
+        auto args = function->arg_begin();
+        llvm::Value* arg1 = args++;
+        llvm::Value* arg2 = args++;
+        llvm::Value* arg3 = args++;
+        llvm::Value* arg4 = args++;
+        valueMap[0] = arg1;
+        valueMap[1] = arg2;
+        valueMap[2] = arg3;
+        valueMap[TIME_REGISTER] = arg4;
+
+        // Load constants into valueMap
+        for (const auto& kv : program.constants) {
+            valueMap[kv.first] = llvm::ConstantFP::get(context, llvm::APFloat(kv.second));
+        }
+
+        // Process each instruction
+        for (size_t i = 0; i < program.instructions.size(); ++i) {
+            if (!live[i]) {
+                continue;
+            }
+            if (profiling && counter_of[i] != counter) {
+                if (counter != -1) {
+                    start = count_cycles(counter, start);
+                }
+                counter = counter_of[i];
+            }
+            const Instruction& instr = program.instructions[i];
+            llvm::Value* lhs = valueMap[instr.input1];
+            llvm::Value* rhs = (instr.input2 != -1) ? valueMap[instr.input2] : nullptr;
+            llvm::Value* result = nullptr;
+            llvm::Type* type = llvm_type(instr.type);
+
+            switch (instr.operation) {
+                case Operation::Add:
+                    result = builder.CreateFAdd(lhs, rhs, "addtmp");
+                    break;
+                case Operation::Sub:
+                    result = builder.CreateFSub(lhs, rhs, "subtmp");
+                    break;
+                case Operation::Mul:
+                    result = builder.CreateFMul(lhs, rhs, "multmp");
+                    break;
+                case Operation::Sqrt:
+                    result = intrinsic(llvm::Intrinsic::sqrt, type, {lhs});
+                    break;
+                case Operation::Min:
+                    result = intrinsic(llvm::Intrinsic::minnum, type, {lhs, rhs});
+                    break;
+                case Operation::Max:
+                    result = intrinsic(llvm::Intrinsic::maxnum, type, {lhs, rhs});
+                    break;
+                case Operation::Abs:
+                    result = intrinsic(llvm::Intrinsic::fabs, type, {lhs});
+                    break;
+                case Operation::Sin:
+                    result = accuracy == TrigAccuracy::Libm ? intrinsic(llvm::Intrinsic::sin, type, {lhs})
+                            : emit_sin_cos(builder, module.get(), lhs, false, accuracy == TrigAccuracy::Fast);
+                    break;
+                case Operation::Cos:
+                    result = accuracy == TrigAccuracy::Libm ? intrinsic(llvm::Intrinsic::cos, type, {lhs})
+                            : emit_sin_cos(builder, module.get(), lhs, true, accuracy == TrigAccuracy::Fast);
+                    break;
+                case Operation::Div:
+                    result = builder.CreateFDiv(lhs, rhs, "divtmp");
+                    break;
+                case Operation::Floor:
+                    result = intrinsic(llvm::Intrinsic::floor, type, {lhs});
+                    break;
+                case Operation::Round:
+                    result = intrinsic(llvm::Intrinsic::round, type, {lhs});
+                    break;
+                case Operation::Atan2: {
+                    // there is no LLVM intrinsic for atan2, call the C library
+                    llvm::Type* double_type = llvm::Type::getDoubleTy(context);
+                    llvm::FunctionType* atan2_type = llvm::FunctionType::get(double_type, {double_type, double_type}, false);
+                    result = builder.CreateCall(module->getOrInsertFunction("atan2", atan2_type), {lhs, rhs});
+                    break;
+                }
+                case Operation::Scatter:
+                    result = emit_scatter(builder, module.get(), function, *program.scatters[instr.data], lhs, rhs,
+                                          valueMap[instr.input3]);
+                    break;
+                case Operation::Volume:
+                    result = emit_volume(builder, module.get(), *program.volumes[instr.data], lhs, rhs,
+                                         valueMap[instr.input3]);
+                    break;
+                case Operation::Pack:
+                    result = llvm::UndefValue::get(type);
+                    result = builder.CreateInsertElement(result, lhs, (uint64_t) 0);
+                    result = builder.CreateInsertElement(result, rhs, (uint64_t) 1);
+                    if (instr.type == ValueType::Vec3) {
+                        result = builder.CreateInsertElement(result, valueMap[instr.input3], (uint64_t) 2);
+                    }
+                    break;
+                case Operation::Splat:
+                    result = builder.CreateVectorSplat(instr.type == ValueType::Vec3 ? 3 : 2, lhs);
+                    break;
+                case Operation::ExtractX:
+                    result = builder.CreateExtractElement(lhs, (uint64_t) 0);
+                    break;
+                case Operation::ExtractY:
+                    result = builder.CreateExtractElement(lhs, (uint64_t) 1);
+                    break;
+                case Operation::ExtractZ:
+                    result = builder.CreateExtractElement(lhs, (uint64_t) 2);
+                    break;
+                case Operation::Dot:
+                    result = builder.CreateFAddReduce(llvm::ConstantFP::get(context, llvm::APFloat(0.0)),
+                                                      builder.CreateFMul(lhs, rhs));
+                    break;
+                case Operation::Length:
+                    result = builder.CreateFAddReduce(llvm::ConstantFP::get(context, llvm::APFloat(0.0)),
+                                                      builder.CreateFMul(lhs, lhs));
+                    result = intrinsic(llvm::Intrinsic::sqrt, llvm::Type::getDoubleTy(context), {result});
+                    break;
+                case Operation::MaxElement:
+                    result = builder.CreateFPMaxReduce(lhs);
+                    break;
+                default:
+                    // Handle unknown operation
+                    assert(false && "Unknown operation");
+                    break;
+            }
+
+            // Store the result in the value map
+            valueMap[instr.output] = result;
+        }
+        if (counter != -1) {
+            count_cycles(counter, start);
+        }
+
+        return valueMap;
+    };
+
+    std::vector<int> outputs = {program.output};
+    outputs.insert(outputs.end(), program.extra_outputs.begin(), program.extra_outputs.end());
+    builder.CreateRet(lower(function, live_instructions(program, {program.output}))[program.output]);
+    if (profiling) {
+        llvm::verifyFunction(*function);
+        return module;
+    }
+    // mathFunc is inlined into the batch loop
+    function->addFnAttr(llvm::Attribute::AlwaysInline);
+
+    // Batch entry point: a loop calling mathFunc for every point. The coordinate and output arrays never
+    // alias, which allows the loop vectorizer to evaluate several points at once.
+    llvm::Type* double_type = builder.getDoubleTy();
+    llvm::Type* pointer_type = double_type->getPointerTo();
+    llvm::Type* index_type = builder.getInt64Ty();
+    llvm::FunctionType* batch_type = llvm::FunctionType::get(builder.getVoidTy(),
+        {pointer_type, pointer_type, pointer_type, double_type, pointer_type, index_type}, false);
+    llvm::Function* batch = llvm::Function::Create(batch_type, llvm::Function::ExternalLinkage, "batchFunc", module.get());
+    for (unsigned i : {0u, 1u, 2u, 4u}) {
+        batch->addParamAttr(i, llvm::Attribute::NoAlias);
+    }
+    {
+        auto batch_args = batch->arg_begin();
+        llvm::Value* xs = batch_args++;
+        llvm::Value* ys = batch_args++;
+        llvm::Value* zs = batch_args++;
+        llvm::Value* t = batch_args++;
+        llvm::Value* out = batch_args++;
+        llvm::Value* n = batch_args++;
+
+        llvm::BasicBlock* batch_entry = llvm::BasicBlock::Create(context, "entry", batch);
+        llvm::BasicBlock* loop = llvm::BasicBlock::Create(context, "loop", batch);
+        llvm::BasicBlock* exit = llvm::BasicBlock::Create(context, "exit", batch);
+        builder.SetInsertPoint(batch_entry);
+        builder.CreateCondBr(builder.CreateICmpSGT(n, builder.getInt64(0)), loop, exit);
+
+        builder.SetInsertPoint(loop);
+        llvm::PHINode* i = builder.CreatePHI(index_type, 2);
+        i->addIncoming(builder.getInt64(0), batch_entry);
+        llvm::Value* x = builder.CreateLoad(double_type, builder.CreateInBoundsGEP(double_type, xs, i));
+        llvm::Value* y = builder.CreateLoad(double_type, builder.CreateInBoundsGEP(double_type, ys, i));
+        llvm::Value* z = builder.CreateLoad(double_type, builder.CreateInBoundsGEP(double_type, zs, i));
+        llvm::Value* value = builder.CreateCall(function, {x, y, z, t});
+        builder.CreateStore(value, builder.CreateInBoundsGEP(double_type, out, i));
+        llvm::Value* next = builder.CreateAdd(i, builder.getInt64(1), "", true, true);
+        i->addIncoming(next, loop);
+        builder.CreateCondBr(builder.CreateICmpSLT(next, n), loop, exit);
+
+        builder.SetInsertPoint(exit);
+        builder.CreateRetVoid();
+    }
+
+    // Gradient entry point: the value and the central differences, mathFunc is inlined seven times
+    llvm::FunctionType* gradient_type = llvm::FunctionType::get(double_type,
+        {double_type, double_type, double_type, double_type, pointer_type}, false);
+    llvm::Function* gradient = llvm::Function::Create(gradient_type, llvm::Function::ExternalLinkage, "gradientFunc",
+                                                      module.get());
+    {
+        auto gradient_args = gradient->arg_begin();
+        llvm::Value* p[3];
+        for (llvm::Value*& coordinate : p) {
+            coordinate = gradient_args++;
+        }
+        llvm::Value* t = gradient_args++;
+        llvm::Value* out = gradient_args++;
+        builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", gradient));
+        llvm::Value* step = llvm::ConstantFP::get(double_type, GRADIENT_STEP);
+        llvm::Value* scale = llvm::ConstantFP::get(double_type, 0.5 / GRADIENT_STEP);
+        for (int axis = 0; axis < 3; ++axis) {
+            llvm::Value* forward[3] = {p[0], p[1], p[2]};
+            llvm::Value* backward[3] = {p[0], p[1], p[2]};
+            forward[axis] = builder.CreateFAdd(p[axis], step);
+            backward[axis] = builder.CreateFSub(p[axis], step);
+            llvm::Value* difference = builder.CreateFSub(
+                    builder.CreateCall(function, {forward[0], forward[1], forward[2], t}),
+                    builder.CreateCall(function, {backward[0], backward[1], backward[2], t}));
+            builder.CreateStore(builder.CreateFMul(difference, scale),
+                                builder.CreateInBoundsGEP(double_type, out, builder.getInt64(axis)));
+        }
+        builder.CreateRet(builder.CreateCall(function, {p[0], p[1], p[2], t}));
+    }
+
+    // All outputs in one pass, shared subgraphs are only evaluated once
+    llvm::FunctionType* all_type = llvm::FunctionType::get(builder.getVoidTy(),
+        {double_type, double_type, double_type, double_type, pointer_type}, false);
+    llvm::Function* all = llvm::Function::Create(all_type, llvm::Function::ExternalLinkage, "allFunc", module.get());
+    {
+        std::map<int, llvm::Value*> values = lower(all, live_instructions(program, outputs));
+        llvm::Value* out = all->getArg(4);
+        for (int k = 0; k < (int) outputs.size(); ++k) {
+            builder.CreateStore(values[outputs[k]], builder.CreateInBoundsGEP(double_type, out, builder.getInt64(k)));
+        }
+        builder.CreateRetVoid();
+    }
+
+    // Every extra output on its own, e.g. for the root finding of its surface
+    for (int k = 1; k < (int) outputs.size(); ++k) {
+        llvm::Function* output = llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
+                                                        "outputFunc" + std::to_string(k), module.get());
+        builder.CreateRet(lower(output, live_instructions(program, {outputs[k]}))[outputs[k]]);
+        llvm::verifyFunction(*output);
+    }
+
+    // Verify the functions
+    llvm::verifyFunction(*function);
+    llvm::verifyFunction(*batch);
+    llvm::verifyFunction(*gradient);
+    llvm::verifyFunction(*all);
+    return module;
+}
+
+// Run the O3 pipeline with inlining and the loop and SLP vectorizers, tuned for the target machine
+static void optimize_module(llvm::Module& module, llvm::TargetMachine* target) {
+    module.setDataLayout(target->createDataLayout());
+    module.setTargetTriple(target->getTargetTriple().str());
+    llvm::PassManagerBuilder pass_builder;
+    pass_builder.OptLevel = 3;
+    pass_builder.Inliner = llvm::createFunctionInliningPass(3, 0, false);
+    pass_builder.LoopVectorize = true;
+    pass_builder.SLPVectorize = true;
+    target->adjustPassManager(pass_builder);
+    llvm::legacy::FunctionPassManager function_passes(&module);
+    function_passes.add(llvm::createTargetTransformInfoWrapperPass(target->getTargetIRAnalysis()));
+    pass_builder.populateFunctionPassManager(function_passes);
+    llvm::legacy::PassManager module_passes;
+    module_passes.add(llvm::createTargetTransformInfoWrapperPass(target->getTargetIRAnalysis()));
+    pass_builder.populateModulePassManager(module_passes);
+    function_passes.doInitialization();
+    for (llvm::Function& f : module) {
+        function_passes.run(f);
+    }
+    function_passes.doFinalization();
+    module_passes.run(module);
+}
+
+// Optimize the module for the host CPU and compile it. The engine is never freed, such that the compiled functions
+// stay valid.
+static llvm::ExecutionEngine* create_engine(std::unique_ptr<llvm::Module> module) {
+    // Target the host CPU, such that the vectorizer can use all available vector extensions
+    std::string errMsg;
+    llvm::Module* module_ptr = module.get();
+    llvm::EngineBuilder engine_builder(std::move(module));
+    engine_builder.setOptLevel(llvm::CodeGenOpt::Aggressive).setErrorStr(&errMsg).setMCPU(llvm::sys::getHostCPUName());
+    llvm::TargetMachine* target = engine_builder.selectTarget();
+    if (!target) {
+        throw std::runtime_error(errMsg);
+    }
+    optimize_module(*module_ptr, target);
+
+    // Compile the functions, the engine takes ownership of the target machine
+    llvm::ExecutionEngine* engine = engine_builder.create(target);
+    if (!engine) {
+        // Handle error
+        throw std::runtime_error(errMsg);
+    }
+
+    engine->finalizeObject();
+    return engine;
+}
+
+Kernel compile_kernel(const Program& program, TrigAccuracy accuracy) {
+    // Initialize LLVM
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    llvm::LLVMContext context;
+    std::unique_ptr<llvm::Module> module = build_module(program, accuracy, context);
+
+    auto start_compile = std::chrono::high_resolution_clock::now();
+
+    llvm::ExecutionEngine* engine = create_engine(std::move(module));
+    Kernel kernel;
+    kernel.eval = reinterpret_cast<decltype(kernel.eval)>(engine->getFunctionAddress("mathFunc"));
+    kernel.batch = reinterpret_cast<decltype(kernel.batch)>(engine->getFunctionAddress("batchFunc"));
+    kernel.gradient = reinterpret_cast<decltype(kernel.gradient)>(engine->getFunctionAddress("gradientFunc"));
+    kernel.eval_all = reinterpret_cast<decltype(kernel.eval_all)>(engine->getFunctionAddress("allFunc"));
+    kernel.outputs = {kernel.eval};
+    for (int k = 1; k <= (int) program.extra_outputs.size(); ++k) {
+        kernel.outputs.push_back(reinterpret_cast<decltype(kernel.eval)>(
+                engine->getFunctionAddress("outputFunc" + std::to_string(k))));
+    }
+
+    auto end_compile = std::chrono::high_resolution_clock::now();
+    printf("Finalizing: %f ms\n", std::chrono::duration<double, std::milli>(end_compile - start_compile).count());
+
+    return kernel;
+}
+
+ProfilingKernel compile_profiling_kernel(const Program& program, TrigAccuracy accuracy) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    llvm::LLVMContext context;
+    ProfilingKernel kernel;
+    llvm::ExecutionEngine* engine = create_engine(build_module(program, accuracy, context, &kernel));
+    kernel.eval = reinterpret_cast<decltype(kernel.eval)>(engine->getFunctionAddress("mathFunc"));
+    return kernel;
+}
+
+void compile_object(const Program& program, const ObjectOptions& options, const std::string& object_path,
+                    const std::string& header_path) {
+    bool valid_name = !options.name.empty() && !std::isdigit((unsigned char) options.name[0]) &&
+                      std::all_of(options.name.begin(), options.name.end(), [](char c) {
+                          return std::isalnum((unsigned char) c) || c == '_';
+                      });
+    if (!valid_name) {
+        throw std::runtime_error(options.name + " is not a valid C identifier");
+    }
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    std::string triple = llvm::sys::getProcessTriple();
+    std::string error;
+    const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (!target) {
+        throw std::runtime_error(error);
+    }
+    // the baseline runs on every machine of the architecture, tuning for this machine has to be asked for
+    std::string cpu = options.cpu;
+    if (cpu.empty()) {
+        cpu = "generic";
+    } else if (cpu == "native") {
+        cpu = llvm::sys::getHostCPUName().str();
+    }
+    std::unique_ptr<llvm::MCSubtargetInfo> subtarget(target->createMCSubtargetInfo(triple, "", ""));
+    if (!subtarget || !subtarget->isCPUStringValid(cpu)) {
+        throw std::runtime_error("Unknown target CPU " + cpu);
+    }
+    std::unique_ptr<llvm::TargetMachine> machine(target->createTargetMachine(
+            triple, cpu, options.features, llvm::TargetOptions(), llvm::Reloc::PIC_, llvm::None,
+            llvm::CodeGenOpt::Aggressive));
+    if (!machine) {
+        throw std::runtime_error("Could not create a target machine for " + triple);
+    }
+
+    llvm::LLVMContext context;
+    std::unique_ptr<llvm::Module> module = build_module(program, options.accuracy, context);
+    module->getFunction("mathFunc")->setName(options.name + "_eval");
+    module->getFunction("batchFunc")->setName(options.name + "_batch");
+    module->getFunction("gradientFunc")->setName(options.name + "_gradient");
+    module->getFunction("allFunc")->setName(options.name + "_eval_all");
+    int num_outputs = 1 + (int) program.extra_outputs.size();
+    for (int k = 1; k < num_outputs; ++k) {
+        module->getFunction("outputFunc" + std::to_string(k))->setName(options.name + "_output" + std::to_string(k));
+    }
+    optimize_module(*module, machine.get());
+
+    llvm::SmallVector<char, 0> object;
+    llvm::raw_svector_ostream stream(object);
+    llvm::legacy::PassManager emit_passes;
+    if (machine->addPassesToEmitFile(emit_passes, stream, nullptr, llvm::CGFT_ObjectFile)) {
+        throw std::runtime_error("The target can't emit object files");
+    }
+    emit_passes.run(*module);
+
+    bool library = object_path.size() >= 2 && object_path.compare(object_path.size() - 2, 2, ".a") == 0;
+    if (library) {
+        llvm::NewArchiveMember member(llvm::MemoryBufferRef(llvm::StringRef(object.data(), object.size()),
+                                                            options.name + ".o"));
+        auto kind = machine->getTargetTriple().isOSDarwin() ? llvm::object::Archive::K_DARWIN
+                                                             : llvm::object::Archive::K_GNU;
+        if (llvm::Error archive_error = llvm::writeArchive(object_path, llvm::makeArrayRef(member), true, kind, true, false)) {
+            llvm::consumeError(std::move(archive_error));
+            throw std::runtime_error("Could not write " + object_path);
+        }
+    } else {
+        std::unique_ptr<FILE, int (*)(FILE*)> file(fopen(object_path.c_str(), "wb"), &fclose);
+        if (!file) {
+            throw std::runtime_error("Could not open " + object_path);
+        }
+        if (fwrite(object.data(), 1, object.size(), file.get()) != object.size() || fflush(file.get()) != 0) {
+            throw std::runtime_error("Could not write " + object_path);
+        }
+    }
+
+    std::unique_ptr<FILE, int (*)(FILE*)> header(fopen(header_path.c_str(), "w"), &fclose);
+    if (!header) {
+        throw std::runtime_error("Could not open " + header_path);
+    }
+    const char* name = options.name.c_str();
+    fprintf(header.get(), "// Generated from a Raumkuenstler graph for %s (%s), do not edit\n", triple.c_str(), cpu.c_str());
+    fprintf(header.get(), "#pragma once\n\n#include <stdint.h>\n\n");
+    fprintf(header.get(), "#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n");
+    fprintf(header.get(), "// Value of the graph at the point (x, y, z) and the time t\n");
+    fprintf(header.get(), "double %s_eval(double x, double y, double z, double t);\n\n", name);
+    fprintf(header.get(), "// out[i] = %s_eval(x[i], y[i], z[i], t) for i < n, the arrays must not overlap\n", name);
+    fprintf(header.get(), "void %s_batch(const double *x, const double *y, const double *z, double t, double *out, "
+                          "int64_t n);\n\n", name);
+    fprintf(header.get(), "// Returns %s_eval(x, y, z, t) and writes the gradient to gradient[0], gradient[1] and "
+                          "gradient[2]\n", name);
+    fprintf(header.get(), "double %s_gradient(double x, double y, double z, double t, double *gradient);\n\n", name);
+    std::string macro = options.name;
+    std::transform(macro.begin(), macro.end(), macro.begin(), [](char c) { return (char) std::toupper((unsigned char) c); });
+    fprintf(header.get(), "#define %s_NUM_OUTPUTS %d\n\n", macro.c_str(), num_outputs);
+    fprintf(header.get(), "// Writes all outputs to out[0], ..., out[%s_NUM_OUTPUTS - 1] in one pass, out[0] is %s_eval\n",
+            macro.c_str(), name);
+    fprintf(header.get(), "void %s_eval_all(double x, double y, double z, double t, double *out);\n\n", name);
+    for (int k = 1; k < num_outputs; ++k) {
+        fprintf(header.get(), "double %s_output%d(double x, double y, double z, double t);\n\n", name, k);
+    }
+    fprintf(header.get(), "#ifdef __cplusplus\n}\n#endif\n");
+    if (fflush(header.get()) != 0) {
+        throw std::runtime_error("Could not write " + header_path);
+    }
+}
+
+std::function<double(glm::dvec3, double)> compile_animated(const Program& program, TrigAccuracy accuracy) {
+    auto func = compile_kernel(program, accuracy).eval;
+    return [func](glm::dvec3 p, double t) -> double {
+        return func(p.x, p.y, p.z, t);
+    };
+}
 
-    // Process Instructions
-    // A map to keep track of values (variables and constants) in the function
-    std::map<int, llvm::Value*> valueMap;
+std::function<double(glm::dvec3)> compile(const Program& program, double time, TrigAccuracy accuracy) {
+    auto func = compile_animated(program, accuracy);
+    return [func, time](glm::dvec3 p) -> double {
+        return func(p, time);
+    };
+}
 
-    // Function arguments
-    auto args = function->arg_begin();
-    llvm::Value* arg1 = args++;
-    llvm::Value* arg2 = args++;
-    llvm::Value* arg3 = args++;
-    valueMap[0] = arg1;
-    valueMap[1] = arg2;
-    valueMap[2] = arg3;
+void compact_registers(Program& program) {
+    // Index of the last instruction reading each register, the output is live until the end
+    std::vector<int> last_use(program.num_registers, -1);
+    for (int i = 0; i < (int) program.instructions.size(); ++i) {
+        const Instruction& instr = program.instructions[i];
+        last_use[instr.input1] = i;
+        if (instr.input2 != -1) {
+            last_use[instr.input2] = i;
+        }
+        if (instr.input3 != -1) {
+            last_use[instr.input3] = i;
+        }
+    }
+    last_use[program.output] = (int) program.instructions.size();
+    for (int output : program.extra_outputs) {
+        last_use[output] = (int) program.instructions.size();
+    }
 
-    // Load constants into valueMap
-    for (const auto& kv : constants) {
-        valueMap[kv.first] = llvm::ConstantFP::get(context, llvm::APFloat(kv.second));
+    // The point, the time and the constants keep a register for the whole program
+    std::vector<int> mapping(program.num_registers, -1);
+    for (int i = 0; i < FIRST_FREE_REGISTER; ++i) {
+        mapping[i] = i;
     }
+    int next_register = FIRST_FREE_REGISTER;
+    std::map<int, double> constants;
+    for (const auto& kv : program.constants) {
+        mapping[kv.first] = next_register;
+        constants[next_register++] = kv.second;
+    }
+    int first_temporary = next_register;
+
+    // Linear scan over the instructions, registers of dead temporaries are handed out again
+    std::vector<int> free_registers;
+    auto release = [&](int reg, int i) {
+        if (reg != -1 && mapping[reg] >= first_temporary && last_use[reg] <= i) {
+            free_registers.push_back(mapping[reg]);
+            last_use[reg] = INT32_MAX;
+        }
+    };
+    for (int i = 0; i < (int) program.instructions.size(); ++i) {
+        Instruction& instr = program.instructions[i];
+        int input1 = instr.input1;
+        int input2 = instr.input2;
+        int input3 = instr.input3;
+        instr.input1 = mapping[input1];
+        instr.input2 = input2 == -1 ? -1 : mapping[input2];
+        instr.input3 = input3 == -1 ? -1 : mapping[input3];
+        // inputs are read before the output is written, so the output may take over an input register
+        release(input1, i);
+        release(input2, i);
+        release(input3, i);
+        if (free_registers.empty()) {
+            mapping[instr.output] = next_register++;
+        } else {
+            mapping[instr.output] = free_registers.back();
+            free_registers.pop_back();
+        }
+        int output = instr.output;
+        instr.output = mapping[output];
+        // results that are never read
+        release(output, i);
+    }
+    program.constants = std::move(constants);
+    program.output = mapping[program.output];
+    for (int& output : program.extra_outputs) {
+        output = mapping[output];
+    }
+    program.num_registers = next_register;
+}
 
-    // Process each instruction
-    for (const auto& instr : instructions) {
-        llvm::Value* lhs = valueMap[instr.input1];
-        llvm::Value* rhs = (instr.input2 != -1) ? valueMap[instr.input2] : nullptr;
-        llvm::Value* result = nullptr;
+bool depends_on_time(const Program& program) {
+    // a Time node connected directly to an output doesn't generate any instruction
+    if (program.output == TIME_REGISTER || std::find(program.extra_outputs.begin(), program.extra_outputs.end(),
+                                                     TIME_REGISTER) != program.extra_outputs.end()) {
+        return true;
+    }
+    return std::any_of(program.instructions.begin(), program.instructions.end(), [](const Instruction& instr) {
+        return instr.input1 == TIME_REGISTER || instr.input2 == TIME_REGISTER || instr.input3 == TIME_REGISTER;
+    });
+}
 
+// Interval of the values of a register and bound of the absolute value of its derivative by the time
+struct TimeBound {
+    double lower;
+    double upper;
+    double speed;
+    // If the value is a sum of squares, the sum of the squared speeds of their bases, otherwise negative. The speed
+    // of its square root is bounded by the square root of this.
+    double square_speed = -1.0;
+
+    double magnitude() const { return std::max(std::abs(lower), std::abs(upper)); }
+};
+
+// Product of two non-negative bounds, zero wins over infinity
+static double bound_product(double a, double b) {
+    return a == 0.0 || b == 0.0 ? 0.0 : a * b;
+}
+
+// Interval of the product, infinite ends are multiplied with zero like in bound_product
+static TimeBound interval_product(const TimeBound& a, const TimeBound& b) {
+    double products[4] = {a.lower * b.lower, a.lower * b.upper, a.upper * b.lower, a.upper * b.upper};
+    double ends[4][2] = {{a.lower, b.lower}, {a.lower, b.upper}, {a.upper, b.lower}, {a.upper, b.upper}};
+    for (int i = 0; i < 4; ++i) {
+        if (ends[i][0] == 0.0 || ends[i][1] == 0.0) {
+            products[i] = 0.0;
+        }
+    }
+    return {*std::min_element(products, products + 4), *std::max_element(products, products + 4),
+            bound_product(a.magnitude(), b.speed) + bound_product(b.magnitude(), a.speed)};
+}
+
+// Smallest absolute value in the interval
+static double interval_distance_to_zero(const TimeBound& a) {
+    return a.lower > 0.0 ? a.lower : a.upper < 0.0 ? -a.upper : 0.0;
+}
+
+double time_speed_bound(const Program& program, glm::dvec3 lower, glm::dvec3 upper) {
+    constexpr double infinity = std::numeric_limits<double>::infinity();
+    std::map<int, TimeBound> bounds;
+    for (int axis = 0; axis < 3; ++axis) {
+        bounds[axis] = {lower[axis], upper[axis], 0.0};
+    }
+    bounds[TIME_REGISTER] = {-infinity, infinity, 1.0};
+    for (const auto& kv : program.constants) {
+        bounds[kv.first] = {kv.second, kv.second, 0.0};
+    }
+    auto bound = [&](int reg) -> TimeBound {
+        auto it = bounds.find(reg);
+        return it != bounds.end() ? it->second : TimeBound{-infinity, infinity, infinity};
+    };
+    // the speed of an operation that jumps or isn't bounded, unless its inputs don't depend on the time
+    auto unbounded = [&](double speed) {
+        return speed == 0.0 ? 0.0 : infinity;
+    };
+
+    std::vector<bool> live = live_instructions(program, {program.output});
+    for (size_t i = 0; i < program.instructions.size(); ++i) {
+        if (!live[i]) {
+            continue;
+        }
+        const Instruction& instr = program.instructions[i];
+        TimeBound a = bound(instr.input1);
+        TimeBound b = instr.input2 != -1 ? bound(instr.input2) : TimeBound{0.0, 0.0, 0.0};
+        double lanes = instr.type == ValueType::Vec3 ? 3.0 : instr.type == ValueType::Vec2 ? 2.0 : 1.0;
+        TimeBound result{-infinity, infinity, infinity};
         switch (instr.operation) {
             case Operation::Add:
-                result = builder.CreateFAdd(lhs, rhs, "addtmp");
+                result = {a.lower + b.lower, a.upper + b.upper, a.speed + b.speed};
+                if (a.square_speed >= 0.0 && b.square_speed >= 0.0) {
+                    result.square_speed = a.square_speed + b.square_speed;
+                }
                 break;
             case Operation::Sub:
-                result = builder.CreateFSub(lhs, rhs, "subtmp");
+                result = {a.lower - b.upper, a.upper - b.lower, a.speed + b.speed};
                 break;
             case Operation::Mul:
-                result = builder.CreateFMul(lhs, rhs, "multmp");
+                result = interval_product(a, b);
+                if (instr.input1 == instr.input2 && instr.type == ValueType::Scalar) {
+                    result.lower = std::max(result.lower, 0.0);
+                    result.square_speed = a.speed * a.speed;
+                }
+                break;
+            case Operation::Div: {
+                double distance = interval_distance_to_zero(b);
+                if (distance == 0.0) {
+                    result.speed = unbounded(a.speed + b.speed);
+                    break;
+                }
+                result = interval_product(a, {1.0 / b.upper, 1.0 / b.lower, 0.0});
+                result.speed = a.speed / distance + bound_product(b.speed, a.magnitude() / (distance * distance));
                 break;
+            }
             case Operation::Sqrt:
-                // Assuming sqrt function is available in your LLVM setup
-                result = builder.CreateCall(module->getOrInsertFunction("llvm.sqrt.f64", funcType), lhs, "sqrttmp");
+                result = {std::sqrt(std::max(a.lower, 0.0)), std::sqrt(std::max(a.upper, 0.0)),
+                          a.lower > 0.0 ? a.speed / (2.0 * std::sqrt(a.lower)) : unbounded(a.speed)};
+                if (a.square_speed >= 0.0) {
+                    result.speed = std::min(result.speed, std::sqrt(a.square_speed));
+                }
                 break;
             case Operation::Min:
-                // Implement Min operation
-                result = builder.CreateSelect(builder.CreateFCmpULT(lhs, rhs), lhs, rhs);
+                result = {std::min(a.lower, b.lower), std::min(a.upper, b.upper), std::max(a.speed, b.speed)};
                 break;
             case Operation::Max:
-                // Implement Max operation
-                result = builder.CreateSelect(builder.CreateFCmpULT(lhs, rhs), rhs, lhs);
+                result = {std::max(a.lower, b.lower), std::max(a.upper, b.upper), std::max(a.speed, b.speed)};
                 break;
             case Operation::Abs:
-                // Implement Abs operation
-                result = builder.CreateSelect(builder.CreateFCmpULT(lhs, llvm::ConstantFP::get(context, llvm::APFloat(0.0))), builder.CreateFNeg(lhs), lhs);
+                result = {interval_distance_to_zero(a), a.magnitude(), a.speed};
                 break;
             case Operation::Sin:
-                // Implement Sin operation
-                result = builder.CreateCall(module->getOrInsertFunction("llvm.sin.f64", funcType), lhs, "sintmp");
-                break;
             case Operation::Cos:
-                // Implement Cos operation
-                result = builder.CreateCall(module->getOrInsertFunction("llvm.cos.f64", funcType), lhs, "costmp");
+                result = {-1.0, 1.0, a.speed};
+                break;
+            case Operation::Floor:
+            case Operation::Round:
+                result = {std::floor(a.lower), std::ceil(a.upper), unbounded(a.speed)};
+                break;
+            case Operation::Atan2: {
+                // the derivative of atan2(y, x) is (x y' - y x') / (x^2 + y^2)
+                double distance = std::hypot(interval_distance_to_zero(a), interval_distance_to_zero(b));
+                result = {-M_PI, M_PI, distance > 0.0 ? (bound_product(b.magnitude(), a.speed) +
+                                                         bound_product(a.magnitude(), b.speed)) / (distance * distance)
+                                                      : unbounded(a.speed + b.speed)};
+                break;
+            }
+            case Operation::Scatter:
+            case Operation::Volume:
+                // distance fields change at most as fast as the point moves
+                result.speed = a.speed + b.speed + bound(instr.input3).speed;
+                break;
+            case Operation::Pack: {
+                TimeBound c = instr.type == ValueType::Vec3 ? bound(instr.input3) : b;
+                result = {std::min({a.lower, b.lower, c.lower}), std::max({a.upper, b.upper, c.upper}),
+                          std::max({a.speed, b.speed, c.speed})};
+                break;
+            }
+            case Operation::Splat:
+            case Operation::ExtractX:
+            case Operation::ExtractY:
+            case Operation::ExtractZ:
+            case Operation::MaxElement:
+                result = a;
+                break;
+            case Operation::Dot: {
+                TimeBound product = interval_product(a, b);
+                result = {lanes * product.lower, lanes * product.upper, lanes * product.speed};
+                if (instr.input1 == instr.input2) {
+                    result.lower = std::max(result.lower, 0.0);
+                    result.square_speed = lanes * a.speed * a.speed;
+                }
+                break;
+            }
+            case Operation::Length:
+                result = {0.0, std::sqrt(lanes) * a.magnitude(), std::sqrt(lanes) * a.speed};
                 break;
             default:
-                // Handle unknown operation
-                assert(false && "Unknown operation");
                 break;
         }
-
-        // Store the result in the value map
-        valueMap[instr.output] = result;
+        if (std::isnan(result.speed)) {
+            result.speed = infinity;
+        }
+        if (std::isnan(result.lower) || std::isnan(result.upper)) {
+            result.lower = -infinity;
+            result.upper = infinity;
+        }
+        bounds[instr.output] = result;
     }
+    return bound(program.output).speed;
+}
 
-    // The final instruction should put its result in `valueMap[output]` for the return value
-    builder.CreateRet(valueMap[instructions.back().output]);
-
-    // Verify the function
-    llvm::verifyFunction(*function);
-
-    auto start_compile = std::chrono::high_resolution_clock::now();
+// Magic number and version of the program files
+constexpr uint32_t PROGRAM_MAGIC = 0x504b4152; // "RAKP"
+constexpr uint32_t PROGRAM_VERSION = 4;
 
-    // Compile the function
-    std::string errMsg;
-    llvm::ExecutionEngine* engine = llvm::EngineBuilder(std::move(module)).setOptLevel(llvm::CodeGenOpt::Aggressive).setErrorStr(&errMsg).create();
-    if (!engine) {
-        // Handle error
-        throw std::runtime_error(errMsg);
+void write_program(const Program& program, const std::string& path) {
+    std::unique_ptr<FILE, int (*)(FILE*)> file(fopen(path.c_str(), "wb"), &fclose);
+    if (!file) {
+        throw std::runtime_error("Could not open " + path);
     }
+    auto write = [&](const auto& value) {
+        if (fwrite(&value, sizeof(value), 1, file.get()) != 1) {
+            throw std::runtime_error("Could not write " + path);
+        }
+    };
+    auto write_vector = [&](glm::dvec3 v) {
+        write(v.x);
+        write(v.y);
+        write(v.z);
+    };
+    write(PROGRAM_MAGIC);
+    write(PROGRAM_VERSION);
+    write((int32_t) program.num_registers);
+    write((int32_t) program.output);
+    write((uint64_t) program.extra_outputs.size());
+    for (int output : program.extra_outputs) {
+        write((int32_t) output);
+    }
+    write((uint64_t) program.constants.size());
+    for (const auto& [reg, value] : program.constants) {
+        write((int32_t) reg);
+        write(value);
+    }
+    write((uint64_t) program.instructions.size());
+    for (const Instruction& instr : program.instructions) {
+        write((int32_t) instr.input1);
+        write((int32_t) instr.input2);
+        write((int32_t) instr.input3);
+        write((int32_t) instr.output);
+        write((int32_t) instr.operation);
+        write((int32_t) instr.type);
+        write((int32_t) instr.data);
+    }
+    write((uint64_t) program.scatters.size());
+    for (const auto& set : program.scatters) {
+        write((uint64_t) set->instances.size());
+        for (const ScatterInstance& instance : set->instances) {
+            write((int32_t) instance.primitive);
+            write_vector(instance.position);
+            write_vector(instance.size);
+            for (int i = 0; i < 3; ++i) {
+                write_vector(instance.rotation[i]);
+            }
+        }
+        write((uint64_t) set->nodes.size());
+        for (const BVHNode& node : set->nodes) {
+            write_vector(node.lower);
+            write_vector(node.upper);
+            write((int32_t) node.first);
+            write((int32_t) node.count);
+        }
+    }
+    auto write_array = [&](const auto& values) {
+        write((uint64_t) values.size());
+        if (!values.empty() && fwrite(values.data(), sizeof(values[0]), values.size(), file.get()) != values.size()) {
+            throw std::runtime_error("Could not write " + path);
+        }
+    };
+    write((uint64_t) program.volumes.size());
+    for (const auto& volume : program.volumes) {
+        write_vector(volume->lower);
+        write_vector(volume->upper);
+        write_vector(volume->spacing);
+        for (int i = 0; i < 3; ++i) {
+            write((int32_t) volume->bricks[i]);
+        }
+        write_array(volume->brick_index);
+        write_array(volume->brick_values);
+        write_array(volume->samples);
+    }
+    if (fflush(file.get()) != 0) {
+        throw std::runtime_error("Could not write " + path);
+    }
+}
 
-    engine->finalizeObject();
-    void* funcPtr = engine->getPointerToFunction(function);
-
-    auto end_compile = std::chrono::high_resolution_clock::now();
-    printf("Finalizing: %f ms\n", std::chrono::duration<double, std::milli>(end_compile - start_compile).count());
+// Check that every index of a program read from a file is in range, such that a corrupt file can't make the
+// compiler read out of bounds. Throws std::runtime_error naming the first problem.
+static void validate_program(const Program& program, const std::string& path) {
+    auto fail = [&](const std::string& problem) {
+        throw std::runtime_error(path + " is corrupt: " + problem);
+    };
+    if (program.num_registers < FIRST_FREE_REGISTER) {
+        fail("too few registers");
+    }
+    auto is_register = [&](int reg) {
+        return reg >= 0 && reg < program.num_registers;
+    };
+    if (!is_register(program.output)) {
+        fail("output register out of range");
+    }
+    for (int output : program.extra_outputs) {
+        if (!is_register(output)) {
+            fail("output register out of range");
+        }
+    }
+    for (const auto& kv : program.constants) {
+        if (kv.first < FIRST_FREE_REGISTER || kv.first >= program.num_registers) {
+            fail("constant register out of range");
+        }
+    }
+    for (const Instruction& instr : program.instructions) {
+        if (instr.operation <= Operation::None || instr.operation > Operation::MaxElement) {
+            fail("unknown operation");
+        }
+        if (instr.type < ValueType::Scalar || instr.type > ValueType::Vec3) {
+            fail("unknown value type");
+        }
+        bool binary = instr.operation == Operation::Add || instr.operation == Operation::Sub ||
+                      instr.operation == Operation::Mul || instr.operation == Operation::Min ||
+                      instr.operation == Operation::Max || instr.operation == Operation::Div ||
+                      instr.operation == Operation::Atan2 || instr.operation == Operation::Dot ||
+                      instr.operation == Operation::Pack || instr.operation == Operation::Scatter ||
+                      instr.operation == Operation::Volume;
+        bool ternary = instr.operation == Operation::Scatter || instr.operation == Operation::Volume ||
+                       (instr.operation == Operation::Pack && instr.type == ValueType::Vec3);
+        // unused inputs are -1
+        auto is_input = [&](int reg, bool used) {
+            return used ? is_register(reg) : reg == -1 || is_register(reg);
+        };
+        if (!is_register(instr.input1) || !is_input(instr.input2, binary) || !is_input(instr.input3, ternary)) {
+            fail("input register out of range");
+        }
+        if (instr.output < FIRST_FREE_REGISTER || instr.output >= program.num_registers) {
+            fail("output register out of range");
+        }
+        if ((instr.operation == Operation::Scatter && (instr.data < 0 || instr.data >= (int) program.scatters.size())) ||
+            (instr.operation == Operation::Volume && (instr.data < 0 || instr.data >= (int) program.volumes.size()))) {
+            fail("data index out of range");
+        }
+    }
+    for (const auto& set : program.scatters) {
+        for (const ScatterInstance& instance : set->instances) {
+            if (instance.primitive != ScatterPrimitive::Sphere && instance.primitive != ScatterPrimitive::Box) {
+                fail("unknown primitive");
+            }
+        }
+        // children follow their parent, which rules out cycles, and the depth has to fit the traversal stack
+        std::vector<int> depth(set->nodes.size(), 0);
+        for (int i = 0; i < (int) set->nodes.size(); ++i) {
+            const BVHNode& node = set->nodes[i];
+            if (node.count > 0) {
+                if (node.first < 0 || node.first > (int) set->instances.size() - node.count) {
+                    fail("BVH leaf out of range");
+                }
+            } else if (node.count < 0 || node.first <= i || node.first >= (int) set->nodes.size() - 1) {
+                fail("BVH node out of range");
+            } else {
+                depth[node.first] = depth[node.first + 1] = depth[i] + 1;
+                if (depth[i] + 2 > SCATTER_STACK_SIZE) {
+                    fail("BVH too deep");
+                }
+            }
+        }
+    }
+    for (const auto& volume : program.volumes) {
+        size_t num_bricks = 1;
+        for (int i = 0; i < 3; ++i) {
+            if (volume->bricks[i] < 1 || volume->bricks[i] > std::numeric_limits<int>::max() / BRICK_SIZE ||
+                !(volume->spacing[i] > 0.0) || !std::isfinite(1.0 / volume->spacing[i])) {
+                fail("invalid volume grid");
+            }
+            num_bricks *= (size_t) volume->bricks[i];
+        }
+        if (num_bricks > (size_t) std::numeric_limits<int>::max() || volume->brick_index.size() != num_bricks ||
+            volume->brick_values.size() != num_bricks || volume->samples.empty() ||
+            volume->samples.size() % BRICK_SAMPLES != 0) {
+            fail("volume arrays don't match its grid");
+        }
+        size_t num_stored = volume->samples.size() / BRICK_SAMPLES;
+        for (int32_t index : volume->brick_index) {
+            if (index < -1 || (index >= 0 && (size_t) index >= num_stored)) {
+                fail("volume brick out of range");
+            }
+        }
+    }
+}
 
-    typedef double (*FuncType)(double, double, double);
-    auto func = reinterpret_cast<FuncType>(funcPtr);
-    return [func](glm::dvec3 p) -> double {
-        return func(p.x, p.y, p.z);
+Program read_program(const std::string& path) {
+    std::unique_ptr<FILE, int (*)(FILE*)> file(fopen(path.c_str(), "rb"), &fclose);
+    if (!file) {
+        throw std::runtime_error("Could not open " + path);
+    }
+    // sizes larger than the file are corrupt, they would only fail after allocating the memory
+    uint64_t file_size = 0;
+    if (fseek(file.get(), 0, SEEK_END) == 0) {
+        long end = ftell(file.get());
+        file_size = end > 0 ? (uint64_t) end : 0;
+    }
+    if (fseek(file.get(), 0, SEEK_SET) != 0) {
+        throw std::runtime_error("Could not read " + path);
+    }
+    auto read = [&](auto& value) {
+        if (fread(&value, sizeof(value), 1, file.get()) != 1) {
+            throw std::runtime_error("Unexpected end of " + path);
+        }
     };
+    auto read_int = [&]() {
+        int32_t value;
+        read(value);
+        return (int) value;
+    };
+    auto read_size = [&]() {
+        uint64_t value;
+        read(value);
+        if (value > file_size) {
+            throw std::runtime_error("Unexpected end of " + path);
+        }
+        return (size_t) value;
+    };
+    auto read_vector = [&]() {
+        glm::dvec3 v;
+        read(v.x);
+        read(v.y);
+        read(v.z);
+        return v;
+    };
+    uint32_t magic, version;
+    read(magic);
+    read(version);
+    if (magic != PROGRAM_MAGIC || version != PROGRAM_VERSION) {
+        throw std::runtime_error(path + " is not a program file");
+    }
+    Program program;
+    program.num_registers = read_int();
+    program.output = read_int();
+    program.extra_outputs.resize(read_size());
+    for (int& output : program.extra_outputs) {
+        output = read_int();
+    }
+    size_t num_constants = read_size();
+    for (size_t i = 0; i < num_constants; ++i) {
+        int reg = read_int();
+        read(program.constants[reg]);
+    }
+    program.instructions.resize(read_size());
+    for (Instruction& instr : program.instructions) {
+        instr.input1 = read_int();
+        instr.input2 = read_int();
+        instr.input3 = read_int();
+        instr.output = read_int();
+        instr.operation = (Operation) read_int();
+        instr.type = (ValueType) read_int();
+        instr.data = read_int();
+    }
+    program.scatters.resize(read_size());
+    for (auto& set : program.scatters) {
+        auto scatter = std::make_shared<ScatterSet>();
+        scatter->instances.resize(read_size());
+        for (ScatterInstance& instance : scatter->instances) {
+            instance.primitive = (ScatterPrimitive) read_int();
+            instance.position = read_vector();
+            instance.size = read_vector();
+            for (int i = 0; i < 3; ++i) {
+                instance.rotation[i] = read_vector();
+            }
+        }
+        scatter->nodes.resize(read_size());
+        for (BVHNode& node : scatter->nodes) {
+            node.lower = read_vector();
+            node.upper = read_vector();
+            node.first = read_int();
+            node.count = read_int();
+        }
+        set = std::move(scatter);
+    }
+    auto read_array = [&](auto& values) {
+        values.resize(read_size());
+        if (!values.empty() && fread(values.data(), sizeof(values[0]), values.size(), file.get()) != values.size()) {
+            throw std::runtime_error("Unexpected end of " + path);
+        }
+    };
+    program.volumes.resize(read_size());
+    for (auto& volume : program.volumes) {
+        auto baked = std::make_shared<SparseVolume>();
+        baked->lower = read_vector();
+        baked->upper = read_vector();
+        baked->spacing = read_vector();
+        for (int i = 0; i < 3; ++i) {
+            baked->bricks[i] = read_int();
+        }
+        read_array(baked->brick_index);
+        read_array(baked->brick_values);
+        read_array(baked->samples);
+        volume = std::move(baked);
+    }
+    validate_program(program, path);
+    return program;
 }
 
 int generate_constant(std::map<int, double>& constants, int& current_register, double value) {
@@ -285,6 +1627,91 @@ int generate_cos (std::vector<Instruction>& instructions, int& current_register,
     return i1.output;
 }
 
+int generate_div (std::vector<Instruction>& instructions, int& current_register, int v1, int v2) {
+    Instruction i1 = {v1, v2, current_register++, Operation::Div};
+    instructions.insert(instructions.end(), {i1});
+    return i1.output;
+}
+
+int generate_floor (std::vector<Instruction>& instructions, int& current_register, int v1) {
+    Instruction i1 = {v1, -1, current_register++, Operation::Floor};
+    instructions.insert(instructions.end(), {i1});
+    return i1.output;
+}
+
+int generate_round (std::vector<Instruction>& instructions, int& current_register, int v1) {
+    Instruction i1 = {v1, -1, current_register++, Operation::Round};
+    instructions.insert(instructions.end(), {i1});
+    return i1.output;
+}
+
+int generate_atan2 (std::vector<Instruction>& instructions, int& current_register, int y, int x) {
+    Instruction i1 = {y, x, current_register++, Operation::Atan2};
+    instructions.insert(instructions.end(), {i1});
+    return i1.output;
+}
+
+int generate_scatter (std::vector<Instruction>& instructions, int& current_register, glm::ivec3 p, int scatter) {
+    Instruction i1 = {p.x, p.y, current_register++, Operation::Scatter, ValueType::Scalar, p.z, scatter};
+    instructions.push_back(i1);
+    return i1.output;
+}
+
+int generate_volume (std::vector<Instruction>& instructions, int& current_register, glm::ivec3 p, int volume) {
+    Instruction i1 = {p.x, p.y, current_register++, Operation::Volume, ValueType::Scalar, p.z, volume};
+    instructions.push_back(i1);
+    return i1.output;
+}
+
+int generate_pack (std::vector<Instruction>& instructions, int& current_register, glm::ivec2 v) {
+    Instruction i1 = {v.x, v.y, current_register++, Operation::Pack, ValueType::Vec2};
+    instructions.push_back(i1);
+    return i1.output;
+}
+
+int generate_pack (std::vector<Instruction>& instructions, int& current_register, glm::ivec3 v) {
+    Instruction i1 = {v.x, v.y, current_register++, Operation::Pack, ValueType::Vec3, v.z};
+    instructions.push_back(i1);
+    return i1.output;
+}
+
+int generate_splat (std::vector<Instruction>& instructions, int& current_register, ValueType type, int v) {
+    Instruction i1 = {v, -1, current_register++, Operation::Splat, type};
+    instructions.push_back(i1);
+    return i1.output;
+}
+
+int generate_extract (std::vector<Instruction>& instructions, int& current_register, ValueType type, int v, int component) {
+    constexpr Operation extract[] = {Operation::ExtractX, Operation::ExtractY, Operation::ExtractZ};
+    Instruction i1 = {v, -1, current_register++, extract[component], type};
+    instructions.push_back(i1);
+    return i1.output;
+}
+
+int generate_op (std::vector<Instruction>& instructions, int& current_register, Operation op, ValueType type, int v1, int v2) {
+    Instruction i1 = {v1, v2, current_register++, op, type};
+    instructions.push_back(i1);
+    return i1.output;
+}
+
+int generate_dot (std::vector<Instruction>& instructions, int& current_register, ValueType type, int v1, int v2) {
+    Instruction i1 = {v1, v2, current_register++, Operation::Dot, type};
+    instructions.push_back(i1);
+    return i1.output;
+}
+
+int generate_length (std::vector<Instruction>& instructions, int& current_register, ValueType type, int v) {
+    Instruction i1 = {v, -1, current_register++, Operation::Length, type};
+    instructions.push_back(i1);
+    return i1.output;
+}
+
+int generate_max_element (std::vector<Instruction>& instructions, int& current_register, ValueType type, int v) {
+    Instruction i1 = {v, -1, current_register++, Operation::MaxElement, type};
+    instructions.push_back(i1);
+    return i1.output;
+}
+
 const char* return_op_name(Operation op){
     switch(op){
         case Operation::Add:
@@ -305,6 +1732,34 @@ const char* return_op_name(Operation op){
             return "Sin";
         case Operation::Cos:
             return "Cos";
+        case Operation::Div:
+            return "Div";
+        case Operation::Floor:
+            return "Floor";
+        case Operation::Round:
+            return "Round";
+        case Operation::Atan2:
+            return "Atan2";
+        case Operation::Scatter:
+            return "Scatter";
+        case Operation::Volume:
+            return "Volume";
+        case Operation::Pack:
+            return "Pack";
+        case Operation::Splat:
+            return "Splat";
+        case Operation::ExtractX:
+            return "ExtractX";
+        case Operation::ExtractY:
+            return "ExtractY";
+        case Operation::ExtractZ:
+            return "ExtractZ";
+        case Operation::Dot:
+            return "Dot";
+        case Operation::Length:
+            return "Length";
+        case Operation::MaxElement:
+            return "MaxElement";
         default:
             return "Unknown";
     }
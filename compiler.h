@@ -9,6 +9,12 @@
 #include <functional>
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
+#include <memory>
+#include <cstdint>
+#include <string>
+
+#include "scatter.h"
+#include "volume.h"
 
 enum class Operation {
     None = 0,
@@ -20,7 +26,34 @@ enum class Operation {
     Max,
     Abs,
     Sin,
-    Cos
+    Cos,
+    Div,
+    Floor,
+    Round,
+    // atan2(input1, input2), only for scalars
+    Atan2,
+    // Distance to the union of a scatter set at the point (input1, input2, input3)
+    Scatter,
+    // Trilinear lookup into a baked volume at the point (input1, input2, input3)
+    Volume,
+    // Vector operations, the instruction type is the type of the vector operand(s)
+    Pack,
+    Splat,
+    ExtractX,
+    ExtractY,
+    ExtractZ,
+    Dot,
+    Length,
+    MaxElement
+};
+
+// Type of the values an instruction operates on. Element-wise operations (Add, Sub, Mul, Div, Sqrt, Min, Max,
+// Abs, Sin, Cos, Floor, Round) produce a value of the same type, Pack and Splat produce a vector of the type and all other vector
+// operations produce a scalar.
+enum class ValueType {
+    Scalar,
+    Vec2,
+    Vec3
 };
 
 // Representation of a single instruction used as an input for LLVM compiler
@@ -29,9 +62,136 @@ struct Instruction {
     int input2;
     int output;
     Operation operation;
+    ValueType type = ValueType::Scalar;
+    // Only used by Pack, Scatter and Volume
+    int input3 = -1;
+    // Index into Program::scatters for Scatter and into Program::volumes for Volume
+    int data = -1;
+};
+
+// Registers 0, 1 and 2 hold the coordinates of the point, register 3 holds the animation time
+constexpr int TIME_REGISTER = 3;
+constexpr int FIRST_FREE_REGISTER = 4;
+
+// Node of the graph an instruction was generated by and the point context it was lowered in
+struct InstructionSource {
+    int node_id = -1;
+    int context = 0;
+};
+
+// A lowered graph: instructions in execution order, the values of the constant registers and the register
+// holding the result
+struct Program {
+    std::vector<Instruction> instructions;
+    std::map<int, double> constants;
+    int output = -1;
+    // Registers of further outputs of the graph, e.g. other surfaces or a material id
+    std::vector<int> extra_outputs;
+    // Number of registers used, including the point and the time
+    int num_registers = FIRST_FREE_REGISTER;
+    // Instance sets with their BVH, baked into the kernel as constant arrays
+    std::vector<std::shared_ptr<const ScatterSet>> scatters;
+    // Baked subgraphs, stored in the kernel as constant arrays as well
+    std::vector<std::shared_ptr<const SparseVolume>> volumes;
+    // Source of every instruction, filled by Editor::generate_program for profiling and not serialized
+    std::vector<InstructionSource> sources;
+};
+
+// Renumber the registers such that the constants follow the input registers densely and every temporary
+// reuses a register whose value is no longer needed. Afterward, num_registers is the size of the register file.
+void compact_registers(Program& program);
+
+// Mark the instructions the given output registers depend on, instructions of other outputs and dead code are
+// not compiled into the entry point of an output
+std::vector<bool> live_instructions(const Program& program, const std::vector<int>& outputs);
+
+// How Sin and Cos are lowered. Libm calls llvm.sin/llvm.cos which become scalar library calls and block
+// vectorization. Precise inlines a range reduced double polynomial (error of a few ulp for |x| < 1e6), Fast
+// evaluates a float polynomial (about 1e-7 absolute error near zero, growing with |x| since x is rounded to float).
+enum class TrigAccuracy {
+    Libm,
+    Precise,
+    Fast
+};
+
+// Entry points of a compiled program. eval evaluates the output at a single point at time t, batch evaluates the
+// points (x[i], y[i], z[i]) for i < n into out[i]. The batch loop is vectorized where all operations allow it. Both
+// functions are pure and can be called from several threads at once.
+struct Kernel {
+    double (*eval)(double x, double y, double z, double t) = nullptr;
+    void (*batch)(const double* x, const double* y, const double* z, double t, double* out, int64_t n) = nullptr;
+    // Returns the value at the point and writes its gradient (central differences with a step of 1e-4) to out
+    double (*gradient)(double x, double y, double z, double t, double* out) = nullptr;
+    // Writes the output and the extra outputs of the program to out[0], ..., out[num_outputs() - 1]
+    void (*eval_all)(double x, double y, double z, double t, double* out) = nullptr;
+    // Every output on its own, outputs[0] is eval
+    std::vector<double (*)(double x, double y, double z, double t)> outputs;
+
+    int num_outputs() const { return (int) outputs.size(); }
+
+    explicit operator bool() const { return eval != nullptr; }
+};
+
+// Compile the program for the host CPU and optimize it. Throws std::runtime_error if the JIT can't be created.
+Kernel compile_kernel(const Program& program, TrigAccuracy accuracy = TrigAccuracy::Precise);
+
+// Instrumented eval of the main output for profiling. Every run of consecutive instructions of a node in
+// program.sources is enclosed by reads of the cycle counter and its cycles are added to the counter of the node.
+// The counters are shared by all calls, so eval must not be called from several threads at once.
+struct ProfilingKernel {
+    double (*eval)(double x, double y, double z, double t) = nullptr;
+    // Node id of every counter
+    std::vector<int> nodes;
+    // Timed runs of every counter per call
+    std::vector<int> runs;
+    // Cycles of every counter summed over all calls. The extra last counter times an empty run once per call, which
+    // is the overhead included in the cycles of every run. All counters stay zero if the target has no cycle counter.
+    std::unique_ptr<uint64_t[]> cycles;
+};
+
+// Compile the instrumented kernel, optimized like compile_kernel. The instructions of a node may still be scheduled
+// across the counter reads, the cycles are an approximation.
+ProfilingKernel compile_profiling_kernel(const Program& program, TrigAccuracy accuracy = TrigAccuracy::Precise);
+
+// Settings of an ahead-of-time compiled program
+struct ObjectOptions {
+    // Prefix of the symbols, the entry points are <name>_eval, <name>_batch and <name>_gradient
+    std::string name = "sdf";
+    // Target CPU, e.g. x86-64-v2 or x86-64-v3. Empty selects the baseline of the architecture (generic), such that
+    // the object runs on any machine with the architecture of this one. native tunes it for the CPU of this machine.
+    std::string cpu;
+    // Additional target features, e.g. +avx2,+fma
+    std::string features;
+    TrigAccuracy accuracy = TrigAccuracy::Precise;
 };
 
-std::function<double(glm::dvec3)> compile(std::vector<Instruction>& instructions, std::map<int, double>& constants);
+// Compile the program ahead of time for the architecture of this machine. Writes an object file, or a static
+// library if object_path ends with .a, and a C header declaring the entry points of the Kernel. The code only
+// depends on the C math library (for Atan2) and can be linked without LLVM. Throws std::runtime_error if the CPU
+// is unknown or a file can't be written.
+void compile_object(const Program& program, const ObjectOptions& options, const std::string& object_path,
+                    const std::string& header_path);
+
+// Compile the program to a function of the point and the time. The compiled function is pure and can be
+// called from several threads at once.
+std::function<double(glm::dvec3, double)> compile_animated(const Program& program, TrigAccuracy accuracy = TrigAccuracy::Precise);
+
+// Compile the program for a fixed time
+std::function<double(glm::dvec3)> compile(const Program& program, double time = 0.0, TrigAccuracy accuracy = TrigAccuracy::Precise);
+
+// Check whether an output is the time register or any instruction reads it
+bool depends_on_time(const Program& program);
+
+// Bound of |df/dt| of the main output over the box [lower, upper] at any time, from interval arithmetic on the
+// instructions. Scatter sets and volumes are assumed to change at most as fast as their point moves. Returns 0 if
+// the output doesn't depend on the time and infinity if the derivative can't be bounded, e.g. for Floor of the time.
+double time_speed_bound(const Program& program, glm::dvec3 lower, glm::dvec3 upper);
+
+// Binary serialization of a program including its scatter sets and volumes, used to send a graph to other processes. Numbers
+// are stored in the native byte order. Both throw std::runtime_error if the file can't be written or read.
+void write_program(const Program& program, const std::string& path);
+
+Program read_program(const std::string& path);
 
 // helper functions to create instructions
 int generate_constant(std::map<int, double>& constants, int& current_register, double value);
@@ -76,5 +236,35 @@ int generate_sin (std::vector<Instruction>& instructions, int& current_register,
 
 int generate_cos (std::vector<Instruction>& instructions, int& current_register, int v1);
 
+int generate_div (std::vector<Instruction>& instructions, int& current_register, int v1, int v2);
+
+int generate_floor (std::vector<Instruction>& instructions, int& current_register, int v1);
+
+int generate_round (std::vector<Instruction>& instructions, int& current_register, int v1);
+
+int generate_atan2 (std::vector<Instruction>& instructions, int& current_register, int y, int x);
+
+int generate_scatter (std::vector<Instruction>& instructions, int& current_register, glm::ivec3 p, int scatter);
+
+int generate_volume (std::vector<Instruction>& instructions, int& current_register, glm::ivec3 p, int volume);
+
+// vector helpers, vector values occupy a single register
+int generate_pack (std::vector<Instruction>& instructions, int& current_register, glm::ivec2 v);
+
+int generate_pack (std::vector<Instruction>& instructions, int& current_register, glm::ivec3 v);
+
+int generate_splat (std::vector<Instruction>& instructions, int& current_register, ValueType type, int v);
+
+int generate_extract (std::vector<Instruction>& instructions, int& current_register, ValueType type, int v, int component);
+
+// Element-wise operation on two vectors (or one for unary operations)
+int generate_op (std::vector<Instruction>& instructions, int& current_register, Operation op, ValueType type, int v1, int v2 = -1);
+
+int generate_dot (std::vector<Instruction>& instructions, int& current_register, ValueType type, int v1, int v2);
+
+int generate_length (std::vector<Instruction>& instructions, int& current_register, ValueType type, int v);
+
+int generate_max_element (std::vector<Instruction>& instructions, int& current_register, ValueType type, int v);
+
 const char* return_op_name(Operation op);
 
@@ -5,6 +5,8 @@
 #include "editor.h"
 #include "third_party/imnodes.h"
 #include <algorithm>
+#include <stdexcept>
+#include <string>
 
 // Every Editor contains an OutputNode
 Editor::Editor() {
@@ -12,31 +14,52 @@ Editor::Editor() {
 }
 
 void Editor::draw() {
+    // The profile of an outdated graph isn't shown
+    std::vector<const NodeProfile *> profiles(m_nodes.size(), nullptr);
+    double max_share = 0.0;
+    if (m_profile.graph_hash == m_output_hash) {
+        for (const NodeProfile &profile: m_profile.nodes) {
+            if (profile.node_id < (int) profiles.size()) {
+                profiles[profile.node_id] = &profile;
+                max_share = std::max(max_share, profile.time_share);
+            }
+        }
+    }
     ImNodes::BeginNodeEditor();
     // draw all nodes that currenty exist
     for (auto &node: m_nodes) {
         if (node == nullptr) {
             continue;
         }
-        node->draw();
-    }
-    // check all possible link combinations and draw existing ones
-    m_links.clear();
-    int counter = 0;
-    for (int i = 0; i < m_inputs.size(); ++i) {
-        if (m_nodes[i] == nullptr) {
-            continue;
+        const NodeProfile *profile = profiles[node->m_node_id];
+        if (profile != nullptr) {
+            // from blue for cheap nodes to red for the most expensive one
+            float heat = max_share > 0.0 ? (float) (profile->time_share / max_share) : 0.0f;
+            unsigned int color = IM_COL32(40 + (int) (180 * heat), 70 - (int) (40 * heat), 140 - (int) (110 * heat), 255);
+            ImNodes::PushColorStyle(ImNodesCol_TitleBar, color);
+            ImNodes::PushColorStyle(ImNodesCol_TitleBarHovered, color);
+            ImNodes::PushColorStyle(ImNodesCol_TitleBarSelected, color);
         }
-        for (int j = 0; j < m_inputs[i].size(); ++j) {
-            if (m_inputs[i][j].node_id == -1) {
-                continue;
-            }
-            m_links[counter] = {i, j};
-            ImNodes::Link(counter++, OUTPUT_ATTRIBUTE_OFFSET + m_inputs[i][j].node_id,
-                          INPUT_ATTRIBUTE_OFFSET + m_inputs[i][j].attribute_id);
+        node->draw();
+        if (profile != nullptr) {
+            ImNodes::PopColorStyle();
+            ImNodes::PopColorStyle();
+            ImNodes::PopColorStyle();
         }
     }
+    // draw existing links
+    for (auto &[link_id, input]: m_links) {
+        ImNodes::Link(link_id, OUTPUT_ATTRIBUTE_OFFSET + m_inputs[input.first][input.second].node_id,
+                      INPUT_ATTRIBUTE_OFFSET + link_id);
+    }
     ImNodes::EndNodeEditor();
+    int hovered;
+    if (ImNodes::IsNodeHovered(&hovered) && hovered < (int) profiles.size() && profiles[hovered] != nullptr) {
+        const NodeProfile &profile = *profiles[hovered];
+        ImGui::SetTooltip("%d instructions in %d contexts\n%lld evaluations\n%.0f cycles per call\n"
+                          "%.1f%% of the remesh", profile.instructions, profile.contexts, (long long) profile.evaluations, profile.cycles,
+                          100.0 * profile.time_share);
+    }
 }
 
 void Editor::handle_links() {
@@ -45,18 +68,53 @@ void Editor::handle_links() {
         if (start_attr == end_attr) {
             return;
         }
-        for (auto &input: m_inputs) {
-            for (auto &link: input) {
-                if (link.attribute_id == end_attr - INPUT_ATTRIBUTE_OFFSET && link.type == m_nodes[start_attr - OUTPUT_ATTRIBUTE_OFFSET].get()->m_output_type) {
-                    link.node_id = start_attr - OUTPUT_ATTRIBUTE_OFFSET;
-                    m_remesh = true;
-                    return;
-                }
-            }
+        int source_id = start_attr - OUTPUT_ATTRIBUTE_OFFSET;
+        auto [node_id, input_id] = m_attributes[end_attr - INPUT_ATTRIBUTE_OFFSET];
+        if (node_id == -1 || m_inputs[node_id][input_id].type != m_nodes[source_id]->m_output_type) {
+            return;
         }
+        connect(source_id, node_id, input_id);
     }
 }
 
+void Editor::connect(int source_id, int node_id, int input_id) {
+    disconnect(node_id, input_id);
+    InputSlot &slot = m_inputs[node_id][input_id];
+    slot.node_id = source_id;
+    m_outputs[source_id].emplace_back(node_id, input_id);
+    m_links[slot.attribute_id] = {node_id, input_id};
+    m_remesh = true;
+}
+
+void Editor::disconnect(int node_id, int input_id) {
+    InputSlot &slot = m_inputs[node_id][input_id];
+    if (slot.node_id == -1) {
+        return;
+    }
+    auto &outputs = m_outputs[slot.node_id];
+    auto it = std::find(outputs.begin(), outputs.end(), std::make_pair(node_id, input_id));
+    // swap and pop, the order of the outputs doesn't matter
+    *it = outputs.back();
+    outputs.pop_back();
+    m_links.erase(slot.attribute_id);
+    slot.node_id = -1;
+    m_remesh = true;
+}
+
+void Editor::remove_node(int node_id) {
+    for (int i = 0; i < (int) m_inputs[node_id].size(); ++i) {
+        disconnect(node_id, i);
+        m_attributes[m_inputs[node_id][i].attribute_id] = {-1, -1};
+    }
+    while (!m_outputs[node_id].empty()) {
+        auto [target_id, input_id] = m_outputs[node_id].back();
+        disconnect(target_id, input_id);
+    }
+    m_inputs[node_id].clear();
+    m_nodes[node_id] = nullptr;
+    m_free_nodes.push_back(node_id);
+}
+
 void Editor::draw_primitive_dropdown() {
     static int selected_node = -1;
     ImGui::PushItemWidth(120);
@@ -94,6 +152,18 @@ void Editor::draw_operator_dropdown() {
             selected_node = 1;
             add_node<SmoothUnionNode>();
         }
+        if (ImGui::Selectable("Repeat", selected_node == 2)) {
+            selected_node = 2;
+            add_node<RepeatNode>();
+        }
+        if (ImGui::Selectable("Scatter", selected_node == 3)) {
+            selected_node = 3;
+            add_node<ScatterNode>();
+        }
+        if (ImGui::Selectable("Bake", selected_node == 4)) {
+            selected_node = 4;
+            add_node<BakeNode>();
+        }
         ImGui::EndCombo();
     }
     ImGui::PopItemWidth();
@@ -123,6 +193,10 @@ void Editor::draw_math_dropdown() {
             selected_node = 4;
             add_node<UnaryOpNode, Operation::Cos>();
         }
+        if (ImGui::Selectable("Output", selected_node == 5)) {
+            selected_node = 5;
+            add_node<OutputNode>();
+        }
         ImGui::EndCombo();
     }
     ImGui::PopItemWidth();
@@ -130,25 +204,242 @@ void Editor::draw_math_dropdown() {
 
 void Editor::draw_delete_button() {
     if (ImGui::Button("Delete")) {
+        // links first, their ids become invalid once a node is removed
+        std::vector<int> links (ImNodes::NumSelectedLinks());
+        ImNodes::GetSelectedLinks(links.data());
+        for (auto link_id : links){
+            auto it = m_links.find(link_id);
+            if (it != m_links.end()) {
+                disconnect(it->second.first, it->second.second);
+            }
+        }
         std::vector<int> nodes (ImNodes::NumSelectedNodes());
         ImNodes::GetSelectedNodes(nodes.data());
         for (auto it : nodes){
-            for (auto& link : m_inputs){
-                for (auto& slot : link){
-                    if (slot.node_id == it){
-                        slot.node_id = -1;
-                    }
+            // the first output node can't be deleted
+            if (it != 0 && m_nodes[it] != nullptr) {
+                remove_node(it);
+            }
+        }
+        m_remesh = true;
+    }
+}
+
+std::vector<int> Editor::output_subgraph(int node_id) {
+    // Iterative post-order traversal from the node, so deep graphs can't overflow the stack
+    enum State : char { Unvisited, Open, Done };
+    std::vector<State> state(m_nodes.size(), Unvisited);
+    std::vector<int> order;
+    std::vector<int> stack = {node_id};
+    while (!stack.empty()) {
+        int node_id = stack.back();
+        if (state[node_id] == Unvisited) {
+            state[node_id] = Open;
+            for (auto &slot: m_inputs[node_id]) {
+                if (slot.node_id != -1 && state[slot.node_id] == Unvisited) {
+                    stack.push_back(slot.node_id);
                 }
             }
-            m_nodes[it] = nullptr;
+            continue;
         }
-        std::vector<int> links (ImNodes::NumSelectedLinks());
-        ImNodes::GetSelectedLinks(links.data());
-        for (auto link_id : links){
-            auto index = m_links[link_id];
-            m_inputs[index.first][index.second].node_id = -1;
+        stack.pop_back();
+        if (state[node_id] == Done) {
+            continue;
         }
+        state[node_id] = Done;
+        order.push_back(node_id);
     }
+    return order;
+}
+
+size_t Editor::output_hash() {
+    if (m_inputs[0][0].node_id == -1) {
+        return 0;
+    }
+    size_t seed = 0;
+    for (int node_id: output_nodes()) {
+        hash_combine(seed, subgraph_hash(node_id));
+    }
+    return seed;
+}
+
+std::vector<int> Editor::output_nodes() {
+    std::vector<int> nodes;
+    for (int node_id = 0; node_id < (int) m_nodes.size(); ++node_id) {
+        if (dynamic_cast<OutputNode *>(m_nodes[node_id].get()) && m_inputs[node_id][0].node_id != -1) {
+            nodes.push_back(node_id);
+        }
+    }
+    return nodes;
+}
+
+size_t Editor::subgraph_hash(int root_id) {
+    std::vector<size_t> hashes(m_nodes.size(), 0);
+    std::vector<bool> hashed(m_nodes.size(), false);
+    for (int node_id: output_subgraph(root_id)) {
+        size_t seed = m_nodes[node_id]->parameter_hash();
+        for (auto &slot: m_inputs[node_id]) {
+            // unconnected inputs (and links closing a cycle) only contribute their position
+            hash_combine(seed, slot.node_id != -1 && hashed[slot.node_id] ? hashes[slot.node_id] : (size_t) 0);
+        }
+        hashes[node_id] = seed;
+        hashed[node_id] = true;
+    }
+    return hashes[root_id];
+}
+
+bool Editor::output_changed() {
+    size_t hash = output_hash();
+    bool changed = hash != m_output_hash;
+    m_output_hash = hash;
+    return changed;
+}
+
+Program Editor::generate_program(int node_id) {
+    if (node_id == 0 && m_inputs[0][0].node_id == -1) {
+        throw std::runtime_error("The output node is not connected");
+    }
+    // The output node is lowered together with all other connected output nodes
+    std::vector<int> roots = {node_id};
+    if (node_id == 0) {
+        roots = output_nodes();
+        m_output_ids = roots;
+    }
+    // Nodes like BakeNode may generate programs of their own, this has to happen before the state below is set up
+    for (int root: roots) {
+        for (int id: output_subgraph(root)) {
+            m_nodes[id]->prepare();
+        }
+    }
+    Program program;
+    m_program = &program;
+    program.instructions.reserve(8 * m_nodes.size());
+    int current_register = FIRST_FREE_REGISTER;
+    // the slots of m_registers are reused by add_context, only their contents are reset
+    m_points.clear();
+    m_lowering.clear();
+    add_context({0, 1, 2});
+
+    // Iterative post-order traversal over (node, context) pairs. Every pair is lowered exactly once after all of
+    // its inputs, so shared subgraphs are only computed once per context.
+    struct Task {
+        int node_id;
+        int context;
+        bool open;
+        std::vector<int> domains;
+    };
+    std::vector<Task> stack;
+    for (auto it = roots.rbegin(); it != roots.rend(); ++it) {
+        stack.push_back({*it, 0, false, {}});
+    }
+    while (!stack.empty()) {
+        Task &task = stack.back();
+        m_context = task.context;
+        if (!task.open) {
+            // lowered already or a link closing a cycle
+            if (m_lowering[task.context][task.node_id] != 0) {
+                stack.pop_back();
+                continue;
+            }
+            m_lowering[task.context][task.node_id] = 1;
+            task.open = true;
+            // nodes like RepeatNode evaluate their inputs at transformed points, this may add contexts
+            task.domains = m_nodes[task.node_id]->generate_domains(program.instructions, current_register,
+                                                                   program.constants);
+            program.sources.resize(program.instructions.size(), {task.node_id, task.context});
+            if (task.domains.empty()) {
+                task.domains = {task.context};
+            }
+            int task_node_id = task.node_id;
+            std::vector<int> domains = task.domains;
+            if (!m_nodes[task_node_id]->evaluates_inputs()) {
+                continue;
+            }
+            for (int domain: domains) {
+                for (auto &slot: m_inputs[task_node_id]) {
+                    if (slot.node_id != -1 && m_lowering[domain][slot.node_id] == 0) {
+                        stack.push_back({slot.node_id, domain, false, {}});
+                    }
+                }
+            }
+            continue;
+        }
+        m_domains = task.domains;
+        m_nodes[task.node_id]->generate_instructions(program.instructions, current_register, program.constants,
+                                                     m_registers[task.context][task.node_id]);
+        program.sources.resize(program.instructions.size(), {task.node_id, task.context});
+        m_lowering[task.context][task.node_id] = 2;
+        stack.pop_back();
+    }
+    m_program = nullptr;
+    program.output = m_registers[0][node_id][0];
+    for (size_t i = 1; i < roots.size(); ++i) {
+        program.extra_outputs.push_back(m_registers[0][roots[i]][0]);
+    }
+    program.num_registers = current_register;
+    compact_registers(program);
+    return program;
+}
+
+void Editor::profile(const MeshingOptions &options, TrigAccuracy accuracy) {
+    Program program = generate_program();
+    m_profile = profile_program(program, options, accuracy);
+    for (NodeProfile &profile: m_profile.nodes) {
+        profile.name = m_nodes[profile.node_id]->title();
+    }
+    m_profile.graph_hash = output_hash();
+}
+
+int Editor::add_scatter_set(const std::shared_ptr<const ScatterSet> &set) {
+    auto &scatters = m_program->scatters;
+    auto it = std::find(scatters.begin(), scatters.end(), set);
+    if (it != scatters.end()) {
+        return (int) (it - scatters.begin());
+    }
+    scatters.push_back(set);
+    return (int) scatters.size() - 1;
+}
+
+int Editor::add_volume(const std::shared_ptr<const SparseVolume> &volume) {
+    auto &volumes = m_program->volumes;
+    auto it = std::find(volumes.begin(), volumes.end(), volume);
+    if (it != volumes.end()) {
+        return (int) (it - volumes.begin());
+    }
+    volumes.push_back(volume);
+    return (int) volumes.size() - 1;
+}
+
+int Editor::add_context(glm::ivec3 point) {
+    m_points.push_back(point);
+    if (m_registers.size() < m_points.size()) {
+        m_registers.emplace_back();
+    }
+    auto &slots = m_registers[m_points.size() - 1];
+    slots.resize(m_nodes.size());
+    for (auto &slot: slots) {
+        slot.clear();
+    }
+    m_lowering.emplace_back(m_nodes.size(), 0);
+    return (int) m_points.size() - 1;
+}
+
+glm::ivec3 Editor::point_registers() {
+    return m_points[m_context];
+}
+
+const std::vector<int> &Editor::input_registers(int node_id, int input_id) {
+    return input_registers(node_id, input_id, m_context);
+}
+
+const std::vector<int> &Editor::input_registers(int node_id, int input_id, int context) {
+    int input_node_id = m_inputs[node_id][input_id].node_id;
+    // inputs without a default value have to be connected, a node in a cycle is not lowered before its users
+    if (input_node_id == -1 || m_registers[context][input_node_id].empty()) {
+        throw std::runtime_error("Input " + std::to_string(input_id) + " of node " + std::to_string(node_id) +
+                                 " is not connected or part of a cycle");
+    }
+    return m_registers[context][input_node_id];
 }
 
 Node *Editor::find_node(int node_id, int input_id) {
@@ -161,14 +452,25 @@ Node *Editor::find_node(int node_id, int input_id) {
 
 template<class T, Operation op>
 void Editor::add_node() {
+    // reuse the slot of a deleted node if there is one
+    int node_id = (int) m_nodes.size();
+    if (!m_free_nodes.empty()) {
+        node_id = m_free_nodes.back();
+        m_free_nodes.pop_back();
+    } else {
+        m_nodes.emplace_back();
+        m_inputs.emplace_back();
+        m_outputs.emplace_back();
+    }
     if constexpr (op == Operation::None) {
-        m_nodes.push_back(std::make_unique<T>(this, m_nodes.size()));
+        m_nodes[node_id] = std::make_unique<T>(this, node_id);
     } else {
-        m_nodes.push_back(std::make_unique<T>(this, m_nodes.size(), op));
+        m_nodes[node_id] = std::make_unique<T>(this, node_id, op);
     }
-    m_inputs.emplace_back();
-    for (int i = 0; i < m_nodes.back()->m_num_inputs; ++i) {
-        m_inputs.back().push_back({-1, m_current_input_id++, T::InputType[i]});
+    for (int i = 0; i < m_nodes[node_id]->m_num_inputs; ++i) {
+        m_inputs[node_id].push_back({-1, m_current_input_id, T::InputType[i]});
+        m_attributes.emplace_back(node_id, i);
+        m_current_input_id++;
     }
 }
 
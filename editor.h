@@ -8,6 +8,7 @@
 #include <memory>
 
 #include "node.h"
+#include "profiler.h"
 
 constexpr int INPUT_ATTRIBUTE_OFFSET = 10e6;
 constexpr int OUTPUT_ATTRIBUTE_OFFSET = 20e6;
@@ -29,11 +30,27 @@ public:
     // there is no input link), the input attribute id and the input type (scalar or point).
     std::vector<std::vector<InputSlot>> m_inputs;
     int m_current_input_id = 0;
+    // Set whenever a parameter or a link might have changed, the hash below decides if a re-mesh is needed
     bool m_remesh = true;
+    // Hash of the subgraph feeding the output node at the last call of output_changed
+    size_t m_output_hash = 0;
 
-    // Map from link id to inputs
+    // For each node, the (node id, input id) pairs of all inputs linked to its output
+    std::vector<std::vector<std::pair<int, int>>> m_outputs;
+
+    // Map from link id to inputs. The link id is the attribute id of the input, so it stays valid as long
+    // as the link exists and the map only changes when links are created or removed.
     std::map<int, std::pair<int, int>> m_links;
 
+    // Map from input attribute id to (node id, input id), {-1, -1} for inputs of deleted nodes
+    std::vector<std::pair<int, int>> m_attributes;
+
+    // Slots in m_nodes of deleted nodes which are reused by add_node
+    std::vector<int> m_free_nodes;
+
+    // Last profile of the graph, drawn as a heat overlay on the title bars as long as the graph is unchanged
+    GraphProfile m_profile;
+
     // Draw the nodes
     void draw();
 
@@ -48,6 +65,75 @@ public:
 
     void draw_delete_button();
 
+    // State of the last call of generate_program. Nodes are lowered once per point context, a context is the
+    // triple of registers holding the point at which the primitives are evaluated (x, y, z at the output).
+    std::vector<glm::ivec3> m_points;
+    // Output registers of every node in every context, indexed by context and node id. The table is kept between
+    // programs such that the slots don't allocate again, contexts beyond m_points are stale.
+    std::vector<std::vector<std::vector<int>>> m_registers;
+    // 0 if a node hasn't been visited in a context, 1 while its inputs are lowered and 2 afterward
+    std::vector<std::vector<char>> m_lowering;
+    // Program being generated
+    Program *m_program = nullptr;
+    // Context of the node being lowered and the contexts its inputs were lowered in
+    int m_context = 0;
+    std::vector<int> m_domains;
+
+    // All nodes the node depends on (including itself) in topological order, the node is last
+    std::vector<int> output_subgraph(int node_id = 0);
+
+    // Lower the nodes feeding the node (the output node by default) in topological order and compact the
+    // registers, the program returns the first output register of the node. For the output node, all other
+    // connected output nodes become extra outputs of the program. Throws std::runtime_error if the output or a
+    // required input isn't connected.
+    Program generate_program(int node_id = 0);
+
+    // Ids of the connected output nodes in the order of the program outputs, the first output node comes first
+    std::vector<int> output_nodes();
+
+    // Output nodes of the last program generated for the output node, in the order of its outputs
+    std::vector<int> m_output_ids;
+
+    // Mesh the output once with the options and store the cost of every node in m_profile, see profile_program
+    void profile(const MeshingOptions &options, TrigAccuracy accuracy);
+
+    // Add a point context during generate_program and return its id
+    int add_context(glm::ivec3 point);
+
+    // Add a scatter set to the program during generate_program and return its index, a set is only added once
+    int add_scatter_set(const std::shared_ptr<const ScatterSet> &set);
+
+    // Add a baked volume to the program during generate_program and return its index
+    int add_volume(const std::shared_ptr<const SparseVolume> &volume);
+
+    // Registers of the point in the current context
+    glm::ivec3 point_registers();
+
+    // Registers of the node linked to an input in the current (or the given) context, only valid during
+    // generate_program
+    const std::vector<int> &input_registers(int node_id, int input_id);
+
+    const std::vector<int> &input_registers(int node_id, int input_id, int context);
+
+    // Hash of the node parameters and links of all nodes reachable from the output nodes. Nodes that don't
+    // feed an output don't influence the hash. Returns 0 if the first output isn't connected.
+    size_t output_hash();
+
+    // Hash of the parameters and links of the node and all nodes it depends on
+    size_t subgraph_hash(int node_id);
+
+    // Recompute the output hash and check if it differs from the previous one
+    bool output_changed();
+
+    // Link the output of node source_id to an input, replacing an existing link
+    void connect(int source_id, int node_id, int input_id);
+
+    // Remove the link of an input if there is one
+    void disconnect(int node_id, int input_id);
+
+    // Remove a node and all links from and to it, its slot is reused by the next added node
+    void remove_node(int node_id);
+
     // Find a node in the m_nodes vector
     Node *find_node(int node_id, int input_id);
 
@@ -2,179 +2,126 @@
 // Created by elisabeth on 19.11.23.
 //
 
-#include "implicit_meshing.h"
-#include <memory>
-#include <glm/glm.hpp>
-
-#include "third_party/probabilistic-quadrics.hh"
-#include "third_party/hash_table7.hpp"
-
-using glm_trait = pq::math<double, glm::dvec3, glm::dvec3, glm::dmat3>;
-using quadric = pq::quadric<glm_trait>;
-
-// Edge between two adjaccent grid points a and b
-// idx shows the axis of the edge (0 -> x, 1 -> y, 2 -> z)
-struct Edge {
-    glm::ivec3 a;
-    glm::ivec3 b;
-    int idx;
-};
-
-struct GridHash {
-    size_t operator()(const glm::ivec3 &v) const {
-        // Use std::hash for individual components and combine them
-        size_t seed = 0;
-        seed ^= std::hash<int>()(v.x) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-        seed ^= std::hash<int>()(v.y) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-        seed ^= std::hash<int>()(v.z) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-        return seed;
-    }
-};
-
-// GridCell represents a range of grid points in 3D space.
-// The first vector defines the inclusive lower-left front grid index,
-// while the second vector defines the exclusive upper-right back grid index.
-using GridCell = std::pair<glm::ivec3, glm::ivec3>;
-
-// Split current grid cell intro 8 smaller cells
-void generate_children(std::vector<GridCell> &grid_cells, const GridCell &current) {
-    glm::ivec3 min_coord = current.first;
-    glm::ivec3 max_coord = current.second;
-
-    // Ensure the cell dimensions are valid
-    if (max_coord.x <= min_coord.x || max_coord.y <= min_coord.y || max_coord.z <= min_coord.z) {
-        throw std::invalid_argument("Invalid cell dimensions");
-    }
+#include "implicit_meshing_impl.h"
 
-    // Calculate the size of each child cell
-    glm::ivec3 cell_size = (max_coord - min_coord) / 2;
+MeshingContext::MeshingContext() : m_scratch(std::make_unique<MeshingScratch>()) {}
 
-    // Ensure each child cell will have a positive size
-    assert(cell_size.x > 0 && cell_size.y > 0 && cell_size.z > 0);
+MeshingContext::~MeshingContext() = default;
 
-    for (int x = 0; x < 2; ++x) {
-        for (int y = 0; y < 2; ++y) {
-            for (int z = 0; z < 2; ++z) {
-                glm::ivec3 child_min = min_coord + cell_size * glm::ivec3(x, y, z);
-                glm::ivec3 child_max = child_min + cell_size;
+MeshingContext::MeshingContext(MeshingContext &&) noexcept = default;
 
-                // Adjust the max boundary for the last cell in each dimension
-                if (x == 1) child_max.x = max_coord.x;
-                if (y == 1) child_max.y = max_coord.y;
-                if (z == 1) child_max.z = max_coord.z;
+MeshingContext &MeshingContext::operator=(MeshingContext &&) noexcept = default;
 
-                GridCell child_cell(child_min, child_max);
-                grid_cells.push_back(child_cell);
-            }
-        }
-    }
+void MeshingContext::reset_temporal() {
+    m_scratch->temporal_valid = false;
 }
 
-glm::dvec3 interpolate(std::pair<glm::dvec3, double> neg, std::pair<glm::dvec3, double> pos) {
-    double val_neg = neg.second;
-    double val_pos = pos.second;
-    assert(val_neg <= 0);
-    assert(val_pos >= 0);
-    auto pt_neg = neg.first;
-    auto pt_pos = pos.first;
-    double t = val_neg / (val_neg - val_pos);
-    glm::dvec3 p = pt_neg + (pt_pos - pt_neg) * t;
-    return p;
+QuadMesh mesh_generator(std::function<double(glm::dvec3)> f, int n, MeshingMode mode) {
+    MeshingContext context;
+    MeshingOptions options;
+    options.resolution = glm::ivec3(n);
+    options.mode = mode;
+    QuadMesh mesh;
+    mesh_generator(context, f, options, mesh);
+    return mesh;
 }
 
-glm::dvec3 find_point_on_surface(std::pair<glm::dvec3, double> neg, std::pair<glm::dvec3, double> pos,
-                                 const std::function<double(glm::dvec3)> &f,
-                                 int num_iterations) {
-    assert(num_iterations > 0);
-    const double threshold = 10e-5;
-    for (int i = 0; i < num_iterations - 1; ++i) {
-        glm::dvec3 p = interpolate(neg, pos);
-        double val = f(p);
-        if (std::abs(val) < threshold) {
-            return p;
+QuadMesh merge_tiles(const std::vector<MeshTile> &tiles) {
+    // Neighbouring tiles compute the same vertex for the voxels of the halo, keep the first copy
+    std::vector<std::pair<int64_t, glm::dvec3>> vertices;
+    for (const auto &tile: tiles) {
+        for (size_t v = 0; v < tile.voxel_ids.size(); ++v) {
+            vertices.emplace_back(tile.voxel_ids[v], tile.vertices[v]);
+        }
+    }
+    std::stable_sort(vertices.begin(), vertices.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+    vertices.erase(std::unique(vertices.begin(), vertices.end(),
+                               [](const auto &a, const auto &b) { return a.first == b.first; }), vertices.end());
+
+    QuadMesh mesh;
+    mesh.vertices.reserve(vertices.size());
+    for (const auto &vertex: vertices) {
+        mesh.vertices.push_back(vertex.second);
+    }
+    auto vertex_index = [&](int64_t id) {
+        if (id == -1) {
+            return -1;
         }
-        if (val < 0) {
-            neg = {p, val};
-        } else {
-            pos = {p, val};
+        auto it = std::lower_bound(vertices.begin(), vertices.end(), id,
+                                   [](const auto &vertex, int64_t value) { return vertex.first < value; });
+        return it != vertices.end() && it->first == id ? (int) (it - vertices.begin()) : -1;
+    };
+    for (const auto &tile: tiles) {
+        for (const auto &face: tile.faces) {
+            mesh.quads.push_back({vertex_index(face[0]), vertex_index(face[1]), vertex_index(face[2]),
+                                  vertex_index(face[3])});
         }
     }
-
-    // Return the best approximation if the loop completes without finding the exact point
-    return interpolate(neg, pos);
+    return mesh;
 }
 
-QuadMesh mesh_generator(std::function<double(glm::dvec3)> f, int n) {
-    glm::dvec3 lower{-3};
-    glm::dvec3 upper{3};
+void solve_hermite(const HermiteData &data, double position_sigma, double normal_sigma, QuadMesh &mesh) {
+    mesh.vertices.resize(data.voxels.size());
+    for (size_t v = 0; v < data.voxels.size(); ++v) {
+        quadric q;
+        for (int c = data.offsets[v]; c < data.offsets[v + 1]; ++c) {
+            q += quadric::probabilistic_plane_quadric(data.points[c], data.normals[c], position_sigma, normal_sigma);
+        }
+        mesh.vertices[v] = q.minimizer();
+    }
+    mesh.quads = data.quads;
+}
 
-    auto index_to_grid_point = [=](glm::dvec3 index) {
-        return lower + index / (n - 1.0) * (upper - lower);
-    };
+// Cells with at most this many voxels along each axis are re-traversed as a whole by the temporal mesher
+constexpr int TEMPORAL_BRICK_SIZE = 8;
 
-    auto gradient_f = [=](glm::dvec3 p) -> glm::dvec3 {
-        double eps = 10e-5;
-        double dx = (f({p.x + eps, p.y, p.z}) - f({p.x - eps, p.y, p.z})) / (2 * eps);
-        double dy = (f({p.x, p.y + eps, p.z}) - f({p.x, p.y - eps, p.z})) / (2 * eps);
-        double dz = (f({p.x, p.y, p.z + eps}) - f({p.x, p.y, p.z - eps})) / (2 * eps);
-        return {dx, dy, dz};
+void mesh_generator_temporal(MeshingContext &context, const KernelEvaluator &f, const MeshingOptions &options,
+                             const TemporalOptions &temporal, QuadMesh &mesh) {
+    MeshingScratch &scratch = context.scratch();
+    GridMapping index_to_grid_point(options);
+    auto same_grid = [](const MeshingOptions &a, const MeshingOptions &b) {
+        return a.lower == b.lower && a.upper == b.upper && a.resolution == b.resolution &&
+               a.culling_factor == b.culling_factor;
     };
-
-    /* used for debugging
-    auto draw_grid_cell = [=](GridCell cell) {
-        glm::vec3 lower = index_to_grid_point(cell.first);
-        glm::vec3 upper = index_to_grid_point(cell.second);
-        std::vector<glm::vec3> pts{
-                // Bottom square
-                glm::vec3{lower[0], lower[1], lower[2]}, glm::vec3{upper[0], lower[1], lower[2]},
-                glm::vec3{upper[0], lower[1], lower[2]}, glm::vec3{upper[0], lower[1], upper[2]},
-                glm::vec3{upper[0], lower[1], upper[2]}, glm::vec3{lower[0], lower[1], upper[2]},
-                glm::vec3{lower[0], lower[1], upper[2]}, glm::vec3{lower[0], lower[1], lower[2]},
-
-                // Top square
-                glm::vec3{lower[0], upper[1], lower[2]}, glm::vec3{upper[0], upper[1], lower[2]},
-                glm::vec3{upper[0], upper[1], lower[2]}, glm::vec3{upper[0], upper[1], upper[2]},
-                glm::vec3{upper[0], upper[1], upper[2]}, glm::vec3{lower[0], upper[1], upper[2]},
-                glm::vec3{lower[0], upper[1], upper[2]}, glm::vec3{lower[0], upper[1], lower[2]},
-
-                // Connecting lines between top and bottom squares
-                glm::vec3{lower[0], lower[1], lower[2]}, glm::vec3{lower[0], upper[1], lower[2]},
-                glm::vec3{upper[0], lower[1], lower[2]}, glm::vec3{upper[0], upper[1], lower[2]},
-                glm::vec3{upper[0], lower[1], upper[2]}, glm::vec3{upper[0], upper[1], upper[2]},
-                glm::vec3{lower[0], lower[1], upper[2]}, glm::vec3{lower[0], upper[1], upper[2]}
-        };
-
-        std::vector<std::array<size_t, 2>> lines
-                = {{0,  1},
-                   {2,  3},
-                   {4,  5},
-                   {6,  7},
-                   {8,  9},
-                   {10, 11},
-                   {12, 13},
-                   {14, 15},
-                   {16, 17},
-                   {18, 19},
-                   {20, 21},
-                   {22, 23}};
-
-        static size_t id = 0;
-        auto bb_lines = ps::registerCurveNetwork("bounding_box" + std::to_string(id++), pts, lines);
-        bb_lines->setRadius(0.003);
-    };*/
-
-    // stack of grid cells used in recursive subdivision algorithm
-    std::vector<GridCell> grid_cells;
-    grid_cells.push_back({{0, 0, 0},
-                          {n, n, n}});
-    emhash7::HashMap<glm::ivec3, double, GridHash> grid;
-
-    // subdivide cells that contain zero-crossings
-    while (!grid_cells.empty()) {
-        GridCell cell = grid_cells.back();
-        grid_cells.pop_back();
+    double motion = temporal.speed * std::abs(f.time - scratch.temporal_time);
+    bool full = !scratch.temporal_valid || scratch.temporal_function != f.f || !std::isfinite(temporal.speed) ||
+                !same_grid(scratch.temporal_options, options) || scratch.temporal_motion + motion > temporal.max_motion;
+
+    // The cells to traverse, a cell is marked with a positive second value once it is inside a brick
+    std::vector<std::pair<GridCell, double>> &stack = scratch.temporal_stack;
+    std::vector<std::pair<GridCell, double>> &cells = scratch.temporal_cells;
+    stack.clear();
+    if (full) {
+        cells.clear();
+        stack.push_back({{{0, 0, 0}, index_to_grid_point.n}, -1.0});
+        scratch.temporal_motion = 0.0;
+    } else {
+        // Keep the culled cells whose margin covers the motion, all others are traversed again
+        size_t kept = 0;
+        for (auto &[cell, margin]: cells) {
+            if (margin > motion) {
+                cells[kept++] = {cell, margin - motion};
+            } else {
+                stack.push_back({cell, -1.0});
+            }
+        }
+        cells.resize(kept);
+        scratch.temporal_motion += motion;
+    }
+    scratch.temporal_valid = true;
+    scratch.temporal_function = f.f;
+    scratch.temporal_time = f.time;
+    scratch.temporal_options = options;
+
+    // Same subdivision as sample_grid, cells of at least brick size are recorded for the next frame
+    Grid &grid = scratch.grid;
+    grid.clear();
+    while (!stack.empty()) {
+        auto [cell, inside_brick] = stack.back();
+        stack.pop_back();
         glm::ivec3 grid_size = cell.second - cell.first;
-        // if the cell is too small to divide it again, just evaluate the function at the lower corner
+        bool recorded = inside_brick < 0.0;
+        bool brick = recorded && std::max({grid_size.x, grid_size.y, grid_size.z}) <= TEMPORAL_BRICK_SIZE;
         if (grid_size.x == 1 || grid_size.y == 1 || grid_size.z == 1) {
             for (int i = cell.first.x; i < cell.second.x; ++i) {
                 for (int j = cell.first.y; j < cell.second.y; ++j) {
@@ -184,125 +131,177 @@ QuadMesh mesh_generator(std::function<double(glm::dvec3)> f, int n) {
                     }
                 }
             }
+            if (recorded) {
+                cells.push_back({cell, -1.0});
+            }
             continue;
         }
-        // if the cell does not contain a zero-crossing, skip the cell
         glm::dvec3 cell_lower = index_to_grid_point(cell.first);
         glm::dvec3 cell_upper = index_to_grid_point(cell.second);
         double v = f((cell_upper + cell_lower) / 2.0);
-        if (abs(v) > 1.5 * glm::length(cell_upper - cell_lower) / 2.0) {
+        double margin = std::abs(v) - options.culling_factor * glm::length(cell_upper - cell_lower) / 2.0;
+        if (margin > 0.0) {
+            if (recorded) {
+                cells.push_back({cell, margin});
+            }
             continue;
         }
-        // if the cell contains a zero-crossing, subdivide it into 8 smaller cells
-        generate_children(grid_cells, cell);
+        // an active brick is traversed again in the next frame
+        if (brick) {
+            cells.push_back({cell, -1.0});
+        }
+        size_t first_child = scratch.grid_cells.size();
+        generate_children(scratch.grid_cells, cell);
+        for (size_t c = first_child; c < scratch.grid_cells.size(); ++c) {
+            stack.push_back({scratch.grid_cells[c], recorded && !brick ? -1.0 : 1.0});
+        }
+        scratch.grid_cells.resize(first_child);
     }
+    mesh_grid(scratch, grid, index_to_grid_point, f, options, mesh);
+}
 
-    std::vector<glm::dvec3> points;
-    std::vector<std::array<int, 4>> faces;
-    std::vector<Edge> edges = {{{1, 1, 0}, {1, 1, 1}, 2},
-                               {{1, 0, 1}, {1, 1, 1}, 1},
-                               {{0, 1, 1}, {1, 1, 1}, 0},};
-    std::vector<std::pair<glm::ivec3, glm::ivec3>> all_edges = {{{0, 0, 0}, {1, 0, 0}},
-                                                                {{0, 0, 0}, {0, 1, 0}},
-                                                                {{0, 0, 0}, {0, 0, 1}},
-                                                                {{1, 0, 0}, {1, 1, 0}},
-                                                                {{1, 0, 0}, {1, 0, 1}},
-                                                                {{0, 1, 0}, {1, 1, 0}},
-                                                                {{0, 1, 0}, {0, 1, 1}},
-                                                                {{0, 0, 1}, {1, 0, 1}},
-                                                                {{0, 0, 1}, {0, 1, 1}},
-                                                                {{1, 1, 0}, {1, 1, 1}},
-                                                                {{1, 0, 1}, {1, 1, 1}},
-                                                                {{0, 1, 1}, {1, 1, 1}},};
-
-    std::vector<int> index_points(n * n * n, -1);
-
-    // generate vertex positions of the output mesh
-    // for each voxel we compute a point if at least one of its edges contains a zero-crossing
-    // the point is computed by minimizing a quadric error metric
-    for (const auto &element: grid) {
-        glm::ivec3 index = element.first;
-        quadric q;
-        int counter = 0;
-        for (auto e: all_edges) {
-            glm::ivec3 index_p1 = index + e.first;
-            glm::ivec3 index_p2 = index + e.second;
-            auto it1 = grid.find(index_p1);
-            auto it2 = grid.find(index_p2);
-            if (it1 == grid.end() || it2 == grid.end()) {
-                continue;
+// Sample all outputs of f at the grid points close to any of the surfaces. Works like sample_grid, but a cell is
+// only skipped if the value at its center rules out every surface.
+static void sample_grid_multi(const MultiKernelEvaluator &f, const std::vector<bool> &surface,
+                              const GridMapping &index_to_grid_point, double culling_factor, MeshingScratch &scratch) {
+    int num_outputs = f.size();
+    std::vector<double> values(num_outputs);
+    auto closest_surface = [&]() {
+        double distance = INFINITY;
+        for (int k = 0; k < num_outputs; ++k) {
+            if (surface[k]) {
+                distance = std::min(distance, std::abs(values[k]));
             }
-            double v1 = it1->second;
-            double v2 = it2->second;
-            if (v1 * v2 <= 0) {
-                glm::dvec3 p1 = index_to_grid_point(index_p1);
-                glm::dvec3 p2 = index_to_grid_point(index_p2);
-
-                std::pair p1v1 = {p1, v1};
-                std::pair p2v2 = {p2, v2};
-
-                if (v1 > 0) {
-                    std::swap(p1v1, p2v2);
+        }
+        return distance;
+    };
+    std::vector<GridCell> &grid_cells = scratch.grid_cells;
+    grid_cells.clear();
+    grid_cells.push_back({{0, 0, 0}, index_to_grid_point.n});
+    scratch.samples.clear();
+    scratch.sample_ids.clear();
+    while (!grid_cells.empty()) {
+        GridCell cell = grid_cells.back();
+        grid_cells.pop_back();
+        glm::ivec3 grid_size = cell.second - cell.first;
+        if (grid_size.x == 1 || grid_size.y == 1 || grid_size.z == 1) {
+            for (int i = cell.first.x; i < cell.second.x; ++i) {
+                for (int j = cell.first.y; j < cell.second.y; ++j) {
+                    for (int k = cell.first.z; k < cell.second.z; ++k) {
+                        glm::ivec3 index = {i, j, k};
+                        auto [it, inserted] = scratch.sample_ids.insert({index, (int) (scratch.samples.size() / num_outputs)});
+                        if (inserted) {
+                            scratch.samples.resize(scratch.samples.size() + num_outputs);
+                        }
+                        f(index_to_grid_point(index), scratch.samples.data() + (size_t) it->second * num_outputs);
+                    }
                 }
-                auto zero_crossing = find_point_on_surface(p1v1, p2v2, f, 5);
-
-                counter++;
-                q += quadric::probabilistic_plane_quadric(zero_crossing, glm::normalize(gradient_f(zero_crossing)),
-                                                          0.05, 0.05);
             }
+            continue;
         }
-        if (counter != 0) {
-            points.push_back(q.minimizer());
-            index_points[index.x * n * n + index.y * n + index.z] = (int) points.size() - 1;
+        glm::dvec3 cell_lower = index_to_grid_point(cell.first);
+        glm::dvec3 cell_upper = index_to_grid_point(cell.second);
+        f((cell_upper + cell_lower) / 2.0, values.data());
+        if (closest_surface() > culling_factor * glm::length(cell_upper - cell_lower) / 2.0) {
+            continue;
         }
+        generate_children(grid_cells, cell);
     }
+}
 
-    // generate faces of the output mesh by connecting the corresponding points
-    for (const auto &element: grid) {
-        glm::ivec3 index = element.first;
-        int i = index.x;
-        int j = index.y;
-        int k = index.z;
-        int index_p = index_points[i * n * n + j * n + k];
-        if (index_p == -1) {
+void mesh_generator_multi(MeshingContext &context, const MultiKernelEvaluator &f, const std::vector<bool> &surface,
+                          const MeshingOptions &options, std::vector<SurfaceMesh> &meshes) {
+    MeshingScratch &scratch = context.scratch();
+    GridMapping index_to_grid_point(options);
+    int num_outputs = f.size();
+    if ((int) surface.size() != num_outputs) {
+        throw std::invalid_argument("Every output needs to be marked as surface or field");
+    }
+    sample_grid_multi(f, surface, index_to_grid_point, options.culling_factor, scratch);
+
+    std::vector<double> values(num_outputs);
+    int num_surfaces = (int) std::count(surface.begin(), surface.end(), true);
+    meshes.resize(num_surfaces);
+    int s = 0;
+    for (int output = 0; output < num_outputs; ++output) {
+        if (!surface[output]) {
             continue;
         }
-        for (auto e: edges) {
-            glm::ivec3 index_p1 = index + e.a;
-            glm::ivec3 index_p2 = index + e.b;
-            auto it1 = grid.find(index_p1);
-            auto it2 = grid.find(index_p2);
-            if (it1 == grid.end() || it2 == grid.end()) {
-                continue;
-            }
-            double v1 = it1->second;
-            double v2 = it2->second;
-            if (v1 * v2 <= 0) {
-                std::array<int, 4> face{};
-                if (e.idx == 0) {
-                    face[0] = index_p;
-                    face[1] = index_points[i * n * n + j * n + k + 1];
-                    face[2] = index_points[i * n * n + (j + 1) * n + k + 1];
-                    face[3] = index_points[i * n * n + (j + 1) * n + k];
-                }
-                if (e.idx == 1) {
-                    face[0] = index_p;
-                    face[1] = index_points[(i + 1) * n * n + j * n + k];
-                    face[2] = index_points[(i + 1) * n * n + j * n + k + 1];
-                    face[3] = index_points[i * n * n + j * n + k + 1];
-                }
-                if (e.idx == 2) {
-                    face[0] = index_p;
-                    face[1] = index_points[i * n * n + (j + 1) * n + k];
-                    face[2] = index_points[(i + 1) * n * n + (j + 1) * n + k];
-                    face[3] = index_points[(i + 1) * n * n + j * n + k];
-                }
-                if (v1 < 0) {
-                    std::reverse(face.begin(), face.end());
+        // The samples of one output form the grid of its surface
+        SurfaceMesh &surface_mesh = meshes[s++];
+        surface_mesh.output = output;
+        scratch.grid.clear();
+        for (const auto &element: scratch.sample_ids) {
+            scratch.grid[element.first] = scratch.samples[(size_t) element.second * num_outputs + output];
+        }
+        mesh_grid(scratch, scratch.grid, index_to_grid_point, f.output(output), options, surface_mesh.mesh);
+
+        // Attach the field outputs to the vertices
+        surface_mesh.fields.resize(num_outputs - num_surfaces);
+        for (auto &field: surface_mesh.fields) {
+            field.clear();
+        }
+        for (const glm::dvec3 &vertex: surface_mesh.mesh.vertices) {
+            f(vertex, values.data());
+            for (int k = 0, field = 0; k < num_outputs; ++k) {
+                if (!surface[k]) {
+                    surface_mesh.fields[field++].push_back(values[k]);
                 }
-                faces.push_back(face);
             }
         }
     }
-    return {points, faces};
 }
+
+TriMesh mesh_generator_adaptive(std::function<double(glm::dvec3)> f, int n, double tolerance) {
+    MeshingContext context;
+    MeshingOptions options;
+    options.resolution = glm::ivec3(n);
+    options.collapse_tolerance = tolerance;
+    TriMesh mesh;
+    mesh_generator_adaptive(context, f, options, mesh);
+    return mesh;
+}
+
+StreamingStats mesh_generator_streaming(std::function<double(glm::dvec3)> f, int n, const std::string &path,
+                                        MeshingMode mode) {
+    MeshingOptions options;
+    options.resolution = glm::ivec3(n);
+    options.mode = mode;
+    return mesh_generator_streaming(f, options, path);
+}
+
+// The meshers are compiled once for the evaluators declared in the header, see the extern templates in
+// implicit_meshing_impl.h
+template void mesh_generator(MeshingContext &, const std::function<double(glm::dvec3)> &, const MeshingOptions &,
+                             QuadMesh &);
+
+template void mesh_generator(MeshingContext &, const KernelEvaluator &, const MeshingOptions &, QuadMesh &);
+
+template void sample_hermite(MeshingContext &, const std::function<double(glm::dvec3)> &, const MeshingOptions &,
+                             HermiteData &);
+
+template void sample_hermite(MeshingContext &, const KernelEvaluator &, const MeshingOptions &, HermiteData &);
+
+template void mesh_tile(MeshingContext &, const std::function<double(glm::dvec3)> &, const MeshingOptions &,
+                        glm::ivec3, glm::ivec3, MeshTile &);
+
+template void mesh_tile(MeshingContext &, const KernelEvaluator &, const MeshingOptions &, glm::ivec3, glm::ivec3,
+                        MeshTile &);
+
+template void mesh_generator_adaptive(MeshingContext &, const std::function<double(glm::dvec3)> &,
+                                      const MeshingOptions &, TriMesh &);
+
+template void mesh_generator_adaptive(MeshingContext &, const KernelEvaluator &, const MeshingOptions &, TriMesh &);
+
+template void mesh_generator_view(MeshingContext &, const std::function<double(glm::dvec3)> &, const MeshingOptions &,
+                                  const ViewOptions &, TriMesh &);
+
+template void mesh_generator_view(MeshingContext &, const KernelEvaluator &, const MeshingOptions &,
+                                  const ViewOptions &, TriMesh &);
+
+template StreamingStats mesh_generator_streaming(const std::function<double(glm::dvec3)> &, const MeshingOptions &,
+                                                 const std::string &, const std::function<void(int, int)> &);
+
+template StreamingStats mesh_generator_streaming(const KernelEvaluator &, const MeshingOptions &, const std::string &,
+                                                 const std::function<void(int, int)> &);
+
@@ -6,13 +6,243 @@
 #include <vector>
 #include <array>
 #include <glm/vec3.hpp>
+#include <glm/vec2.hpp>
 #include <functional>
+#include <limits>
+#include <string>
+#include <cstdint>
+#include <memory>
 
 struct QuadMesh {
     std::vector<glm::dvec3> vertices;
     std::vector<std::array<int, 4>> quads;
 };
 
+struct TriMesh {
+    std::vector<glm::dvec3> vertices;
+    std::vector<std::array<int, 3>> triangles;
+};
+
+// Strategy used to place the vertex inside each voxel that contains a zero-crossing
+enum class MeshingMode {
+    // Minimize a quadric error metric built from the refined zero-crossings and the gradients of f.
+    // Reproduces sharp features but needs additional evaluations of f per active voxel.
+    DualContouring,
+    // Average the linearly interpolated zero-crossings of the voxel edges (Surface Nets).
+    // Only uses the already sampled grid values, intended for fast interactive previews.
+    SurfaceNets
+};
+
+// Parameters of the meshers, the defaults reproduce the original settings on a 50^3 grid
+struct MeshingOptions {
+    // The sampled box, its corners are grid points
+    glm::dvec3 lower{-3.0};
+    glm::dvec3 upper{3.0};
+    // Number of grid points along each axis, at least 2
+    glm::ivec3 resolution{50};
+    MeshingMode mode = MeshingMode::DualContouring;
+    // A cell is skipped if |f| at its center exceeds culling_factor times half of its diagonal. Values below
+    // the Lipschitz constant of f can miss parts of the surface.
+    double culling_factor = 1.5;
+    // Budget and tolerance of the regula falsi search for the zero-crossing on an edge
+    int root_iterations = 5;
+    double root_tolerance = 1e-4;
+    // Step of the central differences for the normals
+    double gradient_step = 1e-4;
+    // Standard deviations of the position and the normal of the probabilistic plane quadrics, both positive
+    double position_sigma = 0.05;
+    double normal_sigma = 0.05;
+    // Maximum error of the quadric of a leaf of mesh_generator_adaptive
+    double collapse_tolerance = 1e-5;
+    // Sigmas of the quadric the collapse of a cell is decided by. Without a position sigma the error measures how
+    // far the planes are from meeting in a single point.
+    double collapse_position_sigma = 0.0;
+    double collapse_normal_sigma = 0.001;
+};
+
+// Evaluates a compiled kernel, e.g. Kernel::eval, at a fixed time. The meshers call it directly instead of
+// going through a std::function.
+struct KernelEvaluator {
+    double (*f)(double x, double y, double z, double t) = nullptr;
+    double time = 0.0;
+
+    double operator()(glm::dvec3 p) const { return f(p.x, p.y, p.z, time); }
+};
+
+// Evaluates all outputs of a compiled kernel at a fixed time, see Kernel::eval_all and Kernel::outputs
+struct MultiKernelEvaluator {
+    void (*all)(double x, double y, double z, double t, double *out) = nullptr;
+    std::vector<double (*)(double x, double y, double z, double t)> outputs;
+    double time = 0.0;
+
+    int size() const { return (int) outputs.size(); }
+
+    void operator()(glm::dvec3 p, double *out) const { all(p.x, p.y, p.z, time, out); }
+
+    KernelEvaluator output(int k) const { return {outputs[k], time}; }
+};
+
+// Surface of one output of a multi-output kernel with the values of the field outputs at its vertices
+struct SurfaceMesh {
+    // index of the output
+    int output = 0;
+    QuadMesh mesh;
+    // fields[i][v] is the i-th output that isn't a surface at vertex v
+    std::vector<std::vector<double>> fields;
+};
+
+struct MeshingScratch;
+
+// Scratch memory of the meshers that is kept between runs. Meshing with the same context only clears the
+// buffers, so once they have grown to the size of the surface, remeshing doesn't allocate anymore. A context
+// must not be used by several threads at once.
+class MeshingContext {
+public:
+    MeshingContext();
+
+    ~MeshingContext();
+
+    MeshingContext(MeshingContext &&) noexcept;
+
+    MeshingContext &operator=(MeshingContext &&) noexcept;
+
+    MeshingScratch &scratch() { return *m_scratch; }
+
+    // Forget the octree kept by mesh_generator_temporal, required if the function was recompiled to the same address
+    void reset_temporal();
+
+private:
+    std::unique_ptr<MeshingScratch> m_scratch;
+};
+
 // generate a mesh from an implicit function f with n^3 grid points
-QuadMesh mesh_generator(std::function<double(glm::dvec3)> f, int n = 50);
+QuadMesh mesh_generator(std::function<double(glm::dvec3)> f, int n = 50, MeshingMode mode = MeshingMode::DualContouring);
+
+// The configurable meshers are templates over the evaluator, a callable taking a glm::dvec3. They are
+// defined in implicit_meshing_impl.h, include it for other evaluators. std::function<double(glm::dvec3)> and
+// KernelEvaluator are instantiated once in implicit_meshing.cpp. The scratch memory of context and the vectors
+// of mesh, which is overwritten, are reused.
+template<class Evaluator>
+void mesh_generator(MeshingContext &context, const Evaluator &f, const MeshingOptions &options, QuadMesh &mesh);
+
+// generate a mesh on an adaptive octree. The octree is refined top down and a cell stays a leaf once the planes
+// of the zero-crossings on its edges meet within tolerance inside of the cell and keeping it does not change the
+// topology, so sampling and output size scale with the geometric complexity. Faces between cells of different
+// sizes degenerate to triangles.
+TriMesh mesh_generator_adaptive(std::function<double(glm::dvec3)> f, int n = 50, double tolerance = 1e-5);
+
+// Crossing points and normals on the edges of every voxel with a vertex, the expensive part of dual contouring.
+// Changing the sigmas of the quadrics only requires solve_hermite instead of sampling the grid again.
+struct HermiteData {
+    // Voxels with a vertex in the order of the vertices
+    std::vector<glm::ivec3> voxels;
+    // The crossings of vertex v are [offsets[v], offsets[v + 1])
+    std::vector<int> offsets;
+    std::vector<glm::dvec3> points;
+    std::vector<glm::dvec3> normals;
+    // Faces don't depend on the vertex positions
+    std::vector<std::array<int, 4>> quads;
+};
+
+// Sample f like mesh_generator and store the Hermite data of all active voxels instead of a mesh, the mode of
+// options is ignored.
+template<class Evaluator>
+void sample_hermite(MeshingContext &context, const Evaluator &f, const MeshingOptions &options, HermiteData &data);
+
+// Place the vertices with dual contouring for the given sigmas of the quadrics. With the sigmas of the options
+// passed to sample_hermite, the mesh is the dual contouring mesh of mesh_generator.
+void solve_hermite(const HermiteData &data, double position_sigma, double normal_sigma, QuadMesh &mesh);
+
+// Camera and level of detail settings of mesh_generator_view
+struct ViewOptions {
+    glm::dvec3 camera{0.0, 0.0, 5.0};
+    // unit vector of the view direction
+    glm::dvec3 look{0.0, 0.0, -1.0};
+    // vertical field of view in degrees
+    double fov = 45.0;
+    glm::ivec2 viewport{1280, 720};
+    // Cells are merged as long as their projection stays below this size in pixels
+    double pixels_per_cell = 4.0;
+    // Optional region of interest, cells overlapping it are never merged. Empty if lower > upper.
+    glm::dvec3 roi_lower{0.0};
+    glm::dvec3 roi_upper{-1.0};
+    // Levels the region of interest is refined below the grid of the options, each one halves the voxels
+    int roi_levels = 1;
+};
+
+// Mesh f on the octree of mesh_generator_adaptive, but pick the depth of every region from its size on screen
+// instead of the quadric error. The octree is refined top down and a cell with a sign change becomes a leaf once
+// it is outside of the view frustum or its projection is below view.pixels_per_cell, and the merge keeps the
+// topology. Voxels of the grid of options are the smallest leaves, only cells overlapping the region of interest
+// are split further, view.roi_levels times. Only the visited cells are sampled, so the cost follows the detail
+// on screen instead of the resolution.
+template<class Evaluator>
+void mesh_generator_view(MeshingContext &context, const Evaluator &f, const MeshingOptions &options,
+                         const ViewOptions &view, TriMesh &mesh);
+
+// Settings of mesh_generator_temporal
+struct TemporalOptions {
+    // Bound of |f(p, t1) - f(p, t0)| / |t1 - t0| over the domain, taken from the graph with time_speed_bound.
+    // Infinity traverses the whole grid on every frame.
+    double speed = std::numeric_limits<double>::infinity();
+    // The whole grid is traversed again once the motion bound accumulated since the last full traversal exceeds
+    // this value, which also merges the cells split up by the moving surface
+    double max_motion = 0.5;
+};
+
+// Mesh f at the time of the evaluator, reusing the octree of the previous call with the same context. The cells
+// the previous frame culled stay culled as long as the motion bound times the elapsed time is below the margin
+// by which they were culled. Only the cells around the previous surface and the cells whose margin is used up
+// are traversed again. Falls back to a full traversal for the first frame, if f or options changed, the speed
+// isn't bounded or the accumulated motion exceeds temporal.max_motion. The speed has to be a true bound of f,
+// otherwise parts of the surface that move faster can be missed.
+void mesh_generator_temporal(MeshingContext &context, const KernelEvaluator &f, const MeshingOptions &options,
+                             const TemporalOptions &temporal, QuadMesh &mesh);
+
+// Mesh every output k with surface[k] set and sample the other outputs at the vertices, with a single traversal
+// of the grid. A cell is subdivided as long as any of the surfaces may pass through it and every grid point
+// evaluates all outputs at once, so subgraphs shared by the outputs are computed once per sample. meshes is
+// overwritten with one entry per surface in the order of the outputs.
+void mesh_generator_multi(MeshingContext &context, const MultiKernelEvaluator &f, const std::vector<bool> &surface,
+                          const MeshingOptions &options, std::vector<SurfaceMesh> &meshes);
+
+// Part of a mesh computed by mesh_tile. Vertices and faces refer to voxels by their id, the index of the voxel in
+// a dense resolution.x * resolution.y * resolution.z array. Faces use -1 for voxels without a vertex.
+struct MeshTile {
+    // sorted ids of the voxels with a vertex
+    std::vector<int64_t> voxel_ids;
+    std::vector<glm::dvec3> vertices;
+    std::vector<std::array<int64_t, 4>> faces;
+};
+
+// Mesh the voxels [lower, upper) of the grid given by options. The tile reproduces the samples and vertices of
+// mesh_generator inside the tile and stores the vertices of one layer of voxels beyond upper, which are shared
+// with the neighbouring tiles. Only grid points in [lower, upper + 1] are sampled, so the memory grows with the
+// tile size instead of the size of the whole grid.
+template<class Evaluator>
+void mesh_tile(MeshingContext &context, const Evaluator &f, const MeshingOptions &options, glm::ivec3 lower,
+               glm::ivec3 upper, MeshTile &tile);
+
+// Merge tiles that cover the grid, vertices shared by several tiles are deduplicated by their voxel id. The
+// result has the vertices and faces of mesh_generator, with the vertices ordered by voxel id.
+QuadMesh merge_tiles(const std::vector<MeshTile> &tiles);
+
+template<class Evaluator>
+void mesh_generator_adaptive(MeshingContext &context, const Evaluator &f, const MeshingOptions &options,
+                             TriMesh &mesh);
+
+struct StreamingStats {
+    int64_t num_vertices = 0;
+    int64_t num_quads = 0;
+};
+
+// generate a mesh with n^3 grid points and write it incrementally to the OBJ file at path. The domain
+// is swept in z-slabs and only two slices of samples and vertex indices are kept in memory, so the
+// memory requirement grows with n^2 instead of n^3. Throws std::runtime_error if the file can't be written.
+StreamingStats mesh_generator_streaming(std::function<double(glm::dvec3)> f, int n, const std::string &path,
+                                        MeshingMode mode = MeshingMode::DualContouring);
 
+// progress is called after every z-slice with the number of finished and total slices
+template<class Evaluator>
+StreamingStats mesh_generator_streaming(const Evaluator &f, const MeshingOptions &options, const std::string &path,
+                                        const std::function<void(int, int)> &progress = nullptr);
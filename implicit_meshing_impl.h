@@ -0,0 +1,1236 @@
+//
+// Created by elisabeth on 14.03.24.
+//
+
+#pragma once
+
+// Definitions of the templated meshers and the helpers they share. implicit_meshing.cpp instantiates them for
+// std::function and the evaluators declared in implicit_meshing.h, include this header to mesh with any other
+// callable.
+
+#include "implicit_meshing.h"
+#include <memory>
+#include <cstdio>
+#include <stdexcept>
+#include <climits>
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#include "third_party/probabilistic-quadrics.hh"
+#include "third_party/hash_table7.hpp"
+
+using glm_trait = pq::math<double, glm::dvec3, glm::dvec3, glm::dmat3>;
+using quadric = pq::quadric<glm_trait>;
+
+// Edge between two adjaccent grid points a and b
+// idx shows the axis of the edge (0 -> x, 1 -> y, 2 -> z)
+struct Edge {
+    glm::ivec3 a;
+    glm::ivec3 b;
+    int idx;
+};
+
+struct GridHash {
+    size_t operator()(const glm::ivec3 &v) const {
+        // Use std::hash for individual components and combine them
+        size_t seed = 0;
+        seed ^= std::hash<int>()(v.x) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        seed ^= std::hash<int>()(v.y) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        seed ^= std::hash<int>()(v.z) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        return seed;
+    }
+};
+
+// GridCell represents a range of grid points in 3D space.
+// The first vector defines the inclusive lower-left front grid index,
+// while the second vector defines the exclusive upper-right back grid index.
+using GridCell = std::pair<glm::ivec3, glm::ivec3>;
+
+// Split current grid cell intro 8 smaller cells
+inline void generate_children(std::vector<GridCell> &grid_cells, const GridCell &current) {
+    glm::ivec3 min_coord = current.first;
+    glm::ivec3 max_coord = current.second;
+
+    // Ensure the cell dimensions are valid
+    if (max_coord.x <= min_coord.x || max_coord.y <= min_coord.y || max_coord.z <= min_coord.z) {
+        throw std::invalid_argument("Invalid cell dimensions");
+    }
+
+    // Calculate the size of each child cell
+    glm::ivec3 cell_size = (max_coord - min_coord) / 2;
+
+    // Ensure each child cell will have a positive size
+    assert(cell_size.x > 0 && cell_size.y > 0 && cell_size.z > 0);
+
+    for (int x = 0; x < 2; ++x) {
+        for (int y = 0; y < 2; ++y) {
+            for (int z = 0; z < 2; ++z) {
+                glm::ivec3 child_min = min_coord + cell_size * glm::ivec3(x, y, z);
+                glm::ivec3 child_max = child_min + cell_size;
+
+                // Adjust the max boundary for the last cell in each dimension
+                if (x == 1) child_max.x = max_coord.x;
+                if (y == 1) child_max.y = max_coord.y;
+                if (z == 1) child_max.z = max_coord.z;
+
+                GridCell child_cell(child_min, child_max);
+                grid_cells.push_back(child_cell);
+            }
+        }
+    }
+}
+
+inline glm::dvec3 interpolate(std::pair<glm::dvec3, double> neg, std::pair<glm::dvec3, double> pos) {
+    double val_neg = neg.second;
+    double val_pos = pos.second;
+    assert(val_neg <= 0);
+    assert(val_pos >= 0);
+    auto pt_neg = neg.first;
+    auto pt_pos = pos.first;
+    double t = val_neg / (val_neg - val_pos);
+    glm::dvec3 p = pt_neg + (pt_pos - pt_neg) * t;
+    return p;
+}
+
+template<class Evaluator>
+glm::dvec3 find_point_on_surface(std::pair<glm::dvec3, double> neg, std::pair<glm::dvec3, double> pos,
+                                 const Evaluator &f, int num_iterations, double threshold) {
+    assert(num_iterations > 0);
+    for (int i = 0; i < num_iterations - 1; ++i) {
+        glm::dvec3 p = interpolate(neg, pos);
+        double val = f(p);
+        if (std::abs(val) < threshold) {
+            return p;
+        }
+        if (val < 0) {
+            neg = {p, val};
+        } else {
+            pos = {p, val};
+        }
+    }
+
+    // Return the best approximation if the loop completes without finding the exact point
+    return interpolate(neg, pos);
+}
+
+// Maps grid indices to points in the meshing domain, the domain is sampled with n[axis] points per axis
+struct GridMapping {
+    glm::dvec3 lower;
+    glm::dvec3 upper;
+    glm::ivec3 n;
+
+    explicit GridMapping(const MeshingOptions &options) : lower(options.lower), upper(options.upper),
+                                                          n(options.resolution) {
+        if (n.x < 2 || n.y < 2 || n.z < 2) {
+            throw std::invalid_argument("The resolution needs at least two grid points per axis");
+        }
+    }
+
+    glm::dvec3 operator()(glm::dvec3 index) const {
+        return lower + index / (glm::dvec3(n) - 1.0) * (upper - lower);
+    }
+
+    // index of the voxel (or grid point) in a dense array
+    size_t flat(int i, int j, int k) const {
+        return ((size_t) i * n.y + j) * n.z + k;
+    }
+};
+
+// Sampled function values, only grid points close to the surface are stored
+using Grid = emhash7::HashMap<glm::ivec3, double, GridHash>;
+
+// The three edges of a voxel that are owned by it, each of them generates one face
+const std::array<Edge, 3> edges = {{{{1, 1, 0}, {1, 1, 1}, 2},
+                                    {{1, 0, 1}, {1, 1, 1}, 1},
+                                    {{0, 1, 1}, {1, 1, 1}, 0},}};
+
+// All twelve edges of a voxel
+const std::array<std::pair<glm::ivec3, glm::ivec3>, 12> all_edges = {{{{0, 0, 0}, {1, 0, 0}},
+                                                                      {{0, 0, 0}, {0, 1, 0}},
+                                                                      {{0, 0, 0}, {0, 0, 1}},
+                                                                      {{1, 0, 0}, {1, 1, 0}},
+                                                                      {{1, 0, 0}, {1, 0, 1}},
+                                                                      {{0, 1, 0}, {1, 1, 0}},
+                                                                      {{0, 1, 0}, {0, 1, 1}},
+                                                                      {{0, 0, 1}, {1, 0, 1}},
+                                                                      {{0, 0, 1}, {0, 1, 1}},
+                                                                      {{1, 1, 0}, {1, 1, 1}},
+                                                                      {{1, 0, 1}, {1, 1, 1}},
+                                                                      {{0, 1, 1}, {1, 1, 1}},}};
+
+template<class Evaluator>
+glm::dvec3 gradient(const Evaluator &f, glm::dvec3 p, double eps) {
+    double dx = (f({p.x + eps, p.y, p.z}) - f({p.x - eps, p.y, p.z})) / (2 * eps);
+    double dy = (f({p.x, p.y + eps, p.z}) - f({p.x, p.y - eps, p.z})) / (2 * eps);
+    double dz = (f({p.x, p.y, p.z + eps}) - f({p.x, p.y, p.z - eps})) / (2 * eps);
+    return {dx, dy, dz};
+}
+
+// true if lower <= index < upper holds for all components
+inline bool in_box(glm::ivec3 index, glm::ivec3 lower, glm::ivec3 upper) {
+    return index.x >= lower.x && index.y >= lower.y && index.z >= lower.z &&
+           index.x < upper.x && index.y < upper.y && index.z < upper.z;
+}
+
+// Sample f on all grid points that are close to the zero level set. Cells are subdivided recursively
+// and skipped as soon as the function value at their center proves that they contain no zero-crossing.
+// grid_cells is the stack used for the subdivision, both buffers are cleared first. Only the grid points in
+// [clip_lower, clip_upper) are sampled. The subdivision itself doesn't depend on the clip box, so a clipped
+// grid contains exactly the samples of the full grid inside the box.
+template<class Evaluator>
+void sample_grid(const Evaluator &f, const GridMapping &index_to_grid_point, double culling_factor,
+                 std::vector<GridCell> &grid_cells, Grid &grid, glm::ivec3 clip_lower = glm::ivec3(0),
+                 glm::ivec3 clip_upper = glm::ivec3(INT_MAX)) {
+    grid_cells.clear();
+    grid_cells.push_back({{0, 0, 0}, index_to_grid_point.n});
+    grid.clear();
+
+    // subdivide cells that contain zero-crossings
+    while (!grid_cells.empty()) {
+        GridCell cell = grid_cells.back();
+        grid_cells.pop_back();
+        // skip cells outside of the clip box
+        if (!in_box(cell.first, glm::ivec3(INT_MIN), clip_upper) || !in_box(clip_lower, glm::ivec3(INT_MIN), cell.second)) {
+            continue;
+        }
+        glm::ivec3 grid_size = cell.second - cell.first;
+        // if the cell is too small to divide it again, just evaluate the function at the lower corner
+        if (grid_size.x == 1 || grid_size.y == 1 || grid_size.z == 1) {
+            glm::ivec3 first = glm::max(cell.first, clip_lower);
+            glm::ivec3 last = glm::min(cell.second, clip_upper);
+            for (int i = first.x; i < last.x; ++i) {
+                for (int j = first.y; j < last.y; ++j) {
+                    for (int k = first.z; k < last.z; ++k) {
+                        glm::ivec3 index = {i, j, k};
+                        grid[index] = f(index_to_grid_point(index));
+                    }
+                }
+            }
+            continue;
+        }
+        // if the cell does not contain a zero-crossing, skip the cell
+        glm::dvec3 cell_lower = index_to_grid_point(cell.first);
+        glm::dvec3 cell_upper = index_to_grid_point(cell.second);
+        double v = f((cell_upper + cell_lower) / 2.0);
+        if (abs(v) > culling_factor * glm::length(cell_upper - cell_lower) / 2.0) {
+            continue;
+        }
+        // if the cell contains a zero-crossing, subdivide it into 8 smaller cells
+        generate_children(grid_cells, cell);
+    }
+}
+
+// Call visit(neg, pos) for every edge of the voxel at index whose end points have a different sign.
+// neg is the end point with the negative function value. Returns the number of visited edges.
+template<class Visitor>
+int for_each_zero_crossing(const Grid &grid, const GridMapping &index_to_grid_point, glm::ivec3 index,
+                           Visitor &&visit) {
+    int counter = 0;
+    for (auto e: all_edges) {
+        glm::ivec3 index_p1 = index + e.first;
+        glm::ivec3 index_p2 = index + e.second;
+        auto it1 = grid.find(index_p1);
+        auto it2 = grid.find(index_p2);
+        if (it1 == grid.end() || it2 == grid.end()) {
+            continue;
+        }
+        double v1 = it1->second;
+        double v2 = it2->second;
+        if (v1 * v2 <= 0) {
+            glm::dvec3 p1 = index_to_grid_point(index_p1);
+            glm::dvec3 p2 = index_to_grid_point(index_p2);
+
+            std::pair p1v1 = {p1, v1};
+            std::pair p2v2 = {p2, v2};
+
+            if (v1 > 0) {
+                std::swap(p1v1, p2v2);
+            }
+            counter++;
+            visit(p1v1, p2v2);
+        }
+    }
+    return counter;
+}
+
+// Generate the faces of the output mesh by connecting the points of the four voxels around each
+// edge with a zero-crossing. voxel_index returns the index of the point in the voxel (i, j, k). Only the
+// edges owned by voxels in [base_lower, base_upper) generate faces.
+template<class VoxelIndex>
+void generate_faces(const Grid &grid, VoxelIndex &&voxel_index, std::vector<std::array<int, 4>> &faces,
+                    glm::ivec3 base_lower = glm::ivec3(INT_MIN), glm::ivec3 base_upper = glm::ivec3(INT_MAX)) {
+    for (const auto &element: grid) {
+        glm::ivec3 index = element.first;
+        if (!in_box(index, base_lower, base_upper)) {
+            continue;
+        }
+        int i = index.x;
+        int j = index.y;
+        int k = index.z;
+        int index_p = voxel_index(i, j, k);
+        if (index_p == -1) {
+            continue;
+        }
+        for (auto e: edges) {
+            glm::ivec3 index_p1 = index + e.a;
+            glm::ivec3 index_p2 = index + e.b;
+            auto it1 = grid.find(index_p1);
+            auto it2 = grid.find(index_p2);
+            if (it1 == grid.end() || it2 == grid.end()) {
+                continue;
+            }
+            double v1 = it1->second;
+            double v2 = it2->second;
+            if (v1 * v2 <= 0) {
+                std::array<int, 4> face{};
+                if (e.idx == 0) {
+                    face[0] = index_p;
+                    face[1] = voxel_index(i, j, k + 1);
+                    face[2] = voxel_index(i, j + 1, k + 1);
+                    face[3] = voxel_index(i, j + 1, k);
+                }
+                if (e.idx == 1) {
+                    face[0] = index_p;
+                    face[1] = voxel_index(i + 1, j, k);
+                    face[2] = voxel_index(i + 1, j, k + 1);
+                    face[3] = voxel_index(i, j, k + 1);
+                }
+                if (e.idx == 2) {
+                    face[0] = index_p;
+                    face[1] = voxel_index(i, j + 1, k);
+                    face[2] = voxel_index(i + 1, j + 1, k);
+                    face[3] = voxel_index(i + 1, j, k);
+                }
+                if (v1 < 0) {
+                    std::reverse(face.begin(), face.end());
+                }
+                faces.push_back(face);
+            }
+        }
+    }
+}
+
+// Node of the octree built top down by build_octree. Children are indices into the node array or -1 for empty
+// space. Corner and child i is at offset (i >> 2, (i >> 1) & 1, i & 1), bit i of corners is set if the
+// function is negative at corner i.
+struct OctreeNode {
+    glm::ivec3 lower;
+    int size;
+    bool leaf = false;
+    int corners = 0;
+    int vertex = -1;
+    std::array<int, 8> children{-1, -1, -1, -1, -1, -1, -1, -1};
+};
+
+struct MeshingScratch {
+    std::vector<GridCell> grid_cells;
+    Grid grid;
+    // Vertex of every voxel or -1. Only the voxels listed in used_voxels are set and they are reset after every
+    // run, so the n^3 entries never have to be cleared.
+    std::vector<int> index_points;
+    std::vector<size_t> used_voxels;
+    std::vector<OctreeNode> octree;
+    std::vector<std::array<int, 4>> faces;
+    // Octree of the last frame of mesh_generator_temporal: cells of at least brick size that were culled with
+    // their remaining margin, or active with a negative margin
+    std::vector<std::pair<GridCell, double>> temporal_cells;
+    std::vector<std::pair<GridCell, double>> temporal_stack;
+    bool temporal_valid = false;
+    double (*temporal_function)(double, double, double, double) = nullptr;
+    double temporal_time = 0.0;
+    double temporal_motion = 0.0;
+    MeshingOptions temporal_options;
+    // All outputs of the grid points sampled by mesh_generator_multi, sample_ids maps a grid point to its row
+    std::vector<double> samples;
+    emhash7::HashMap<glm::ivec3, int, GridHash> sample_ids;
+};
+
+// For each voxel we compute a point if at least one of its edges contains a zero-crossing. The point is
+// computed by minimizing a quadric error metric, or in SurfaceNets mode by averaging the linearly
+// interpolated zero-crossings. Returns false if the voxel has no zero-crossing.
+template<class Evaluator>
+bool voxel_vertex(const Grid &grid, const GridMapping &index_to_grid_point, const Evaluator &f,
+                  const MeshingOptions &options, glm::ivec3 index, glm::dvec3 &vertex) {
+    quadric q;
+    glm::dvec3 centroid{0};
+    int counter = for_each_zero_crossing(grid, index_to_grid_point, index, [&](auto neg, auto pos) {
+        if (options.mode == MeshingMode::SurfaceNets) {
+            centroid += interpolate(neg, pos);
+            return;
+        }
+        auto zero_crossing = find_point_on_surface(neg, pos, f, options.root_iterations, options.root_tolerance);
+        glm::dvec3 normal = glm::normalize(gradient(f, zero_crossing, options.gradient_step));
+        q += quadric::probabilistic_plane_quadric(zero_crossing, normal, options.position_sigma,
+                                                  options.normal_sigma);
+    });
+    if (counter == 0) {
+        return false;
+    }
+    vertex = options.mode == MeshingMode::SurfaceNets ? centroid / (double) counter : q.minimizer();
+    return true;
+}
+
+// Compute the vertices and faces of the sampled grid
+template<class Evaluator>
+void mesh_grid(MeshingScratch &scratch, const Grid &grid, const GridMapping &index_to_grid_point, const Evaluator &f,
+               const MeshingOptions &options, QuadMesh &mesh) {
+    std::vector<glm::dvec3> &points = mesh.vertices;
+    std::vector<std::array<int, 4>> &faces = mesh.quads;
+    points.clear();
+    faces.clear();
+    std::vector<int> &index_points = scratch.index_points;
+    size_t num_voxels = (size_t) options.resolution.x * options.resolution.y * options.resolution.z;
+    if (index_points.size() < num_voxels) {
+        index_points.resize(num_voxels, -1);
+    }
+
+    // generate vertex positions of the output mesh
+    for (const auto &element: grid) {
+        glm::ivec3 index = element.first;
+        glm::dvec3 vertex;
+        if (voxel_vertex(grid, index_to_grid_point, f, options, index, vertex)) {
+            points.push_back(vertex);
+            size_t voxel = index_to_grid_point.flat(index.x, index.y, index.z);
+            index_points[voxel] = (int) points.size() - 1;
+            scratch.used_voxels.push_back(voxel);
+        }
+    }
+
+    generate_faces(grid, [&](int i, int j, int k) { return index_points[index_to_grid_point.flat(i, j, k)]; }, faces);
+
+    for (size_t voxel: scratch.used_voxels) {
+        index_points[voxel] = -1;
+    }
+    scratch.used_voxels.clear();
+}
+
+template<class Evaluator>
+void mesh_generator(MeshingContext &context, const Evaluator &f, const MeshingOptions &options, QuadMesh &mesh) {
+    MeshingScratch &scratch = context.scratch();
+    GridMapping index_to_grid_point(options);
+
+    /* used for debugging
+    auto draw_grid_cell = [=](GridCell cell) {
+        glm::vec3 lower = index_to_grid_point(cell.first);
+        glm::vec3 upper = index_to_grid_point(cell.second);
+        std::vector<glm::vec3> pts{
+                // Bottom square
+                glm::vec3{lower[0], lower[1], lower[2]}, glm::vec3{upper[0], lower[1], lower[2]},
+                glm::vec3{upper[0], lower[1], lower[2]}, glm::vec3{upper[0], lower[1], upper[2]},
+                glm::vec3{upper[0], lower[1], upper[2]}, glm::vec3{lower[0], lower[1], upper[2]},
+                glm::vec3{lower[0], lower[1], upper[2]}, glm::vec3{lower[0], lower[1], lower[2]},
+
+                // Top square
+                glm::vec3{lower[0], upper[1], lower[2]}, glm::vec3{upper[0], upper[1], lower[2]},
+                glm::vec3{upper[0], upper[1], lower[2]}, glm::vec3{upper[0], upper[1], upper[2]},
+                glm::vec3{upper[0], upper[1], upper[2]}, glm::vec3{lower[0], upper[1], upper[2]},
+                glm::vec3{lower[0], upper[1], upper[2]}, glm::vec3{lower[0], upper[1], lower[2]},
+
+                // Connecting lines between top and bottom squares
+                glm::vec3{lower[0], lower[1], lower[2]}, glm::vec3{lower[0], upper[1], lower[2]},
+                glm::vec3{upper[0], lower[1], lower[2]}, glm::vec3{upper[0], upper[1], lower[2]},
+                glm::vec3{upper[0], lower[1], upper[2]}, glm::vec3{upper[0], upper[1], upper[2]},
+                glm::vec3{lower[0], lower[1], upper[2]}, glm::vec3{lower[0], upper[1], upper[2]}
+        };
+
+        std::vector<std::array<size_t, 2>> lines
+                = {{0,  1},
+                   {2,  3},
+                   {4,  5},
+                   {6,  7},
+                   {8,  9},
+                   {10, 11},
+                   {12, 13},
+                   {14, 15},
+                   {16, 17},
+                   {18, 19},
+                   {20, 21},
+                   {22, 23}};
+
+        static size_t id = 0;
+        auto bb_lines = ps::registerCurveNetwork("bounding_box" + std::to_string(id++), pts, lines);
+        bb_lines->setRadius(0.003);
+    };*/
+
+    sample_grid(f, index_to_grid_point, options.culling_factor, scratch.grid_cells, scratch.grid);
+    mesh_grid(scratch, scratch.grid, index_to_grid_point, f, options, mesh);
+}
+
+template<class Evaluator>
+void mesh_tile(MeshingContext &context, const Evaluator &f, const MeshingOptions &options, glm::ivec3 lower,
+               glm::ivec3 upper, MeshTile &tile) {
+    MeshingScratch &scratch = context.scratch();
+    GridMapping index_to_grid_point(options);
+    glm::ivec3 n = options.resolution;
+    lower = glm::clamp(lower, glm::ivec3(0), n);
+    upper = glm::clamp(upper, lower, n);
+
+    // The faces of the tile also use the vertices of one layer of voxels above the tile. These voxels need
+    // the samples up to upper + 1.
+    glm::ivec3 voxel_upper = glm::min(upper + 1, n);
+    sample_grid(f, index_to_grid_point, options.culling_factor, scratch.grid_cells, scratch.grid, lower,
+                glm::min(upper + 2, n));
+    const Grid &grid = scratch.grid;
+
+    // vertices of the tile and the halo, sorted by voxel id
+    tile.voxel_ids.clear();
+    tile.vertices.clear();
+    tile.faces.clear();
+    std::vector<std::pair<int64_t, glm::dvec3>> vertices;
+    for (const auto &element: grid) {
+        glm::ivec3 index = element.first;
+        glm::dvec3 vertex;
+        if (in_box(index, lower, voxel_upper) &&
+            voxel_vertex(grid, index_to_grid_point, f, options, index, vertex)) {
+            vertices.emplace_back((int64_t) index_to_grid_point.flat(index.x, index.y, index.z), vertex);
+        }
+    }
+    std::sort(vertices.begin(), vertices.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+    for (const auto &[id, vertex]: vertices) {
+        tile.voxel_ids.push_back(id);
+        tile.vertices.push_back(vertex);
+    }
+
+    // faces refer to the vertices by voxel id, the dense table only covers the voxels of this tile
+    glm::ivec3 extent = voxel_upper - lower;
+    std::vector<int> &index_points = scratch.index_points;
+    size_t num_voxels = (size_t) extent.x * extent.y * extent.z;
+    if (index_points.size() < num_voxels) {
+        index_points.resize(num_voxels, -1);
+    }
+    auto local = [&](int i, int j, int k) {
+        return ((size_t) (i - lower.x) * extent.y + (j - lower.y)) * extent.z + (k - lower.z);
+    };
+    for (size_t v = 0; v < tile.voxel_ids.size(); ++v) {
+        auto id = (size_t) tile.voxel_ids[v];
+        size_t k = id % n.z;
+        size_t j = id / n.z % n.y;
+        size_t i = id / n.z / n.y;
+        index_points[local((int) i, (int) j, (int) k)] = (int) v;
+    }
+    std::vector<std::array<int, 4>> &faces = scratch.faces;
+    faces.clear();
+    generate_faces(grid, [&](int i, int j, int k) { return index_points[local(i, j, k)]; }, faces, lower, upper);
+    for (const auto &face: faces) {
+        std::array<int64_t, 4> ids{};
+        for (int c = 0; c < 4; ++c) {
+            ids[c] = face[c] == -1 ? -1 : tile.voxel_ids[face[c]];
+        }
+        tile.faces.push_back(ids);
+    }
+    for (int64_t id: tile.voxel_ids) {
+        auto k = (int) (id % n.z);
+        auto j = (int) (id / n.z % n.y);
+        auto i = (int) (id / n.z / n.y);
+        index_points[local(i, j, k)] = -1;
+    }
+}
+
+template<class Evaluator>
+void sample_hermite(MeshingContext &context, const Evaluator &f, const MeshingOptions &options, HermiteData &data) {
+    MeshingScratch &scratch = context.scratch();
+    GridMapping index_to_grid_point(options);
+    sample_grid(f, index_to_grid_point, options.culling_factor, scratch.grid_cells, scratch.grid);
+    const Grid &grid = scratch.grid;
+    data.voxels.clear();
+    data.offsets.assign(1, 0);
+    data.points.clear();
+    data.normals.clear();
+    std::vector<int> &index_points = scratch.index_points;
+    size_t num_voxels = (size_t) options.resolution.x * options.resolution.y * options.resolution.z;
+    if (index_points.size() < num_voxels) {
+        index_points.resize(num_voxels, -1);
+    }
+
+    // same crossings as voxel_vertex, in the same order
+    for (const auto &element: grid) {
+        glm::ivec3 index = element.first;
+        int counter = for_each_zero_crossing(grid, index_to_grid_point, index, [&](auto neg, auto pos) {
+            auto zero_crossing = find_point_on_surface(neg, pos, f, options.root_iterations, options.root_tolerance);
+            data.points.push_back(zero_crossing);
+            data.normals.push_back(glm::normalize(gradient(f, zero_crossing, options.gradient_step)));
+        });
+        if (counter == 0) {
+            continue;
+        }
+        data.voxels.push_back(index);
+        data.offsets.push_back((int) data.points.size());
+        size_t voxel = index_to_grid_point.flat(index.x, index.y, index.z);
+        index_points[voxel] = (int) data.voxels.size() - 1;
+        scratch.used_voxels.push_back(voxel);
+    }
+
+    data.quads.clear();
+    generate_faces(grid, [&](int i, int j, int k) { return index_points[index_to_grid_point.flat(i, j, k)]; },
+                   data.quads);
+    for (size_t voxel: scratch.used_voxels) {
+        index_points[voxel] = -1;
+    }
+    scratch.used_voxels.clear();
+}
+
+// Check that collapsing the cell [lower, lower + size]^3 does not change the topology of the surface:
+// the sign may change at most once along each edge of the cell and the signs at the face centers and
+// the cell center have to agree with at least one corner of the face or cell respectively.
+template<class Value>
+bool is_topologically_safe(Value &&value, glm::ivec3 lower, int size) {
+    auto inside = [&](glm::ivec3 index) { return value(index) < 0; };
+    bool corners[2][2][2];
+    for (int x = 0; x < 2; ++x) {
+        for (int y = 0; y < 2; ++y) {
+            for (int z = 0; z < 2; ++z) {
+                corners[x][y][z] = inside(lower + size * glm::ivec3(x, y, z));
+            }
+        }
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        glm::ivec3 dir{0};
+        dir[axis] = 1;
+        for (int u = 0; u < 2; ++u) {
+            for (int v = 0; v < 2; ++v) {
+                glm::ivec3 start = lower;
+                start[(axis + 1) % 3] += u * size;
+                start[(axis + 2) % 3] += v * size;
+                int changes = 0;
+                bool previous = inside(start);
+                for (int t = 1; t <= size; ++t) {
+                    bool current = inside(start + t * dir);
+                    changes += current != previous;
+                    previous = current;
+                }
+                if (changes > 1) {
+                    return false;
+                }
+            }
+        }
+        for (int side = 0; side < 2; ++side) {
+            glm::ivec3 center = lower + glm::ivec3(size / 2);
+            center[axis] = lower[axis] + side * size;
+            bool c = inside(center);
+            bool agrees = false;
+            for (int u = 0; u < 2; ++u) {
+                for (int v = 0; v < 2; ++v) {
+                    glm::ivec3 corner{0};
+                    corner[axis] = side;
+                    corner[(axis + 1) % 3] = u;
+                    corner[(axis + 2) % 3] = v;
+                    agrees |= corners[corner.x][corner.y][corner.z] == c;
+                }
+            }
+            if (!agrees) {
+                return false;
+            }
+        }
+    }
+    bool c = inside(lower + glm::ivec3(size / 2));
+    for (int i = 0; i < 8; ++i) {
+        if (corners[i >> 2][(i >> 1) & 1][i & 1] == c) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Tables of the octree contouring of Ju et al., "Dual Contouring of Hermite Data". Edges are numbered by axis
+// (x edges 0-3, y edges 4-7, z edges 8-11) and given by their two corners.
+constexpr int EDGE_CORNERS[12][2] = {{0, 4}, {1, 5}, {2, 6}, {3, 7}, {0, 2}, {1, 3}, {4, 6}, {5, 7},
+                                     {0, 1}, {2, 3}, {4, 5}, {6, 7}};
+// pairs of children sharing a face inside of a cell and the axis of the face
+constexpr int CELL_FACES[12][3] = {{0, 4, 0}, {1, 5, 0}, {2, 6, 0}, {3, 7, 0}, {0, 2, 1}, {4, 6, 1},
+                                   {1, 3, 1}, {5, 7, 1}, {0, 1, 2}, {2, 3, 2}, {4, 5, 2}, {6, 7, 2}};
+// quadruples of children sharing an edge inside of a cell and the axis of the edge
+constexpr int CELL_EDGES[6][5] = {{0, 1, 2, 3, 0}, {4, 5, 6, 7, 0}, {0, 4, 1, 5, 1},
+                                  {2, 6, 3, 7, 1}, {0, 2, 4, 6, 2}, {1, 3, 5, 7, 2}};
+// children of two cells sharing a face along an axis that share the sub faces
+constexpr int FACE_FACES[3][4][3] = {{{4, 0, 0}, {5, 1, 0}, {6, 2, 0}, {7, 3, 0}},
+                                     {{2, 0, 1}, {6, 4, 1}, {3, 1, 1}, {7, 5, 1}},
+                                     {{1, 0, 2}, {3, 2, 2}, {5, 4, 2}, {7, 6, 2}}};
+// edges inside of a face: the order of the two cells, the four children and the axis of the edge
+constexpr int FACE_EDGES[3][4][6] = {{{1, 4, 0, 5, 1, 1}, {1, 6, 2, 7, 3, 1}, {0, 4, 6, 0, 2, 2}, {0, 5, 7, 1, 3, 2}},
+                                     {{0, 2, 3, 0, 1, 0}, {0, 6, 7, 4, 5, 0}, {1, 2, 0, 6, 4, 2}, {1, 3, 1, 7, 5, 2}},
+                                     {{1, 1, 0, 3, 2, 0}, {1, 5, 4, 7, 6, 0}, {0, 1, 5, 0, 4, 1}, {0, 3, 7, 2, 6, 1}}};
+// children of four cells around an edge that share its two halves
+constexpr int EDGE_EDGES[3][2][5] = {{{3, 2, 1, 0, 0}, {7, 6, 5, 4, 0}},
+                                     {{5, 1, 4, 0, 1}, {7, 3, 6, 2, 1}},
+                                     {{6, 4, 2, 0, 2}, {7, 5, 3, 1, 2}}};
+// the edge of each of the four cells around an edge that coincides with it
+constexpr int EDGE_OF_CELL[3][4] = {{3, 2, 1, 0}, {7, 5, 6, 4}, {11, 10, 9, 8}};
+
+// Build an octree over the voxels of the grid top down. A cell is skipped if it is culled like in sample_grid.
+// A cell with a sign change at its corners becomes a leaf if accept(lower, size, q, vertex) agrees with the
+// quadric of the zero-crossings on its edges and the vertex placed with the sigmas of the options, and if
+// collapsing it keeps the topology. All other cells are split down to single voxels. Only the visited grid
+// points are evaluated, they are cached in grid. Returns the root or -1 if the octree is empty.
+template<class Evaluator, class Accept>
+int build_octree(const Evaluator &f, const GridMapping &index_to_grid_point, const MeshingOptions &options,
+                        Accept &&accept, Grid &grid, std::vector<OctreeNode> &nodes,
+                        std::vector<glm::dvec3> &vertices) {
+    grid.clear();
+    nodes.clear();
+    vertices.clear();
+    glm::ivec3 voxels = index_to_grid_point.n - 1;
+    int root_size = 1;
+    while (root_size < std::max({voxels.x, voxels.y, voxels.z})) {
+        root_size *= 2;
+    }
+    auto value = [&](glm::ivec3 index) {
+        auto it = grid.find(index);
+        if (it != grid.end()) {
+            return it->second;
+        }
+        double v = f(index_to_grid_point(index));
+        grid[index] = v;
+        return v;
+    };
+    auto corner = [](glm::ivec3 lower, int size, int i) {
+        return lower + size * glm::ivec3(i >> 2, (i >> 1) & 1, i & 1);
+    };
+
+    // the children are built before their parent is added, so the recursion depth is the depth of the octree
+    auto build = [&](auto &&self, glm::ivec3 lower, int size) -> int {
+        if (lower.x >= voxels.x || lower.y >= voxels.y || lower.z >= voxels.z) {
+            return -1;
+        }
+        OctreeNode node;
+        node.lower = lower;
+        node.size = size;
+        bool inside_grid = lower.x + size <= voxels.x && lower.y + size <= voxels.y && lower.z + size <= voxels.z;
+        if (inside_grid) {
+            for (int i = 0; i < 8; ++i) {
+                node.corners |= (value(corner(lower, size, i)) < 0) << i;
+            }
+        }
+        bool sign_change = inside_grid && node.corners != 0 && node.corners != 255;
+        if (size == 1) {
+            glm::dvec3 vertex;
+            if (!sign_change || !voxel_vertex(grid, index_to_grid_point, f, options, lower, vertex)) {
+                return -1;
+            }
+            node.leaf = true;
+            node.vertex = (int) vertices.size();
+            vertices.push_back(vertex);
+            nodes.push_back(node);
+            return (int) nodes.size() - 1;
+        }
+        glm::dvec3 cell_lower = index_to_grid_point(lower);
+        glm::dvec3 cell_upper = index_to_grid_point(lower + size);
+        double v = f((cell_lower + cell_upper) / 2.0);
+        if (std::abs(v) > options.culling_factor * glm::length(cell_upper - cell_lower) / 2.0) {
+            return -1;
+        }
+        if (sign_change) {
+            quadric q;
+            quadric q_collapse;
+            for (const auto &edge: EDGE_CORNERS) {
+                std::pair<glm::dvec3, double> neg = {index_to_grid_point(corner(lower, size, edge[0])),
+                                                     value(corner(lower, size, edge[0]))};
+                std::pair<glm::dvec3, double> pos = {index_to_grid_point(corner(lower, size, edge[1])),
+                                                     value(corner(lower, size, edge[1]))};
+                if (neg.second * pos.second > 0) {
+                    continue;
+                }
+                if (neg.second > 0) {
+                    std::swap(neg, pos);
+                }
+                auto zero_crossing = find_point_on_surface(neg, pos, f, options.root_iterations,
+                                                           options.root_tolerance);
+                glm::dvec3 normal = glm::normalize(gradient(f, zero_crossing, options.gradient_step));
+                q += quadric::probabilistic_plane_quadric(zero_crossing, normal, options.position_sigma,
+                                                          options.normal_sigma);
+                q_collapse += quadric::probabilistic_plane_quadric(zero_crossing, normal,
+                                                                   options.collapse_position_sigma,
+                                                                   options.collapse_normal_sigma);
+            }
+            glm::dvec3 vertex = q.minimizer();
+            if (accept(lower, size, q_collapse, vertex) && is_topologically_safe(value, lower, size)) {
+                node.leaf = true;
+                node.vertex = (int) vertices.size();
+                vertices.push_back(vertex);
+                nodes.push_back(node);
+                return (int) nodes.size() - 1;
+            }
+        }
+        bool empty = true;
+        for (int i = 0; i < 8; ++i) {
+            node.children[i] = self(self, corner(lower, size / 2, i), size / 2);
+            empty &= node.children[i] == -1;
+        }
+        if (empty) {
+            return -1;
+        }
+        nodes.push_back(node);
+        return (int) nodes.size() - 1;
+    };
+    return build(build, glm::ivec3(0), root_size);
+}
+
+// Contour the octree: every minimal edge with a sign change connects the vertices of the four leaves around
+// it. Leaves that are larger than their neighbours appear several times, those faces become triangles.
+inline void contour_octree(const std::vector<OctreeNode> &nodes, int root, std::vector<std::array<int, 3>> &triangles) {
+    auto is_leaf = [&](int node) { return nodes[node].leaf; };
+    auto edge_proc = [&](auto &&self, std::array<int, 4> cells, int axis) -> void {
+        if (cells[0] == -1 || cells[1] == -1 || cells[2] == -1 || cells[3] == -1) {
+            return;
+        }
+        if (is_leaf(cells[0]) && is_leaf(cells[1]) && is_leaf(cells[2]) && is_leaf(cells[3])) {
+            // the smallest cell holds the actual edge
+            int smallest = 0;
+            for (int i = 1; i < 4; ++i) {
+                if (nodes[cells[i]].size < nodes[cells[smallest]].size) {
+                    smallest = i;
+                }
+            }
+            const OctreeNode &node = nodes[cells[smallest]];
+            const int *edge = EDGE_CORNERS[EDGE_OF_CELL[axis][smallest]];
+            bool inside1 = (node.corners >> edge[0]) & 1;
+            bool inside2 = (node.corners >> edge[1]) & 1;
+            if (inside1 == inside2) {
+                return;
+            }
+            std::array<int, 4> v{};
+            for (int i = 0; i < 4; ++i) {
+                v[i] = nodes[cells[i]].vertex;
+            }
+            auto emit = [&](int a, int b, int c) {
+                if (a != b && b != c && c != a) {
+                    triangles.push_back({a, b, c});
+                }
+            };
+            if (inside1) {
+                emit(v[0], v[3], v[1]);
+                emit(v[0], v[2], v[3]);
+            } else {
+                emit(v[0], v[1], v[3]);
+                emit(v[0], v[3], v[2]);
+            }
+            return;
+        }
+        for (const auto &sub: EDGE_EDGES[axis]) {
+            std::array<int, 4> children{};
+            for (int i = 0; i < 4; ++i) {
+                children[i] = is_leaf(cells[i]) ? cells[i] : nodes[cells[i]].children[sub[i]];
+            }
+            self(self, children, sub[4]);
+        }
+    };
+    auto face_proc = [&](auto &&self, std::array<int, 2> cells, int axis) -> void {
+        if (cells[0] == -1 || cells[1] == -1 || (is_leaf(cells[0]) && is_leaf(cells[1]))) {
+            return;
+        }
+        for (const auto &sub: FACE_FACES[axis]) {
+            std::array<int, 2> children{};
+            for (int i = 0; i < 2; ++i) {
+                children[i] = is_leaf(cells[i]) ? cells[i] : nodes[cells[i]].children[sub[i]];
+            }
+            self(self, children, sub[2]);
+        }
+        constexpr int orders[2][4] = {{0, 0, 1, 1}, {0, 1, 0, 1}};
+        for (const auto &sub: FACE_EDGES[axis]) {
+            const int *order = orders[sub[0]];
+            std::array<int, 4> children{};
+            for (int i = 0; i < 4; ++i) {
+                int cell = cells[order[i]];
+                children[i] = is_leaf(cell) ? cell : nodes[cell].children[sub[1 + i]];
+            }
+            edge_proc(edge_proc, children, sub[5]);
+        }
+    };
+    auto cell_proc = [&](auto &&self, int cell) -> void {
+        if (cell == -1 || is_leaf(cell)) {
+            return;
+        }
+        const OctreeNode &node = nodes[cell];
+        for (int child: node.children) {
+            self(self, child);
+        }
+        for (const auto &face: CELL_FACES) {
+            face_proc(face_proc, {node.children[face[0]], node.children[face[1]]}, face[2]);
+        }
+        for (const auto &edge: CELL_EDGES) {
+            edge_proc(edge_proc, {node.children[edge[0]], node.children[edge[1]], node.children[edge[2]],
+                                  node.children[edge[3]]}, edge[4]);
+        }
+    };
+    cell_proc(cell_proc, root);
+}
+
+template<class Evaluator>
+void mesh_generator_adaptive(MeshingContext &context, const Evaluator &f, const MeshingOptions &options,
+                             TriMesh &mesh) {
+    MeshingScratch &scratch = context.scratch();
+    GridMapping index_to_grid_point(options);
+    // A cell is a leaf if the planes of its zero-crossings nearly meet in a point and the function vanishes at
+    // that point inside of the cell, so a bump between the edges of the cell is split further
+    double tolerance = options.collapse_tolerance;
+    auto accept = [&](glm::ivec3 lower, int size, const quadric &q, glm::dvec3 vertex) {
+        if (q(q.minimizer()) > tolerance) {
+            return false;
+        }
+        glm::dvec3 cell_lower = index_to_grid_point(lower);
+        glm::dvec3 cell_upper = index_to_grid_point(lower + size);
+        for (int axis = 0; axis < 3; ++axis) {
+            if (vertex[axis] < cell_lower[axis] || vertex[axis] > cell_upper[axis]) {
+                return false;
+            }
+        }
+        return std::abs(f(vertex)) <= std::sqrt(tolerance);
+    };
+    int root = build_octree(f, index_to_grid_point, options, accept, scratch.grid, scratch.octree, mesh.vertices);
+    mesh.triangles.clear();
+    if (root != -1) {
+        contour_octree(scratch.octree, root, mesh.triangles);
+    }
+}
+
+template<class Evaluator>
+void mesh_generator_view(MeshingContext &context, const Evaluator &f, const MeshingOptions &options,
+                         const ViewOptions &view, TriMesh &mesh) {
+    MeshingScratch &scratch = context.scratch();
+    bool has_roi = view.roi_lower.x <= view.roi_upper.x && view.roi_lower.y <= view.roi_upper.y &&
+                   view.roi_lower.z <= view.roi_upper.z;
+    // the octree goes down to the finer grid of the region of interest, a voxel of options has the size base_size
+    int base_size = has_roi ? 1 << std::max(view.roi_levels, 0) : 1;
+    MeshingOptions fine_options = options;
+    fine_options.resolution = (options.resolution - 1) * base_size + 1;
+    GridMapping index_to_grid_point(fine_options);
+
+    // the cone around the view direction that contains the frustum
+    double tan_half_fov = std::tan(glm::radians(view.fov) / 2.0);
+    double aspect = (double) view.viewport.x / std::max(view.viewport.y, 1);
+    double half_angle = std::atan(tan_half_fov * std::sqrt(1.0 + aspect * aspect));
+    // Cells overlapping the region of interest are split down to the finest level, all others stop at the grid of
+    // options or once they are hidden or small enough on screen
+    auto accept = [&](glm::ivec3 lower, int size, const quadric &, glm::dvec3) {
+        glm::dvec3 cell_lower = index_to_grid_point(lower);
+        glm::dvec3 cell_upper = index_to_grid_point(lower + size);
+        bool in_roi = has_roi;
+        for (int axis = 0; axis < 3; ++axis) {
+            in_roi &= cell_lower[axis] <= view.roi_upper[axis] && view.roi_lower[axis] <= cell_upper[axis];
+        }
+        if (in_roi) {
+            return false;
+        }
+        if (size <= base_size) {
+            return true;
+        }
+        glm::dvec3 offset = (cell_lower + cell_upper) / 2.0 - view.camera;
+        double radius = glm::length(cell_upper - cell_lower) / 2.0;
+        double distance = glm::length(offset);
+        if (distance <= radius) {
+            return false;
+        }
+        // cells outside of the frustum aren't visible at all
+        double angle = std::acos(std::clamp(glm::dot(offset, view.look) / distance, -1.0, 1.0));
+        if (angle - std::asin(radius / distance) > half_angle) {
+            return true;
+        }
+        double depth = std::max(glm::dot(offset, view.look), distance * std::cos(half_angle));
+        return 2.0 * radius / (2.0 * depth * tan_half_fov) * view.viewport.y <= view.pixels_per_cell;
+    };
+    int root = build_octree(f, index_to_grid_point, fine_options, accept, scratch.grid, scratch.octree,
+                            mesh.vertices);
+    mesh.triangles.clear();
+    if (root != -1) {
+        contour_octree(scratch.octree, root, mesh.triangles);
+    }
+}
+
+// Edge length of the square tiles that are used to skip empty space in the streaming mesher
+constexpr int SLICE_TILE_SIZE = 8;
+
+// One z-slice of samples used by the streaming mesher. Samples are only stored in tiles that are
+// close to the surface, all other tiles store a single value with the sign of the whole tile.
+struct SampleSlice {
+    // number of samples and tiles along x and y
+    glm::ivec2 n;
+    glm::ivec2 tiles;
+    std::vector<double> values;
+    std::vector<double> tile_values;
+    std::vector<char> tile_active;
+
+    explicit SampleSlice(glm::ivec2 n) : n(n), tiles((n + SLICE_TILE_SIZE - 1) / SLICE_TILE_SIZE) {
+        values.resize((size_t) n.x * n.y);
+        tile_values.resize((size_t) tiles.x * tiles.y);
+        tile_active.resize((size_t) tiles.x * tiles.y);
+    }
+
+    double operator()(int i, int j) const {
+        size_t tile = (size_t) (i / SLICE_TILE_SIZE) * tiles.y + j / SLICE_TILE_SIZE;
+        return tile_active[tile] ? values[(size_t) i * n.y + j] : tile_values[tile];
+    }
+
+    // true if the tile containing (i, j) or one of the tiles at (+1, 0), (0, +1), (+1, +1) is sampled
+    bool near_active(int ti, int tj) const {
+        for (int a = ti; a <= std::min(ti + 1, tiles.x - 1); ++a) {
+            for (int b = tj; b <= std::min(tj + 1, tiles.y - 1); ++b) {
+                if (tile_active[(size_t) a * tiles.y + b]) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+};
+
+// Sample the slice z = k. Like sample_grid, tiles are subdivided recursively as long as the function
+// value at their center does not prove that they are free of zero-crossings.
+template<class Evaluator>
+void sample_slice(const Evaluator &f, const GridMapping &index_to_grid_point, double culling_factor, int k,
+                  SampleSlice &slice) {
+    glm::ivec2 n = slice.n;
+    std::fill(slice.tile_active.begin(), slice.tile_active.end(), 0);
+    // 2D cells given by their inclusive lower and exclusive upper tile index
+    std::vector<std::pair<glm::ivec2, glm::ivec2>> cells;
+    cells.push_back({{0, 0}, slice.tiles});
+    while (!cells.empty()) {
+        auto [lower, upper] = cells.back();
+        cells.pop_back();
+        glm::ivec3 index_lower{lower.x * SLICE_TILE_SIZE, lower.y * SLICE_TILE_SIZE, k};
+        glm::ivec3 index_upper{std::min(upper.x * SLICE_TILE_SIZE, n.x), std::min(upper.y * SLICE_TILE_SIZE, n.y), k};
+        // sample single tiles exactly
+        if (upper.x - lower.x == 1 && upper.y - lower.y == 1) {
+            for (int i = index_lower.x; i < index_upper.x; ++i) {
+                for (int j = index_lower.y; j < index_upper.y; ++j) {
+                    slice.values[(size_t) i * n.y + j] = f(index_to_grid_point(glm::ivec3{i, j, k}));
+                }
+            }
+            slice.tile_active[(size_t) lower.x * slice.tiles.y + lower.y] = 1;
+            continue;
+        }
+        // if the cell does not contain a zero-crossing, store the center value for all of its tiles
+        glm::dvec3 cell_lower = index_to_grid_point(index_lower);
+        glm::dvec3 cell_upper = index_to_grid_point(index_upper);
+        double v = f((cell_upper + cell_lower) / 2.0);
+        if (abs(v) > culling_factor * glm::length(cell_upper - cell_lower) / 2.0) {
+            for (int a = lower.x; a < upper.x; ++a) {
+                for (int b = lower.y; b < upper.y; ++b) {
+                    slice.tile_values[(size_t) a * slice.tiles.y + b] = v;
+                }
+            }
+            continue;
+        }
+        glm::ivec2 mid = (lower + upper) / 2;
+        for (int x = 0; x < 2; ++x) {
+            for (int y = 0; y < 2; ++y) {
+                glm::ivec2 child_lower{x == 0 ? lower.x : mid.x, y == 0 ? lower.y : mid.y};
+                glm::ivec2 child_upper{x == 0 ? mid.x : upper.x, y == 0 ? mid.y : upper.y};
+                if (child_lower.x < child_upper.x && child_lower.y < child_upper.y) {
+                    cells.push_back({child_lower, child_upper});
+                }
+            }
+        }
+    }
+}
+
+template<class Evaluator>
+StreamingStats mesh_generator_streaming(const Evaluator &f, const MeshingOptions &options, const std::string &path,
+                                        const std::function<void(int, int)> &progress) {
+    GridMapping index_to_grid_point(options);
+    MeshingMode mode = options.mode;
+    glm::ivec3 n = options.resolution;
+
+    // the buffer has to outlive the file, which is flushed into it when it is closed
+    std::vector<char> file_buffer(1 << 24);
+    std::unique_ptr<FILE, int (*)(FILE *)> file(fopen(path.c_str(), "w"), &fclose);
+    if (!file) {
+        throw std::runtime_error("Could not open " + path);
+    }
+    setvbuf(file.get(), file_buffer.data(), _IOFBF, file_buffer.size());
+
+    // samples of the two slices bounding the current voxel layer
+    SampleSlice slice_lower(glm::ivec2(n.x, n.y));
+    SampleSlice slice_upper(glm::ivec2(n.x, n.y));
+    // global vertex indices of the previous and the current voxel layer, -1 if a voxel has no vertex
+    std::vector<int64_t> vertices_previous((size_t) n.x * n.y, -1);
+    std::vector<int64_t> vertices_current((size_t) n.x * n.y, -1);
+    // voxel tiles that were processed in the previous and the current layer
+    std::vector<glm::ivec2> tiles_previous;
+    std::vector<glm::ivec2> tiles_current;
+    StreamingStats stats;
+
+    auto reset_vertices = [&](std::vector<int64_t> &vertices, const std::vector<glm::ivec2> &tiles) {
+        for (auto tile: tiles) {
+            for (int i = tile.x * SLICE_TILE_SIZE; i < std::min((tile.x + 1) * SLICE_TILE_SIZE, n.x); ++i) {
+                std::fill_n(vertices.begin() + (size_t) i * n.y + tile.y * SLICE_TILE_SIZE,
+                            std::min(SLICE_TILE_SIZE, n.y - tile.y * SLICE_TILE_SIZE), -1);
+            }
+        }
+    };
+
+    auto write_face = [&](bool reverse, int64_t a, int64_t b, int64_t c, int64_t d) {
+        // faces at the border of the domain can reference voxels without a vertex
+        if (a == -1 || b == -1 || c == -1 || d == -1) {
+            return;
+        }
+        if (reverse) {
+            std::swap(a, d);
+            std::swap(b, c);
+        }
+        fprintf(file.get(), "f %lld %lld %lld %lld\n", (long long) a + 1, (long long) b + 1, (long long) c + 1,
+                (long long) d + 1);
+        stats.num_quads++;
+    };
+
+    // Like in mesh_generator, the grid points on the upper border of the domain are voxels as well. They only
+    // use the edges inside of the domain, so the last layer k = n.z - 1 has no upper slice.
+    auto inside = [&](glm::ivec3 index) { return index.x < n.x && index.y < n.y && index.z < n.z; };
+    sample_slice(f, index_to_grid_point, options.culling_factor, 0, slice_lower);
+    for (int k = 0; k < n.z; ++k) {
+        if (progress) {
+            progress(k, n.z);
+        }
+        bool last = k + 1 == n.z;
+        if (!last) {
+            sample_slice(f, index_to_grid_point, options.culling_factor, k + 1, slice_upper);
+        }
+        auto value = [&](glm::ivec3 index) {
+            return index.z == k ? slice_lower(index.x, index.y) : slice_upper(index.x, index.y);
+        };
+
+        // generate the vertices of voxel layer k, only tiles close to sampled tiles can contain zero-crossings
+        std::swap(vertices_previous, vertices_current);
+        std::swap(tiles_previous, tiles_current);
+        reset_vertices(vertices_current, tiles_current);
+        tiles_current.clear();
+        for (int ti = 0; ti < slice_lower.tiles.x; ++ti) {
+            for (int tj = 0; tj < slice_lower.tiles.y; ++tj) {
+                if (!slice_lower.near_active(ti, tj) && (last || !slice_upper.near_active(ti, tj))) {
+                    continue;
+                }
+                tiles_current.push_back({ti, tj});
+                for (int i = ti * SLICE_TILE_SIZE; i < std::min((ti + 1) * SLICE_TILE_SIZE, n.x); ++i) {
+                    for (int j = tj * SLICE_TILE_SIZE; j < std::min((tj + 1) * SLICE_TILE_SIZE, n.y); ++j) {
+                        glm::ivec3 index{i, j, k};
+                        quadric q;
+                        glm::dvec3 centroid{0};
+                        int counter = 0;
+                        for (auto e: all_edges) {
+                            if (!inside(index + e.second)) {
+                                continue;
+                            }
+                            double v1 = value(index + e.first);
+                            double v2 = value(index + e.second);
+                            if (v1 * v2 > 0) {
+                                continue;
+                            }
+                            std::pair p1v1 = {index_to_grid_point(index + e.first), v1};
+                            std::pair p2v2 = {index_to_grid_point(index + e.second), v2};
+                            if (v1 > 0) {
+                                std::swap(p1v1, p2v2);
+                            }
+                            counter++;
+                            if (mode == MeshingMode::SurfaceNets) {
+                                centroid += interpolate(p1v1, p2v2);
+                                continue;
+                            }
+                            auto zero_crossing = find_point_on_surface(p1v1, p2v2, f, options.root_iterations,
+                                                                       options.root_tolerance);
+                            glm::dvec3 normal = glm::normalize(gradient(f, zero_crossing, options.gradient_step));
+                            q += quadric::probabilistic_plane_quadric(zero_crossing, normal, options.position_sigma,
+                                                                      options.normal_sigma);
+                        }
+                        if (counter == 0) {
+                            continue;
+                        }
+                        glm::dvec3 p = mode == MeshingMode::SurfaceNets ? centroid / (double) counter : q.minimizer();
+                        fprintf(file.get(), "v %.9g %.9g %.9g\n", p.x, p.y, p.z);
+                        vertices_current[(size_t) i * n.y + j] = stats.num_vertices++;
+                    }
+                }
+            }
+        }
+
+        auto current = [&](int i, int j) { return vertices_current[(size_t) i * n.y + j]; };
+        auto previous = [&](int i, int j) { return vertices_previous[(size_t) i * n.y + j]; };
+
+        // faces around z-edges only connect voxels of the current layer, the last layer has no z-edges
+        if (!last) {
+            for (auto tile: tiles_current) {
+                for (int i = tile.x * SLICE_TILE_SIZE; i < std::min((tile.x + 1) * SLICE_TILE_SIZE, n.x - 1); ++i) {
+                    for (int j = tile.y * SLICE_TILE_SIZE; j < std::min((tile.y + 1) * SLICE_TILE_SIZE, n.y - 1); ++j) {
+                        if (current(i, j) == -1) {
+                            continue;
+                        }
+                        double v1 = slice_lower(i + 1, j + 1);
+                        double v2 = slice_upper(i + 1, j + 1);
+                        if (v1 * v2 <= 0) {
+                            write_face(v1 < 0, current(i, j), current(i, j + 1), current(i + 1, j + 1),
+                                       current(i + 1, j));
+                        }
+                    }
+                }
+            }
+        }
+
+        // faces around x- and y-edges in slice k connect the voxels of the previous and the current layer
+        if (k == 0) {
+            std::swap(slice_lower, slice_upper);
+            continue;
+        }
+        for (auto tile: tiles_previous) {
+            for (int i = tile.x * SLICE_TILE_SIZE; i < std::min((tile.x + 1) * SLICE_TILE_SIZE, n.x - 1); ++i) {
+                for (int j = tile.y * SLICE_TILE_SIZE; j < std::min((tile.y + 1) * SLICE_TILE_SIZE, n.y - 1); ++j) {
+                    if (previous(i, j) == -1) {
+                        continue;
+                    }
+                    double v1 = slice_lower(i, j + 1);
+                    double v2 = slice_lower(i + 1, j + 1);
+                    if (v1 * v2 <= 0) {
+                        write_face(v1 < 0, previous(i, j), current(i, j), current(i, j + 1), previous(i, j + 1));
+                    }
+                    v1 = slice_lower(i + 1, j);
+                    v2 = slice_lower(i + 1, j + 1);
+                    if (v1 * v2 <= 0) {
+                        write_face(v1 < 0, previous(i, j), previous(i + 1, j), current(i + 1, j), current(i, j));
+                    }
+                }
+            }
+        }
+        std::swap(slice_lower, slice_upper);
+    }
+    if (fflush(file.get()) != 0) {
+        throw std::runtime_error("Could not write " + path);
+    }
+    if (progress) {
+        progress(n.z, n.z);
+    }
+    return stats;
+}
+
+// Instantiated in implicit_meshing.cpp, such that other translation units don't compile them again
+extern template void mesh_generator(MeshingContext &, const std::function<double(glm::dvec3)> &,
+                                    const MeshingOptions &, QuadMesh &);
+
+extern template void mesh_generator(MeshingContext &, const KernelEvaluator &, const MeshingOptions &, QuadMesh &);
+
+extern template void sample_hermite(MeshingContext &, const std::function<double(glm::dvec3)> &,
+                                    const MeshingOptions &, HermiteData &);
+
+extern template void sample_hermite(MeshingContext &, const KernelEvaluator &, const MeshingOptions &,
+                                    HermiteData &);
+
+extern template void mesh_tile(MeshingContext &, const std::function<double(glm::dvec3)> &, const MeshingOptions &,
+                               glm::ivec3, glm::ivec3, MeshTile &);
+
+extern template void mesh_tile(MeshingContext &, const KernelEvaluator &, const MeshingOptions &, glm::ivec3,
+                               glm::ivec3, MeshTile &);
+
+extern template void mesh_generator_adaptive(MeshingContext &, const std::function<double(glm::dvec3)> &,
+                                             const MeshingOptions &, TriMesh &);
+
+extern template void mesh_generator_adaptive(MeshingContext &, const KernelEvaluator &, const MeshingOptions &,
+                                             TriMesh &);
+
+extern template void mesh_generator_view(MeshingContext &, const std::function<double(glm::dvec3)> &,
+                                         const MeshingOptions &, const ViewOptions &, TriMesh &);
+
+extern template void mesh_generator_view(MeshingContext &, const KernelEvaluator &, const MeshingOptions &,
+                                         const ViewOptions &, TriMesh &);
+
+extern template StreamingStats mesh_generator_streaming(const std::function<double(glm::dvec3)> &,
+                                                        const MeshingOptions &, const std::string &,
+                                                        const std::function<void(int, int)> &);
+
+extern template StreamingStats mesh_generator_streaming(const KernelEvaluator &, const MeshingOptions &,
+                                                        const std::string &, const std::function<void(int, int)> &);
@@ -1,6 +1,14 @@
 #include <iostream>
 #include <chrono>
 #include <memory>
+#include <algorithm>
+#include <filesystem>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <limits>
+#include <cmath>
+#include <unistd.h>
 
 #include <polyscope/point_cloud.h>
 #include <polyscope/surface_mesh.h>
@@ -8,11 +16,113 @@
 
 #include "third_party/imnodes.h"
 #include "implicit_meshing.h"
+#include "mesh_decimation.h"
+#include "mesh_export.h"
+#include "animation.h"
+#include "preview.h"
+#include "tiled_meshing.h"
 #include "editor.h"
 #include "node.h"
 
 namespace ps = polyscope;
 
+// Absolute path of this executable, it is started again as worker process for tiled exports
+static std::string executable_path;
+
+// Connectivity of the mesh currently registered with polyscope
+static std::vector<int> shown_faces;
+static size_t shown_face_size = 0;
+
+// Registering a surface mesh re-creates the structure and re-uploads all buffers. If the connectivity
+// didn't change, e.g. for an animated graph, only the vertex positions are updated.
+template<size_t N>
+void show_mesh(const std::vector<glm::dvec3> &vertices, const std::vector<std::array<int, N>> &faces) {
+    const int *indices = reinterpret_cast<const int *>(faces.data());
+    bool same_connectivity = ps::hasSurfaceMesh("my mesh") && shown_face_size == N &&
+                             shown_faces.size() == faces.size() * N &&
+                             ps::getSurfaceMesh("my mesh")->nVertices() == vertices.size() &&
+                             std::equal(shown_faces.begin(), shown_faces.end(), indices);
+    if (same_connectivity) {
+        ps::getSurfaceMesh("my mesh")->updateVertexPositions(vertices);
+        return;
+    }
+    ps::registerSurfaceMesh("my mesh", vertices, faces);
+    // assign keeps the old allocation as long as the new connectivity fits
+    shown_faces.assign(indices, indices + faces.size() * N);
+    shown_face_size = N;
+}
+
+// Number of meshes of extra surface outputs registered with polyscope
+static int shown_surfaces = 0;
+
+// Show the surfaces of the extra outputs next to the main mesh and the field outputs as vertex quantities. The
+// first surface is the main mesh, which has been shown already.
+void show_outputs(const std::vector<SurfaceMesh> &surfaces, const std::vector<std::string> &field_names) {
+    for (size_t s = 0; s < surfaces.size(); ++s) {
+        ps::SurfaceMesh *shown = ps::getSurfaceMesh("my mesh");
+        if (s > 0) {
+            shown = ps::registerSurfaceMesh("my mesh " + std::to_string(s), surfaces[s].mesh.vertices,
+                                            surfaces[s].mesh.quads);
+        }
+        for (size_t i = 0; i < surfaces[s].fields.size(); ++i) {
+            shown->addVertexScalarQuantity(field_names[i], surfaces[s].fields[i]);
+        }
+    }
+    for (int s = (int) surfaces.size(); s < shown_surfaces; ++s) {
+        ps::removeSurfaceMesh("my mesh " + std::to_string(s));
+    }
+    shown_surfaces = std::max((int) surfaces.size(), 1) - 1;
+}
+
+// Export running on a worker thread, such that large exports don't block the UI. Only one export runs at a
+// time, its progress is shown next to the export buttons.
+struct BackgroundExport {
+    std::thread thread;
+    std::string name;
+    std::atomic<int64_t> done{0};
+    std::atomic<int64_t> total{1};
+    std::atomic<bool> running{false};
+
+    ~BackgroundExport() {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    // Run task on the worker thread, it reports its progress in done and total. Errors are printed. Returns false
+    // if the previous export is still running.
+    bool start(std::string task_name, std::function<void()> task) {
+        if (running) {
+            return false;
+        }
+        if (thread.joinable()) {
+            thread.join();
+        }
+        name = std::move(task_name);
+        done = 0;
+        total = 1;
+        running = true;
+        thread = std::thread([this, task = std::move(task)]() {
+            try {
+                task();
+            } catch (const std::exception &e) {
+                printf("%s failed: %s\n", name.c_str(), e.what());
+            }
+            running = false;
+        });
+        return true;
+    }
+
+    void draw_progress() const {
+        if (running) {
+            ImGui::SameLine();
+            ImGui::ProgressBar((float) done / (float) std::max<int64_t>(total, 1), ImVec2(150, 0), name.c_str());
+        }
+    }
+};
+
+static BackgroundExport background_export;
+
 // This is the function that will be called every frame
 void callback() {
 
@@ -26,34 +136,562 @@ void callback() {
     // Draw delete button
     ImGui::SameLine();
     editor.draw_delete_button();
+    // Changes of the meshing settings require a re-mesh even if the graph is unchanged
+    static bool settings_changed = false;
+    // Optionally reduce the triangle count of the final mesh
+    static bool decimate_mesh = false;
+    ImGui::SameLine();
+    if (ImGui::Checkbox("Decimate", &decimate_mesh)) {
+        settings_changed = true;
+    }
+    // Optionally mesh on an adaptive octree instead of the uniform grid
+    static bool adaptive_mesh = false;
+    ImGui::SameLine();
+    if (ImGui::Checkbox("Adaptive", &adaptive_mesh)) {
+        settings_changed = true;
+    }
+    // Accuracy of the Sin and Cos nodes, the inlined polynomials allow vectorization of the kernel
+    static int trig_accuracy = (int) TrigAccuracy::Precise;
+    const char *trig_names[] = {"libm sin/cos", "precise sin/cos", "fast sin/cos"};
+    ImGui::SameLine();
+    ImGui::PushItemWidth(120);
+    if (ImGui::Combo("##trig_accuracy", &trig_accuracy, trig_names, 3)) {
+        settings_changed = true;
+    }
+    ImGui::PopItemWidth();
+    // Sphere trace the compiled graph into an image panel instead of meshing it after every edit. A mesh is
+    // only computed for exports or once the preview is disabled again.
+    static bool preview_enabled = false;
+    ImGui::SameLine();
+    if (ImGui::Checkbox("Preview", &preview_enabled)) {
+        settings_changed = true;
+        // hide the outdated mesh while previewing
+        if (ps::hasSurfaceMesh("my mesh")) {
+            ps::getSurfaceMesh("my mesh")->setEnabled(!preview_enabled);
+        }
+    }
+    // Animations reuse the octree of the previous frame. How fast the field may change is bounded from the graph
+    // when it is compiled, graphs without a bound are traversed completely on every frame.
+    static bool temporal_meshing = false;
+    static double temporal_speed = std::numeric_limits<double>::infinity();
+    ImGui::SameLine();
+    if (ImGui::Checkbox("Temporal", &temporal_meshing)) {
+        settings_changed = true;
+    }
+    if (temporal_meshing) {
+        ImGui::SameLine();
+        if (std::isfinite(temporal_speed)) {
+            ImGui::Text("speed %.3g", temporal_speed);
+        } else {
+            ImGui::Text("speed unbounded");
+        }
+    }
+    // Sigmas of the dual contouring quadrics. Changing them only places the vertices again using the Hermite data
+    // of the last mesh.
+    static float position_sigma = 0.05f;
+    static float normal_sigma = 0.05f;
+    static bool sigmas_changed = false;
+    // A sigma of zero makes the quadrics of flat regions singular, values typed in with ctrl+click aren't clamped
+    constexpr float min_sigma = 1e-4f;
+    ImGui::PushItemWidth(60);
+    if (ImGui::DragFloat("position sigma", &position_sigma, 0.001f, min_sigma, 1.0f, "%.4f")) {
+        position_sigma = std::max(position_sigma, min_sigma);
+        sigmas_changed = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::DragFloat("normal sigma", &normal_sigma, 0.001f, min_sigma, 1.0f, "%.4f")) {
+        normal_sigma = std::max(normal_sigma, min_sigma);
+        sigmas_changed = true;
+    }
+    ImGui::PopItemWidth();
+    // Spend the resolution where the camera looks, far and hidden parts of the surface are merged into larger
+    // cells. The optional zoom region is meshed at twice the resolution without merging.
+    static bool view_lod = false;
+    static bool zoom_region = false;
+    static float zoom_center[3] = {0.0f, 0.0f, 0.0f};
+    static float zoom_size = 0.5f;
+    ImGui::SameLine();
+    if (ImGui::Checkbox("View LOD", &view_lod)) {
+        settings_changed = true;
+    }
+    if (view_lod) {
+        ImGui::SameLine();
+        if (ImGui::Checkbox("Zoom region", &zoom_region)) {
+            settings_changed = true;
+        }
+    }
+    if (view_lod && zoom_region) {
+        ImGui::PushItemWidth(150);
+        if (ImGui::InputFloat3("center##zoom_center", zoom_center)) {
+            settings_changed = true;
+        }
+        ImGui::PopItemWidth();
+        ImGui::SameLine();
+        ImGui::PushItemWidth(60);
+        if (ImGui::InputFloat("size##zoom_size", &zoom_size)) {
+            zoom_size = std::max(zoom_size, 0.0f);
+            settings_changed = true;
+        }
+        ImGui::PopItemWidth();
+    }
+    auto current_view = [&]() {
+        glm::vec3 look, up, right;
+        ps::view::getCameraFrame(look, up, right);
+        ViewOptions view;
+        view.camera = glm::dvec3(ps::view::getCameraWorldPosition());
+        view.look = glm::dvec3(look);
+        view.fov = ps::view::fov;
+        view.viewport = {ps::view::bufferWidth, ps::view::bufferHeight};
+        if (zoom_region) {
+            glm::dvec3 center(zoom_center[0], zoom_center[1], zoom_center[2]);
+            view.roi_lower = center - (double) zoom_size;
+            view.roi_upper = center + (double) zoom_size;
+        }
+        return view;
+    };
+    // The view dependent mesh follows the camera once it stood still for a moment, whether it was moved with the
+    // mouse, the keyboard or a scroll
+    static ViewOptions meshed_view;
+    static ViewOptions moving_view;
+    static double camera_moved = 0.0;
+    if (view_lod && !preview_enabled) {
+        auto same_view = [](const ViewOptions &a, const ViewOptions &b) {
+            return glm::length(a.camera - b.camera) + glm::length(a.look - b.look) <= 1e-6 && a.fov == b.fov &&
+                   a.viewport == b.viewport;
+        };
+        ViewOptions view = current_view();
+        if (!same_view(view, moving_view)) {
+            moving_view = view;
+            camera_moved = ImGui::GetTime();
+        } else if (ImGui::GetTime() - camera_moved > 0.3 && !same_view(view, meshed_view)) {
+            meshed_view = view;
+            settings_changed = true;
+        }
+    }
+    auto temporal_options = [&]() -> std::optional<TemporalOptions> {
+        if (!temporal_meshing) {
+            return std::nullopt;
+        }
+        TemporalOptions temporal;
+        temporal.speed = temporal_speed;
+        return temporal;
+    };
 
     // Draw the nodes and handle links
     editor.draw();
     editor.handle_links();
 
-    // Compute the mesh if there is a link to the output node and a re-mesh is needed
-    if (!editor.m_remesh) {
+    // The last computed mesh, either a quad mesh or a triangle mesh after decimation or adaptive meshing
+    static QuadMesh mesh;
+    static TriMesh tri_mesh;
+    static bool triangulated = false;
+    // Scratch memory of the mesher, reused for every remesh
+    static MeshingContext meshing_context;
+    // Crossings and normals of the last dual contouring mesh, valid while the mesh is shown without decimation
+    static HermiteData hermite;
+    static bool hermite_valid = false;
+
+    // Graphs containing a Time node are compiled once and meshed ahead of playback on worker threads
+    static AnimationPipeline animation;
+    static AnimatedFunction animated_function;
+
+    // The last compiled graph, traced by the preview renderer
+    static Kernel kernel;
+    static bool kernel_animated = false;
+    static PreviewRenderer renderer;
+    static std::shared_ptr<ps::render::TextureBuffer> preview_texture;
+    static std::vector<glm::vec4> preview_pixels;
+    static PreviewCamera preview_camera;
+    static bool preview_outdated = false;
+    // With the preview enabled the mesh isn't updated on edits
+    static bool mesh_outdated = false;
+    static bool export_requested = false;
+
+    // Export the last mesh, the format is chosen by the file extension (.ply, .obj or .rkqm)
+    static char export_path[256] = "mesh.ply";
+    auto export_last_mesh = [&]() {
+        try {
+            triangulated ? export_mesh(tri_mesh, export_path) : export_mesh(mesh, export_path);
+        } catch (const std::exception &e) {
+            printf("Export failed: %s\n", e.what());
+        }
+    };
+    ImGui::PushItemWidth(120);
+    ImGui::InputText("##export_path", export_path, sizeof(export_path));
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::Button("Export")) {
+        if (mesh_outdated) {
+            // mesh the current graph first, the export happens once the mesh is ready
+            export_requested = true;
+            settings_changed = true;
+        } else {
+            export_last_mesh();
+        }
+    }
+    // Export an animation as one file per frame, the frames are meshed in the background in parallel on all cores
+    static float animation_length = 5.0f;
+    if (animated_function) {
+        ImGui::SameLine();
+        ImGui::PushItemWidth(60);
+        ImGui::InputFloat("s##animation_length", &animation_length);
+        ImGui::PopItemWidth();
+        ImGui::SameLine();
+        if (ImGui::Button("Export animation") && !background_export.running) {
+            std::filesystem::path path(export_path);
+            int frame_count = std::max(1, (int) (animation_length * 30.0f));
+            // the compiled function stays valid after the graph is compiled again
+            AnimatedFunction f = animated_function;
+            double length = animation_length;
+            std::optional<TemporalOptions> temporal = temporal_options();
+            background_export.start("Animation export", [path, frame_count, f, length, temporal]() {
+                background_export.total = frame_count;
+                mesh_range(f, 0.0, length, frame_count, 200, [&](int i, QuadMesh &&frame) {
+                    char suffix[32];
+                    snprintf(suffix, sizeof(suffix), "_%04d", i);
+                    std::filesystem::path frame_path =
+                            path.parent_path() / (path.stem().string() + suffix + path.extension().string());
+                    try {
+                        export_mesh(frame, frame_path.string());
+                    } catch (const std::exception &e) {
+                        printf("Export failed: %s\n", e.what());
+                    }
+                    background_export.done++;
+                }, temporal);
+            });
+        }
+    }
+
+    // Trace the preview at the polyscope camera whenever the view, the panel size or the graph changed
+    if (preview_enabled && kernel) {
+        ImGui::Begin("Preview");
+        ImVec2 size = ImGui::GetContentRegionAvail();
+        int width = std::max(1, (int) size.x);
+        int height = std::max(1, (int) size.y);
+        glm::vec3 look, up, right;
+        ps::view::getCameraFrame(look, up, right);
+        PreviewCamera camera{glm::dvec3(ps::view::getCameraWorldPosition()), glm::dvec3(look), glm::dvec3(up),
+                             glm::dvec3(right), ps::view::fov};
+        if (preview_outdated || kernel_animated || camera != preview_camera || width != renderer.width() ||
+            height != renderer.height()) {
+            renderer.render(kernel, kernel_animated ? ImGui::GetTime() : 0.0, camera, width, height);
+            // the texture is only allocated again when the panel is resized, otherwise its pixels are replaced
+            if (!preview_texture || (int) preview_texture->getSizeX() != width ||
+                (int) preview_texture->getSizeY() != height) {
+                preview_texture = ps::render::engine->generateTextureBuffer(ps::render::TextureFormat::RGBA8, width,
+                                                                            height, renderer.image().data());
+            } else {
+                const std::vector<unsigned char> &image = renderer.image();
+                preview_pixels.resize(image.size() / 4);
+                for (size_t i = 0; i < preview_pixels.size(); ++i) {
+                    const unsigned char *rgba = &image[4 * i];
+                    preview_pixels[i] = glm::vec4(rgba[0], rgba[1], rgba[2], rgba[3]) / 255.0f;
+                }
+                preview_texture->setData(preview_pixels);
+            }
+            preview_camera = camera;
+            preview_outdated = false;
+        }
+        ImGui::Image((ImTextureID) preview_texture->getNativeHandle(), ImVec2((float) width, (float) height));
+        ImGui::End();
+    }
+
+    // Mesh large exports in tiles, every tile is meshed by a separate worker process and the tiles are merged into
+    // an OBJ file in the background
+    static int tiled_resolution = 800;
+    static int tiles_per_axis = 2;
+    ImGui::PushItemWidth(80);
+    ImGui::InputInt("n##tiled_resolution", &tiled_resolution);
+    ImGui::SameLine();
+    ImGui::InputInt("tiles##tiles_per_axis", &tiles_per_axis);
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::Button("Export tiled") && editor.m_inputs[0][0].node_id != -1 && !background_export.running) {
+        try {
+            Program program = editor.generate_program();
+            MeshingOptions options;
+            options.resolution = glm::ivec3(std::max(2, tiled_resolution));
+            auto accuracy = (TrigAccuracy) trig_accuracy;
+            glm::ivec3 tile_counts(std::max(1, tiles_per_axis));
+            std::string path = std::filesystem::path(export_path).replace_extension(".obj").string();
+            background_export.start("Tiled export", [program, options, accuracy, tile_counts, path]() {
+                // every export gets its own directory for the exchanged files, it is removed afterward
+                static int export_count = 0;
+                std::filesystem::path directory = std::filesystem::temp_directory_path() /
+                        ("raumkuenstler_tiles_" + std::to_string(getpid()) + "_" + std::to_string(export_count++));
+                std::string command = "\"" + executable_path + "\" --mesh-tile \"{program}\" \"{job}\" \"{output}\"";
+                try {
+                    mesh_tiled(program, options, accuracy, 0.0, tile_counts, command,
+                               (int) std::thread::hardware_concurrency(), directory.string(), path,
+                               [](int done, int total) {
+                                   background_export.done = done;
+                                   background_export.total = total;
+                               });
+                } catch (...) {
+                    std::error_code error;
+                    std::filesystem::remove_all(directory, error);
+                    throw;
+                }
+                std::filesystem::remove_all(directory);
+            });
+        } catch (const std::exception &e) {
+            printf("Tiled export failed: %s\n", e.what());
+        }
+    }
+
+    // Stream very large meshes slice by slice into an OBJ file, only two slices of the grid are kept in memory
+    static int streaming_resolution = 4096;
+    ImGui::PushItemWidth(80);
+    ImGui::InputInt("n##streaming_resolution", &streaming_resolution);
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::Button("Export streaming") && editor.m_inputs[0][0].node_id != -1 && !background_export.running) {
+        try {
+            Program program = editor.generate_program();
+            MeshingOptions options;
+            options.resolution = glm::ivec3(std::max(2, streaming_resolution));
+            auto accuracy = (TrigAccuracy) trig_accuracy;
+            std::string path = std::filesystem::path(export_path).replace_extension(".obj").string();
+            background_export.start("Streaming export", [program, options, accuracy, path]() {
+                Kernel streaming_kernel = compile_kernel(program, accuracy);
+                mesh_generator_streaming(KernelEvaluator{streaming_kernel.eval, 0.0}, options, path,
+                                         [](int done, int total) {
+                                             background_export.done = done;
+                                             background_export.total = total;
+                                         });
+            });
+        } catch (const std::exception &e) {
+            printf("Streaming export failed: %s\n", e.what());
+        }
+    }
+    background_export.draw_progress();
+
+    // Compile the graph ahead of time into an object file or static library with a C header next to the export path.
+    // Without a cpu the code runs on any machine of this architecture, native tunes it for this one.
+    static char object_cpu[64] = "";
+    ImGui::PushItemWidth(120);
+    ImGui::InputText("cpu##object_cpu", object_cpu, sizeof(object_cpu));
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::Button("Export kernel") && editor.m_inputs[0][0].node_id != -1) {
+        try {
+            std::filesystem::path path(export_path);
+            std::string object_path = path.replace_extension(".o").string();
+            std::string header_path = path.replace_extension(".h").string();
+            ObjectOptions options;
+            options.cpu = object_cpu;
+            options.accuracy = (TrigAccuracy) trig_accuracy;
+            compile_object(editor.generate_program(), options, object_path, header_path);
+        } catch (const std::exception &e) {
+            printf("Kernel export failed: %s\n", e.what());
+        }
+    }
+
+    // Attribute the cost of a remesh to the nodes, shown as a heat overlay and written as CSV next to the export path
+    if (ImGui::Button("Profile") && editor.m_inputs[0][0].node_id != -1) {
+        try {
+            MeshingOptions options;
+            options.resolution = glm::ivec3(200);
+            editor.profile(options, (TrigAccuracy) trig_accuracy);
+        } catch (const std::exception &e) {
+            printf("Profiling failed: %s\n", e.what());
+        }
+    }
+    if (!editor.m_profile.nodes.empty()) {
+        ImGui::SameLine();
+        ImGui::Text("kernel %.0f%% of %.3f s", 100.0 * editor.m_profile.kernel_seconds /
+                                               std::max(editor.m_profile.remesh_seconds, 1e-9),
+                    editor.m_profile.remesh_seconds);
+        ImGui::SameLine();
+        if (ImGui::Button("Export profile")) {
+            try {
+                write_profile(editor.m_profile, std::filesystem::path(export_path).replace_extension(".csv").string());
+            } catch (const std::exception &e) {
+                printf("Profile export failed: %s\n", e.what());
+            }
+        }
+    }
+
+    // Show the latest animation frame that has been meshed in the background
+    if (animation.running()) {
+        if (auto frame = animation.take(ImGui::GetTime())) {
+            mesh = std::move(frame->mesh);
+            triangulated = false;
+            show_mesh(mesh.vertices, mesh.quads);
+        }
+    }
+
+    // While a value is being dragged we only compute a cheap Surface Nets preview, the full dual
+    // contouring mesh is computed once the interaction has finished
+    static bool showing_preview = false;
+    bool interacting = ImGui::IsAnyItemActive();
+    if (showing_preview && !interacting) {
+        settings_changed = true;
+    }
+
+    // Compute the mesh if there is a link to the output node and the settings or the subgraph feeding the
+    // output changed. Edits of nodes that aren't connected to the output leave the output hash unchanged.
+    bool graph_changed = editor.m_remesh && editor.output_changed();
+    editor.m_remesh = false;
+    if (sigmas_changed) {
+        sigmas_changed = false;
+        if (!graph_changed && !settings_changed && hermite_valid) {
+            // only the vertex positions change, the topology of the mesh stays the same
+            solve_hermite(hermite, position_sigma, normal_sigma, mesh);
+            show_mesh(mesh.vertices, mesh.quads);
+            return;
+        }
+        settings_changed = true;
+    }
+    if (!graph_changed && !settings_changed) {
         return;
     }
+    settings_changed = false;
+    hermite_valid = false;
     if (editor.m_inputs[0][0].node_id == -1) {
         return;
     }
     auto start = std::chrono::high_resolution_clock::now();
-    std::vector<Instruction> instructions;
-    std::map<int, double> constants;
-    int current_register = 3;
-    editor.m_nodes[0]->generate_instructions(instructions, current_register, constants);
-    std::function<double(glm::dvec3)> f = compile(instructions, constants);
-    auto mesh = mesh_generator(f, 200);
-    editor.m_remesh = false;
+    Program program;
+    try {
+        program = editor.generate_program();
+    } catch (const std::exception &e) {
+        printf("Code generation failed: %s\n", e.what());
+        return;
+    }
+    try {
+        kernel = compile_kernel(program, (TrigAccuracy) trig_accuracy);
+    } catch (const std::exception &e) {
+        printf("Compilation failed: %s\n", e.what());
+        return;
+    }
+    kernel_animated = depends_on_time(program);
+    preview_outdated = true;
+    animated_function = kernel_animated ? kernel.eval : nullptr;
+    MeshingOptions options;
+    temporal_speed = time_speed_bound(program, options.lower, options.upper);
+    options.resolution = glm::ivec3(200);
+    options.position_sigma = position_sigma;
+    options.normal_sigma = normal_sigma;
+    if (preview_enabled && !export_requested) {
+        animation.stop();
+        mesh_outdated = true;
+        return;
+    }
+    mesh_outdated = false;
+    if (kernel_animated) {
+        // animations only show the main output
+        show_outputs({}, {});
+        if (export_requested) {
+            // export the frame at time zero
+            mesh_generator(meshing_context, KernelEvaluator{kernel.eval, 0.0}, options, mesh);
+            triangulated = false;
+            export_requested = false;
+            export_last_mesh();
+        }
+        preview_enabled ? animation.stop() : animation.start(kernel.eval, ImGui::GetTime(), temporal_options());
+        return;
+    }
+    animation.stop();
+    KernelEvaluator f{kernel.eval, 0.0};
+    options.mode = interacting ? MeshingMode::SurfaceNets : MeshingMode::DualContouring;
+    triangulated = !interacting && (decimate_mesh || adaptive_mesh || view_lod);
+    // Graphs with several output nodes are meshed in one traversal, the first surface becomes the main mesh
+    static std::vector<SurfaceMesh> surface_meshes;
+    std::vector<std::string> field_names;
+    surface_meshes.clear();
+    if (kernel.num_outputs() > 1) {
+        std::vector<bool> surface;
+        for (int node_id: editor.m_output_ids) {
+            auto *output = static_cast<OutputNode *>(editor.m_nodes[node_id].get());
+            surface.push_back(node_id == 0 || output->m_surface);
+            if (!surface.back()) {
+                field_names.emplace_back(output->m_name);
+            }
+        }
+        mesh_generator_multi(meshing_context, MultiKernelEvaluator{kernel.eval_all, kernel.outputs, 0.0}, surface,
+                             options, surface_meshes);
+        std::swap(mesh, surface_meshes[0].mesh);
+        triangulated = false;
+    } else if (view_lod && !interacting) {
+        meshed_view = current_view();
+        mesh_generator_view(meshing_context, f, options, meshed_view, tri_mesh);
+    } else if (adaptive_mesh && !interacting) {
+        mesh_generator_adaptive(meshing_context, f, options, tri_mesh);
+    } else if (interacting) {
+        mesh_generator(meshing_context, f, options, mesh);
+    } else {
+        // keep the Hermite data, such that new sigmas don't require sampling the graph again
+        sample_hermite(meshing_context, f, options, hermite);
+        solve_hermite(hermite, options.position_sigma, options.normal_sigma, mesh);
+        hermite_valid = !decimate_mesh;
+    }
+    if (decimate_mesh && !interacting && surface_meshes.empty()) {
+        tri_mesh = adaptive_mesh || view_lod ? decimate(tri_mesh) : decimate(mesh);
+    }
+    showing_preview = interacting;
+    if (export_requested) {
+        export_requested = false;
+        export_last_mesh();
+    }
+    // the mesh stays hidden while previewing
+    if (preview_enabled) {
+        return;
+    }
     auto end = std::chrono::high_resolution_clock::now();
     // print time in ms
     printf("Time taken: %d ms\n", (int) std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count());
-    ps::registerSurfaceMesh("my mesh", mesh.vertices, mesh.quads);
+    if (triangulated) {
+        show_mesh(tri_mesh.vertices, tri_mesh.triangles);
+    } else {
+        show_mesh(mesh.vertices, mesh.quads);
+    }
+    show_outputs(surface_meshes, field_names);
 }
 
 
-int main() {
+int main(int argc, char **argv) {
+    // worker process of a tiled export: implicit_meshing --mesh-tile program job output
+    if (argc == 5 && std::string(argv[1]) == "--mesh-tile") {
+        try {
+            run_tile_worker(argv[2], argv[3], argv[4]);
+        } catch (const std::exception &e) {
+            fprintf(stderr, "Tile worker failed: %s\n", e.what());
+            return 1;
+        }
+        return 0;
+    }
+    // streaming export of a large grid: implicit_meshing --mesh-streaming program n output.obj
+    if (argc == 5 && std::string(argv[1]) == "--mesh-streaming") {
+        try {
+            MeshingOptions options;
+            options.resolution = glm::ivec3(std::max(2, std::stoi(argv[3])));
+            Kernel kernel = compile_kernel(read_program(argv[2]));
+            StreamingStats stats = mesh_generator_streaming(KernelEvaluator{kernel.eval, 0.0}, options, argv[4]);
+            printf("%lld vertices, %lld quads\n", (long long) stats.num_vertices, (long long) stats.num_quads);
+        } catch (const std::exception &e) {
+            fprintf(stderr, "Streaming export failed: %s\n", e.what());
+            return 1;
+        }
+        return 0;
+    }
+    // ahead-of-time compilation: implicit_meshing --compile-object program object header [cpu]
+    if ((argc == 5 || argc == 6) && std::string(argv[1]) == "--compile-object") {
+        try {
+            ObjectOptions options;
+            options.cpu = argc == 6 ? argv[5] : "";
+            compile_object(read_program(argv[2]), options, argv[3], argv[4]);
+        } catch (const std::exception &e) {
+            fprintf(stderr, "Compilation failed: %s\n", e.what());
+            return 1;
+        }
+        return 0;
+    }
+    // argv[0] is only the name if the program was started through PATH
+    std::error_code error;
+    std::filesystem::path executable = std::filesystem::read_symlink("/proc/self/exe", error);
+    executable_path = error ? std::filesystem::absolute(argv[0]).string() : executable.string();
+
     ps::options::buildGui = false;
     ps::options::groundPlaneMode = ps::GroundPlaneMode::ShadowOnly;
     ps::init();
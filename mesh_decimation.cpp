@@ -0,0 +1,347 @@
+//
+// Created by elisabeth on 03.02.24.
+//
+
+#include "mesh_decimation.h"
+#include "parallel.h"
+#include <glm/glm.hpp>
+#include <queue>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "third_party/probabilistic-quadrics.hh"
+
+using glm_trait = pq::math<double, glm::dvec3, glm::dvec3, glm::dmat3>;
+using quadric = pq::quadric<glm_trait>;
+
+TriMesh triangulate(const QuadMesh &mesh) {
+    TriMesh result;
+    result.vertices = mesh.vertices;
+    result.triangles.reserve(2 * mesh.quads.size());
+    for (const auto &q: mesh.quads) {
+        // quads at the border of the domain can reference voxels without a vertex
+        if (q[0] < 0 || q[1] < 0 || q[2] < 0 || q[3] < 0) {
+            continue;
+        }
+        // split along the shorter diagonal
+        const auto &v = mesh.vertices;
+        if (glm::length(v[q[0]] - v[q[2]]) <= glm::length(v[q[1]] - v[q[3]])) {
+            result.triangles.push_back({q[0], q[1], q[2]});
+            result.triangles.push_back({q[0], q[2], q[3]});
+        } else {
+            result.triangles.push_back({q[0], q[1], q[3]});
+            result.triangles.push_back({q[1], q[2], q[3]});
+        }
+    }
+    return result;
+}
+
+// Candidate edge collapse merging vertex b into vertex a. The entry is stale once the stamp of one of
+// the two vertices changed.
+struct Collapse {
+    double error;
+    int a;
+    int b;
+    int stamp_a;
+    int stamp_b;
+    glm::dvec3 target;
+
+    // std::priority_queue is a max heap, we want the smallest error first
+    bool operator<(const Collapse &other) const { return error > other.error; }
+};
+
+// Performs one decimation pass over a triangle mesh. Every partition only touches its own unlocked
+// vertices and the faces around them, so the partitions can be processed in parallel without locks.
+class Decimator {
+public:
+    Decimator(TriMesh &mesh, std::vector<quadric> &quadrics, const DecimationOptions &options)
+        : m_mesh(mesh), m_quadrics(quadrics), m_options(options) {
+        size_t num_vertices = m_mesh.vertices.size();
+        m_vertex_faces.resize(num_vertices);
+        m_stamp.assign(num_vertices, 0);
+        m_vertex_removed.assign(num_vertices, 0);
+        m_face_removed.assign(m_mesh.triangles.size(), 0);
+        for (int f = 0; f < (int) m_mesh.triangles.size(); ++f) {
+            for (int v: m_mesh.triangles[f]) {
+                m_vertex_faces[v].push_back(f);
+            }
+        }
+    }
+
+    void run(int partitions, double offset) {
+        std::vector<std::vector<int>> blocks = assign_blocks(partitions, offset);
+        parallel_for((int) blocks.size(), [&](int i) {
+            collapse_block(blocks[i]);
+        });
+    }
+
+    // Remove collapsed vertices and faces, the quadrics are remapped accordingly
+    TriMesh compact() const {
+        TriMesh result;
+        std::vector<int> new_index(m_mesh.vertices.size(), -1);
+        std::vector<quadric> quadrics;
+        for (int f = 0; f < (int) m_mesh.triangles.size(); ++f) {
+            if (m_face_removed[f]) {
+                continue;
+            }
+            std::array<int, 3> triangle{};
+            for (int i = 0; i < 3; ++i) {
+                int v = m_mesh.triangles[f][i];
+                if (new_index[v] == -1) {
+                    new_index[v] = (int) result.vertices.size();
+                    result.vertices.push_back(m_mesh.vertices[v]);
+                    quadrics.push_back(m_quadrics[v]);
+                }
+                triangle[i] = new_index[v];
+            }
+            result.triangles.push_back(triangle);
+        }
+        m_quadrics = std::move(quadrics);
+        return result;
+    }
+
+private:
+    TriMesh &m_mesh;
+    std::vector<quadric> &m_quadrics;
+    const DecimationOptions &m_options;
+
+    std::vector<std::vector<int>> m_vertex_faces;
+    std::vector<int> m_stamp;
+    std::vector<char> m_vertex_removed;
+    std::vector<char> m_face_removed;
+    std::vector<int> m_block;
+    std::vector<char> m_locked;
+
+    // Sort the vertices into the spatial partitions and lock every vertex that is adjacent to another
+    // partition or lies on the boundary of the mesh
+    std::vector<std::vector<int>> assign_blocks(int partitions, double offset) {
+        glm::dvec3 lower{std::numeric_limits<double>::max()};
+        glm::dvec3 upper{std::numeric_limits<double>::lowest()};
+        for (const auto &p: m_mesh.vertices) {
+            lower = glm::min(lower, p);
+            upper = glm::max(upper, p);
+        }
+        glm::dvec3 extent = glm::max(upper - lower, glm::dvec3(1e-12));
+
+        int blocks_per_axis = partitions + (offset > 0 ? 1 : 0);
+        m_block.resize(m_mesh.vertices.size());
+        for (int v = 0; v < (int) m_mesh.vertices.size(); ++v) {
+            glm::dvec3 t = (m_mesh.vertices[v] - lower) / extent * (double) partitions + offset;
+            glm::ivec3 cell = glm::clamp(glm::ivec3(glm::floor(t)), glm::ivec3(0), glm::ivec3(blocks_per_axis - 1));
+            m_block[v] = (cell.x * blocks_per_axis + cell.y) * blocks_per_axis + cell.z;
+        }
+
+        m_locked.assign(m_mesh.vertices.size(), 0);
+        std::vector<int> neighbors;
+        for (int v = 0; v < (int) m_mesh.vertices.size(); ++v) {
+            collect_neighbors(v, neighbors);
+            // for a closed fan the number of neighbors equals the number of faces
+            if (neighbors.size() != m_vertex_faces[v].size()) {
+                m_locked[v] = 1;
+            }
+            for (int n: neighbors) {
+                if (m_block[n] != m_block[v]) {
+                    m_locked[v] = 1;
+                }
+            }
+        }
+
+        std::vector<std::vector<int>> blocks(blocks_per_axis * blocks_per_axis * blocks_per_axis);
+        for (int v = 0; v < (int) m_mesh.vertices.size(); ++v) {
+            if (!m_locked[v]) {
+                blocks[m_block[v]].push_back(v);
+            }
+        }
+        return blocks;
+    }
+
+    void collect_neighbors(int v, std::vector<int> &neighbors) const {
+        neighbors.clear();
+        for (int f: m_vertex_faces[v]) {
+            if (m_face_removed[f]) {
+                continue;
+            }
+            for (int n: m_mesh.triangles[f]) {
+                if (n != v && std::find(neighbors.begin(), neighbors.end(), n) == neighbors.end()) {
+                    neighbors.push_back(n);
+                }
+            }
+        }
+    }
+
+    bool can_collapse(int a, int b) const {
+        return a != b && !m_locked[a] && !m_locked[b] && m_block[a] == m_block[b];
+    }
+
+    // Compute the optimal position and error of merging b into a
+    Collapse evaluate(int a, int b) const {
+        quadric q = m_quadrics[a] + m_quadrics[b];
+        glm::dvec3 pa = m_mesh.vertices[a];
+        glm::dvec3 pb = m_mesh.vertices[b];
+        Collapse best{q(pa), a, b, m_stamp[a], m_stamp[b], pa};
+        glm::dvec3 minimizer = q.minimizer();
+        for (glm::dvec3 candidate: {minimizer, pb, (pa + pb) / 2.0}) {
+            if (!std::isfinite(candidate.x) || !std::isfinite(candidate.y) || !std::isfinite(candidate.z)) {
+                continue;
+            }
+            double error = q(candidate);
+            if (error < best.error) {
+                best.error = error;
+                best.target = candidate;
+            }
+        }
+        best.error = std::max(best.error, 0.0);
+        return best;
+    }
+
+    // Check the link condition and make sure that no triangle flips or degenerates
+    bool is_valid(const Collapse &c, std::vector<int> &na, std::vector<int> &nb) const {
+        collect_neighbors(c.a, na);
+        collect_neighbors(c.b, nb);
+        int shared = 0;
+        for (int n: na) {
+            if (std::find(nb.begin(), nb.end(), n) != nb.end()) {
+                shared++;
+            }
+        }
+        if (shared != 2) {
+            return false;
+        }
+        for (int v: {c.a, c.b}) {
+            for (int f: m_vertex_faces[v]) {
+                if (m_face_removed[f]) {
+                    continue;
+                }
+                const auto &t = m_mesh.triangles[f];
+                bool has_a = t[0] == c.a || t[1] == c.a || t[2] == c.a;
+                bool has_b = t[0] == c.b || t[1] == c.b || t[2] == c.b;
+                if (has_a && has_b) {
+                    continue;
+                }
+                glm::dvec3 p[3];
+                glm::dvec3 q[3];
+                for (int i = 0; i < 3; ++i) {
+                    p[i] = m_mesh.vertices[t[i]];
+                    q[i] = (t[i] == c.a || t[i] == c.b) ? c.target : p[i];
+                }
+                glm::dvec3 n_old = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::dvec3 n_new = glm::cross(q[1] - q[0], q[2] - q[0]);
+                double l_old = glm::length(n_old);
+                double l_new = glm::length(n_new);
+                if (l_new < 1e-14 * std::max(1.0, l_old)) {
+                    return false;
+                }
+                if (l_old > 0 && glm::dot(n_old, n_new) / (l_old * l_new) < m_options.min_normal_dot) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void apply(const Collapse &c) {
+        int a = c.a;
+        int b = c.b;
+        m_mesh.vertices[a] = c.target;
+        m_quadrics[a] += m_quadrics[b];
+        for (int f: m_vertex_faces[b]) {
+            if (m_face_removed[f]) {
+                continue;
+            }
+            auto &t = m_mesh.triangles[f];
+            if (t[0] == a || t[1] == a || t[2] == a) {
+                // the two faces adjacent to the edge (a, b) vanish
+                m_face_removed[f] = 1;
+                continue;
+            }
+            for (int &v: t) {
+                if (v == b) {
+                    v = a;
+                }
+            }
+            m_vertex_faces[a].push_back(f);
+        }
+        m_vertex_faces[b].clear();
+        m_vertex_removed[b] = 1;
+        m_stamp[a]++;
+        m_stamp[b]++;
+        auto &faces = m_vertex_faces[a];
+        faces.erase(std::remove_if(faces.begin(), faces.end(), [&](int f) { return m_face_removed[f] != 0; }), faces.end());
+    }
+
+    void collapse_block(const std::vector<int> &block_vertices) {
+        std::priority_queue<Collapse> queue;
+        std::vector<int> neighbors;
+        std::vector<int> na;
+        std::vector<int> nb;
+        for (int a: block_vertices) {
+            collect_neighbors(a, neighbors);
+            for (int b: neighbors) {
+                if (b > a && can_collapse(a, b)) {
+                    Collapse c = evaluate(a, b);
+                    if (c.error <= m_options.max_error) {
+                        queue.push(c);
+                    }
+                }
+            }
+        }
+        while (!queue.empty()) {
+            Collapse c = queue.top();
+            queue.pop();
+            if (m_vertex_removed[c.a] || m_vertex_removed[c.b] ||
+                c.stamp_a != m_stamp[c.a] || c.stamp_b != m_stamp[c.b]) {
+                continue;
+            }
+            if (!is_valid(c, na, nb)) {
+                continue;
+            }
+            apply(c);
+            collect_neighbors(c.a, neighbors);
+            for (int n: neighbors) {
+                if (can_collapse(c.a, n)) {
+                    Collapse next = evaluate(c.a, n);
+                    if (next.error <= m_options.max_error) {
+                        queue.push(next);
+                    }
+                }
+            }
+        }
+    }
+};
+
+TriMesh decimate(const TriMesh &mesh, const DecimationOptions &options) {
+    TriMesh result = mesh;
+    // every vertex starts with the probabilistic plane quadrics of its incident triangles
+    std::vector<quadric> quadrics(result.vertices.size());
+    for (const auto &t: result.triangles) {
+        glm::dvec3 n = glm::cross(result.vertices[t[1]] - result.vertices[t[0]], result.vertices[t[2]] - result.vertices[t[0]]);
+        double length = glm::length(n);
+        if (length == 0) {
+            continue;
+        }
+        n /= length;
+        for (int v: t) {
+            quadrics[v] += quadric::probabilistic_plane_quadric(result.vertices[v], n, options.sigma_position,
+                                                                options.sigma_normal);
+        }
+    }
+    // every level runs a second pass with partitions shifted by half a block so that the locked seams of
+    // the first pass can be decimated as well. Coarser levels handle the seams of the large triangles
+    // created by the finer ones, the last level runs on a single partition.
+    for (int partitions = std::max(1, options.partitions); partitions >= 1; partitions /= 2) {
+        for (double offset: {0.0, 0.5}) {
+            if (partitions == 1 && offset > 0) {
+                continue;
+            }
+            Decimator decimator(result, quadrics, options);
+            decimator.run(partitions, offset);
+            result = decimator.compact();
+        }
+    }
+    return result;
+}
+
+TriMesh decimate(const QuadMesh &mesh, const DecimationOptions &options) {
+    return decimate(triangulate(mesh), options);
+}
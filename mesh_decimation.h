@@ -0,0 +1,29 @@
+//
+// Created by elisabeth on 03.02.24.
+//
+
+#pragma once
+
+#include "implicit_meshing.h"
+
+struct DecimationOptions {
+    // Maximum quadric error (roughly the squared distance to the original surface) a collapse may introduce
+    double max_error = 1e-5;
+    // The bounding box of the mesh is split into partitions^3 blocks which are decimated in parallel
+    int partitions = 4;
+    // Standard deviations of the probabilistic plane quadrics placed at every input triangle
+    double sigma_position = 0.0;
+    double sigma_normal = 0.001;
+    // Collapses are rejected if a triangle normal rotates by more than arccos(min_normal_dot)
+    double min_normal_dot = 0.2;
+};
+
+// Split every quad into two triangles
+TriMesh triangulate(const QuadMesh &mesh);
+
+// Reduce the number of triangles by quadric error edge collapses as long as the error stays below
+// options.max_error. Vertices on the seams between two partitions are kept fixed, they are handled by
+// additional passes with shifted and successively coarser partitions.
+TriMesh decimate(const TriMesh &mesh, const DecimationOptions &options = {});
+
+TriMesh decimate(const QuadMesh &mesh, const DecimationOptions &options = {});
@@ -0,0 +1,394 @@
+//
+// Created by elisabeth on 10.02.24.
+//
+
+#include "mesh_export.h"
+#include "parallel.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+
+// Number of vertices or faces that are encoded by one task
+constexpr size_t EXPORT_CHUNK_SIZE = 1 << 16;
+
+constexpr char QUANTIZED_MAGIC[4] = {'R', 'K', 'Q', 'M'};
+constexpr uint32_t QUANTIZED_VERSION = 1;
+
+// Buffered output file, all writes go through a large buffer
+class OutputFile {
+public:
+    explicit OutputFile(const std::string &path) : m_path(path), m_file(fopen(path.c_str(), "wb")) {
+        if (!m_file) {
+            throw std::runtime_error("Could not open " + path);
+        }
+        m_buffer.resize(1 << 24);
+        setvbuf(m_file, m_buffer.data(), _IOFBF, m_buffer.size());
+    }
+
+    ~OutputFile() {
+        if (m_file) {
+            fclose(m_file);
+        }
+    }
+
+    void write(const void *data, size_t size) {
+        if (fwrite(data, 1, size, m_file) != size) {
+            throw std::runtime_error("Could not write " + m_path);
+        }
+    }
+
+    void write(const std::string &data) { write(data.data(), data.size()); }
+
+    void close() {
+        int result = fclose(m_file);
+        m_file = nullptr;
+        if (result != 0) {
+            throw std::runtime_error("Could not write " + m_path);
+        }
+    }
+
+private:
+    std::string m_path;
+    FILE *m_file;
+    std::vector<char> m_buffer;
+};
+
+// Encode `count` elements in chunks of EXPORT_CHUNK_SIZE on all cores. encode(begin, end, out) appends the
+// encoding of the elements [begin, end) to out. The chunks are returned in order.
+template<class Encoder>
+static std::vector<std::string> encode_parallel(size_t count, Encoder &&encode) {
+    size_t num_chunks = (count + EXPORT_CHUNK_SIZE - 1) / EXPORT_CHUNK_SIZE;
+    std::vector<std::string> chunks(num_chunks);
+    parallel_for((int) num_chunks, [&](int i) {
+        size_t begin = i * EXPORT_CHUNK_SIZE;
+        encode(begin, std::min(begin + EXPORT_CHUNK_SIZE, count), chunks[i]);
+    });
+    return chunks;
+}
+
+template<class T>
+static void append_binary(std::string &out, const T &value) {
+    out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+// Faces at the border of the domain can reference voxels without a vertex, they are skipped like in triangulate.
+// Returns faces if all of them are valid, otherwise the valid faces copied to storage.
+template<size_t N>
+static const std::vector<std::array<int, N>> &valid_faces(const std::vector<std::array<int, N>> &faces,
+                                                          std::vector<std::array<int, N>> &storage) {
+    auto invalid = [](const std::array<int, N> &face) {
+        return std::any_of(face.begin(), face.end(), [](int index) { return index < 0; });
+    };
+    if (std::none_of(faces.begin(), faces.end(), invalid)) {
+        return faces;
+    }
+    storage.clear();
+    std::remove_copy_if(faces.begin(), faces.end(), std::back_inserter(storage), invalid);
+    return storage;
+}
+
+template<size_t N>
+static void write_ply(const std::vector<glm::dvec3> &vertices, const std::vector<std::array<int, N>> &all_faces,
+                      const std::string &path) {
+    std::vector<std::array<int, N>> storage;
+    const auto &faces = valid_faces(all_faces, storage);
+    OutputFile file(path);
+    std::string header = "ply\nformat binary_little_endian 1.0\n";
+    header += "element vertex " + std::to_string(vertices.size()) + "\n";
+    header += "property float x\nproperty float y\nproperty float z\n";
+    header += "element face " + std::to_string(faces.size()) + "\n";
+    header += "property list uchar int vertex_indices\nend_header\n";
+    file.write(header);
+
+    for (const auto &chunk: encode_parallel(vertices.size(), [&](size_t begin, size_t end, std::string &out) {
+        out.reserve((end - begin) * 3 * sizeof(float));
+        for (size_t i = begin; i < end; ++i) {
+            float p[3] = {(float) vertices[i].x, (float) vertices[i].y, (float) vertices[i].z};
+            out.append(reinterpret_cast<const char *>(p), sizeof(p));
+        }
+    })) {
+        file.write(chunk);
+    }
+    for (const auto &chunk: encode_parallel(faces.size(), [&](size_t begin, size_t end, std::string &out) {
+        out.reserve((end - begin) * (1 + N * sizeof(int32_t)));
+        for (size_t i = begin; i < end; ++i) {
+            append_binary(out, (uint8_t) N);
+            for (int index: faces[i]) {
+                append_binary(out, (int32_t) index);
+            }
+        }
+    })) {
+        file.write(chunk);
+    }
+    file.close();
+}
+
+template<size_t N>
+static void write_obj(const std::vector<glm::dvec3> &vertices, const std::vector<std::array<int, N>> &all_faces,
+                      const std::string &path) {
+    std::vector<std::array<int, N>> storage;
+    const auto &faces = valid_faces(all_faces, storage);
+    OutputFile file(path);
+    for (const auto &chunk: encode_parallel(vertices.size(), [&](size_t begin, size_t end, std::string &out) {
+        char line[128];
+        for (size_t i = begin; i < end; ++i) {
+            char *ptr = line;
+            *ptr++ = 'v';
+            for (int c = 0; c < 3; ++c) {
+                *ptr++ = ' ';
+                ptr = std::to_chars(ptr, line + sizeof(line), vertices[i][c], std::chars_format::general, 9).ptr;
+            }
+            *ptr++ = '\n';
+            out.append(line, ptr);
+        }
+    })) {
+        file.write(chunk);
+    }
+    for (const auto &chunk: encode_parallel(faces.size(), [&](size_t begin, size_t end, std::string &out) {
+        char line[128];
+        for (size_t i = begin; i < end; ++i) {
+            char *ptr = line;
+            *ptr++ = 'f';
+            for (int index: faces[i]) {
+                *ptr++ = ' ';
+                // OBJ indices start at 1
+                ptr = std::to_chars(ptr, line + sizeof(line), index + 1).ptr;
+            }
+            *ptr++ = '\n';
+            out.append(line, ptr);
+        }
+    })) {
+        file.write(chunk);
+    }
+    file.close();
+}
+
+static void append_varint(std::string &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((char) (value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char) value);
+}
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+// Layout: magic, version, bits, face size, vertex count, face count, bounding box, quantized positions as
+// uint16 triples, byte size of the index stream, index stream. The first index of every face is coded
+// relative to the first index of the previous face, the others relative to the first index of their face.
+template<size_t N>
+static void write_quantized(const std::vector<glm::dvec3> &vertices,
+                            const std::vector<std::array<int, N>> &all_faces, const std::string &path, int bits) {
+    if (bits < 1 || bits > 16) {
+        throw std::invalid_argument("Quantization bits have to be in [1, 16]");
+    }
+    std::vector<std::array<int, N>> storage;
+    const auto &faces = valid_faces(all_faces, storage);
+    glm::dvec3 lower{0};
+    glm::dvec3 upper{0};
+    if (!vertices.empty()) {
+        lower = upper = vertices[0];
+    }
+    for (const auto &p: vertices) {
+        lower = glm::min(lower, p);
+        upper = glm::max(upper, p);
+    }
+    double levels = (double) ((1 << bits) - 1);
+    glm::dvec3 scale = levels / glm::max(upper - lower, glm::dvec3(1e-300));
+
+    OutputFile file(path);
+    std::string header;
+    header.append(QUANTIZED_MAGIC, sizeof(QUANTIZED_MAGIC));
+    append_binary(header, QUANTIZED_VERSION);
+    append_binary(header, (uint32_t) bits);
+    append_binary(header, (uint32_t) N);
+    append_binary(header, (uint64_t) vertices.size());
+    append_binary(header, (uint64_t) faces.size());
+    for (int c = 0; c < 3; ++c) {
+        append_binary(header, lower[c]);
+    }
+    for (int c = 0; c < 3; ++c) {
+        append_binary(header, upper[c]);
+    }
+    file.write(header);
+
+    for (const auto &chunk: encode_parallel(vertices.size(), [&](size_t begin, size_t end, std::string &out) {
+        out.reserve((end - begin) * 3 * sizeof(uint16_t));
+        for (size_t i = begin; i < end; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                double q = std::round((vertices[i][c] - lower[c]) * scale[c]);
+                append_binary(out, (uint16_t) std::clamp(q, 0.0, levels));
+            }
+        }
+    })) {
+        file.write(chunk);
+    }
+
+    auto chunks = encode_parallel(faces.size(), [&](size_t begin, size_t end, std::string &out) {
+        out.reserve((end - begin) * N * 2);
+        int64_t previous = begin > 0 ? faces[begin - 1][0] : 0;
+        for (size_t i = begin; i < end; ++i) {
+            int64_t first = faces[i][0];
+            append_varint(out, zigzag(first - previous));
+            for (size_t j = 1; j < N; ++j) {
+                append_varint(out, zigzag(faces[i][j] - first));
+            }
+            previous = first;
+        }
+    });
+    uint64_t stream_size = 0;
+    for (const auto &chunk: chunks) {
+        stream_size += chunk.size();
+    }
+    file.write(&stream_size, sizeof(stream_size));
+    for (const auto &chunk: chunks) {
+        file.write(chunk);
+    }
+    file.close();
+}
+
+template<size_t N>
+static void read_quantized(const std::string &path, std::vector<glm::dvec3> &vertices,
+                           std::vector<std::array<int, N>> &faces) {
+    std::unique_ptr<FILE, int (*)(FILE *)> file(fopen(path.c_str(), "rb"), &fclose);
+    if (!file) {
+        throw std::runtime_error("Could not open " + path);
+    }
+    auto read = [&](void *data, size_t size) {
+        if (fread(data, 1, size, file.get()) != size) {
+            throw std::runtime_error("Unexpected end of " + path);
+        }
+    };
+    char magic[4];
+    uint32_t version, bits, face_size;
+    uint64_t num_vertices, num_faces, stream_size;
+    double lower[3], upper[3];
+    read(magic, sizeof(magic));
+    read(&version, sizeof(version));
+    if (memcmp(magic, QUANTIZED_MAGIC, sizeof(magic)) != 0 || version != QUANTIZED_VERSION) {
+        throw std::runtime_error(path + " is not a quantized mesh");
+    }
+    read(&bits, sizeof(bits));
+    if (bits < 1 || bits > 16) {
+        throw std::runtime_error(path + " has " + std::to_string(bits) + " quantization bits");
+    }
+    read(&face_size, sizeof(face_size));
+    if (face_size != N) {
+        throw std::runtime_error(path + " has faces of size " + std::to_string(face_size));
+    }
+    read(&num_vertices, sizeof(num_vertices));
+    read(&num_faces, sizeof(num_faces));
+    read(lower, sizeof(lower));
+    read(upper, sizeof(upper));
+
+    std::vector<uint16_t> quantized(3 * num_vertices);
+    read(quantized.data(), quantized.size() * sizeof(uint16_t));
+    double levels = (double) ((1 << bits) - 1);
+    vertices.resize(num_vertices);
+    for (size_t i = 0; i < num_vertices; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            vertices[i][c] = lower[c] + quantized[3 * i + c] / levels * (upper[c] - lower[c]);
+        }
+    }
+
+    read(&stream_size, sizeof(stream_size));
+    std::vector<uint8_t> stream(stream_size);
+    read(stream.data(), stream.size());
+    size_t position = 0;
+    auto next = [&]() {
+        uint64_t value = 0;
+        for (int shift = 0;; shift += 7) {
+            if (position >= stream.size()) {
+                throw std::runtime_error("Unexpected end of " + path);
+            }
+            uint8_t byte = stream[position++];
+            value |= (uint64_t) (byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return unzigzag(value);
+            }
+        }
+    };
+    faces.resize(num_faces);
+    int64_t previous = 0;
+    for (auto &face: faces) {
+        int64_t first = previous + next();
+        face[0] = (int) first;
+        for (size_t j = 1; j < N; ++j) {
+            face[j] = (int) (first + next());
+        }
+        previous = first;
+    }
+}
+
+void write_ply(const QuadMesh &mesh, const std::string &path) {
+    write_ply(mesh.vertices, mesh.quads, path);
+}
+
+void write_ply(const TriMesh &mesh, const std::string &path) {
+    write_ply(mesh.vertices, mesh.triangles, path);
+}
+
+void write_obj(const QuadMesh &mesh, const std::string &path) {
+    write_obj(mesh.vertices, mesh.quads, path);
+}
+
+void write_obj(const TriMesh &mesh, const std::string &path) {
+    write_obj(mesh.vertices, mesh.triangles, path);
+}
+
+void write_quantized(const QuadMesh &mesh, const std::string &path, int bits) {
+    write_quantized(mesh.vertices, mesh.quads, path, bits);
+}
+
+void write_quantized(const TriMesh &mesh, const std::string &path, int bits) {
+    write_quantized(mesh.vertices, mesh.triangles, path, bits);
+}
+
+QuadMesh read_quantized_quad_mesh(const std::string &path) {
+    QuadMesh mesh;
+    read_quantized(path, mesh.vertices, mesh.quads);
+    return mesh;
+}
+
+TriMesh read_quantized_tri_mesh(const std::string &path) {
+    TriMesh mesh;
+    read_quantized(path, mesh.vertices, mesh.triangles);
+    return mesh;
+}
+
+static bool ends_with(const std::string &path, const std::string &extension) {
+    return path.size() >= extension.size() && path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+template<class Mesh>
+static void export_any(const Mesh &mesh, const std::string &path) {
+    if (ends_with(path, ".ply")) {
+        write_ply(mesh, path);
+    } else if (ends_with(path, ".obj")) {
+        write_obj(mesh, path);
+    } else if (ends_with(path, ".rkqm")) {
+        write_quantized(mesh, path);
+    } else {
+        throw std::invalid_argument("Unknown mesh format: " + path);
+    }
+}
+
+void export_mesh(const QuadMesh &mesh, const std::string &path) {
+    export_any(mesh, path);
+}
+
+void export_mesh(const TriMesh &mesh, const std::string &path) {
+    export_any(mesh, path);
+}
@@ -0,0 +1,38 @@
+//
+// Created by elisabeth on 10.02.24.
+//
+
+#pragma once
+
+#include <string>
+
+#include "implicit_meshing.h"
+
+// All writers encode the mesh in parallel chunks and throw std::runtime_error if the file can't be written. Faces
+// with a negative index, i.e. at the border of the domain, are skipped.
+
+// Binary little endian PLY with float positions and int face indices
+void write_ply(const QuadMesh &mesh, const std::string &path);
+
+void write_ply(const TriMesh &mesh, const std::string &path);
+
+// Wavefront OBJ
+void write_obj(const QuadMesh &mesh, const std::string &path);
+
+void write_obj(const TriMesh &mesh, const std::string &path);
+
+// Compact binary format: positions are quantized to `bits` bits per coordinate relative to the bounding
+// box and the face indices are delta coded as zigzag varints
+void write_quantized(const QuadMesh &mesh, const std::string &path, int bits = 16);
+
+void write_quantized(const TriMesh &mesh, const std::string &path, int bits = 16);
+
+// Read meshes written by write_quantized, throws std::runtime_error if the file has a different face size
+QuadMesh read_quantized_quad_mesh(const std::string &path);
+
+TriMesh read_quantized_tri_mesh(const std::string &path);
+
+// Pick the format from the extension of path (.ply, .obj or .rkqm)
+void export_mesh(const QuadMesh &mesh, const std::string &path);
+
+void export_mesh(const TriMesh &mesh, const std::string &path);
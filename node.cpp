@@ -10,6 +10,12 @@
 
 #include <glm/glm.hpp>
 #include <map>
+#include <cstring>
+#include <typeinfo>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
 
 Node::Node(Editor *editor, int node_id, int num_inputs) {
     this->m_editor = editor;
@@ -17,15 +23,45 @@ Node::Node(Editor *editor, int node_id, int num_inputs) {
     this->m_num_inputs = num_inputs;
 }
 
+void hash_combine(size_t &seed, size_t value) {
+    seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+void hash_combine(size_t &seed, float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    hash_combine(seed, (size_t) bits);
+}
+
+void hash_combine(size_t &seed, glm::vec3 value) {
+    hash_combine(seed, value.x);
+    hash_combine(seed, value.y);
+    hash_combine(seed, value.z);
+}
+
+size_t Node::parameter_hash() const {
+    size_t seed = typeid(*this).hash_code();
+    hash_parameters(seed);
+    return seed;
+}
+
 void OutputNode::draw() {
     ImGui::PushItemWidth(120);
     ImNodes::BeginNode(m_node_id);
     ImNodes::BeginNodeTitleBar();
-    ImGui::TextUnformatted("Output");
+    ImGui::TextUnformatted(title());
     ImNodes::EndNodeTitleBar();
     ImGui::Dummy(ImVec2(120.0f, 0.0f));
 
     assert(m_num_inputs == 1);
+    if (m_node_id != 0) {
+        if (ImGui::InputText("name", m_name, sizeof(m_name))) {
+            m_editor->m_remesh = true;
+        }
+        if (ImGui::Checkbox("surface", &m_surface)) {
+            m_editor->m_remesh = true;
+        }
+    }
     ImNodes::BeginInputAttribute(m_editor->get_input_attribute_id(m_node_id, 0));
     ImNodes::EndInputAttribute();
 
@@ -33,11 +69,14 @@ void OutputNode::draw() {
     ImGui::PopItemWidth();
 }
 
-std::vector<int>
-OutputNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
-                                  std::map<int, double> &constants) {
-    Node *node = m_editor->find_node(m_node_id, 0);
-    return node->generate_instructions(instructions, current_register, constants);
+void OutputNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                                       std::map<int, double> &constants, std::vector<int> &registers) {
+    registers = m_editor->input_registers(m_node_id, 0);
+}
+
+void OutputNode::hash_parameters(size_t &seed) const {
+    hash_combine(seed, (size_t) m_surface);
+    hash_combine(seed, std::hash<std::string>()(m_name));
 }
 
 void SphereNode::draw() {
@@ -45,7 +84,7 @@ void SphereNode::draw() {
     ImNodes::BeginNode(m_node_id);
 
     ImNodes::BeginNodeTitleBar();
-    ImGui::TextUnformatted("Sphere");
+    ImGui::TextUnformatted(title());
     ImNodes::EndNodeTitleBar();
 
     ImGui::Dummy(ImVec2(120.0f, 0.0f)); // Adjust width here
@@ -79,29 +118,36 @@ void SphereNode::draw() {
     ImGui::PopItemWidth();
 }
 
-std::vector<int>
-SphereNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
-                                  std::map<int, double> &constants) {
+void SphereNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                                       std::map<int, double> &constants, std::vector<int> &registers) {
     Node *node_center = m_editor->find_node(m_node_id, 0);
     Node *node_radius = m_editor->find_node(m_node_id, 1);
-    std::vector<int> center;
+    glm::ivec3 center;
     if (node_center) {
-        center = node_center->generate_instructions(instructions, current_register, constants);
+        const std::vector<int> &input = m_editor->input_registers(m_node_id, 0);
+        center = glm::ivec3(input[0], input[1], input[2]);
     } else {
         auto cx = generate_constant(constants, current_register, m_center.x);
         auto cy = generate_constant(constants, current_register, m_center.y);
         auto cz = generate_constant(constants, current_register, m_center.z);
-        center = {cx, cy, cz};
+        center = glm::ivec3(cx, cy, cz);
     }
-    std::vector<int> radius;
+    int radius;
     if (node_radius) {
-        radius = node_radius->generate_instructions(instructions, current_register, constants);
+        radius = m_editor->input_registers(m_node_id, 1)[0];
     } else {
-        radius = {generate_constant(constants, current_register, m_radius)};
+        radius = generate_constant(constants, current_register, m_radius);
     }
-    glm::ivec3 res1 = generate_sub(instructions, current_register, {0, 1, 2}, {center[0], center[1], center[2]});
-    int res2 = generate_length(instructions, current_register, res1);
-    return {generate_sub(instructions, current_register, res2, radius[0])};
+    int p = generate_pack(instructions, current_register, m_editor->point_registers());
+    int c = generate_pack(instructions, current_register, center);
+    int res1 = generate_op(instructions, current_register, Operation::Sub, ValueType::Vec3, p, c);
+    int res2 = generate_length(instructions, current_register, ValueType::Vec3, res1);
+    registers = {generate_sub(instructions, current_register, res2, radius)};
+}
+
+void SphereNode::hash_parameters(size_t &seed) const {
+    hash_combine(seed, m_center);
+    hash_combine(seed, m_radius);
 }
 
 void TorusNode::draw() {
@@ -109,7 +155,7 @@ void TorusNode::draw() {
     ImNodes::BeginNode(m_node_id);
 
     ImNodes::BeginNodeTitleBar();
-    ImGui::TextUnformatted("Torus");
+    ImGui::TextUnformatted(title());
     ImNodes::EndNodeTitleBar();
 
     ImGui::Dummy(ImVec2(120.0f, 0.0f));
@@ -153,38 +199,49 @@ void TorusNode::draw() {
     ImGui::PopItemWidth();
 }
 
-std::vector<int>
-TorusNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
-                                 std::map<int, double> &constants) {
+void TorusNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                                      std::map<int, double> &constants, std::vector<int> &registers) {
     Node *node_radius1 = m_editor->find_node(m_node_id, 0);
     Node *node_radius2 = m_editor->find_node(m_node_id, 1);
     Node *node_center = m_editor->find_node(m_node_id, 2);
-    std::vector<int> r1;
+    int r1;
     if (node_radius1) {
-        r1 = node_radius1->generate_instructions(instructions, current_register, constants);
+        r1 = m_editor->input_registers(m_node_id, 0)[0];
     } else {
-        r1 = {generate_constant(constants, current_register, m_major_r)};
+        r1 = generate_constant(constants, current_register, m_major_r);
     }
-    std::vector<int> r2;
+    int r2;
     if (node_radius2) {
-        r2 = node_radius2->generate_instructions(instructions, current_register, constants);
+        r2 = m_editor->input_registers(m_node_id, 1)[0];
     } else {
-        r2 = {generate_constant(constants, current_register, m_minor_r)};
+        r2 = generate_constant(constants, current_register, m_minor_r);
     }
-    std::vector<int> c;
+    glm::ivec3 c;
     if (node_center) {
-        c = node_center->generate_instructions(instructions, current_register, constants);
+        const std::vector<int> &input = m_editor->input_registers(m_node_id, 2);
+        c = glm::ivec3(input[0], input[1], input[2]);
     } else {
         auto cx = generate_constant(constants, current_register, m_center.x);
         auto cy = generate_constant(constants, current_register, m_center.y);
         auto cz = generate_constant(constants, current_register, m_center.z);
-        c = {cx, cy, cz};
+        c = glm::ivec3(cx, cy, cz);
     }
-    glm::ivec3 res0 = generate_sub(instructions, current_register, {0, 1, 2}, {c[0], c[1], c[2]});
-    int res1 = generate_length(instructions, current_register, {res0.x, res0.z});
-    int res2 = generate_sub(instructions, current_register, res1, r1[0]);
-    int res3 = generate_length(instructions, current_register, {res2, res0.y});
-    return {generate_sub(instructions, current_register, res3, r2[0])};
+    int p = generate_pack(instructions, current_register, m_editor->point_registers());
+    int center = generate_pack(instructions, current_register, c);
+    int res0 = generate_op(instructions, current_register, Operation::Sub, ValueType::Vec3, p, center);
+    int x = generate_extract(instructions, current_register, ValueType::Vec3, res0, 0);
+    int y = generate_extract(instructions, current_register, ValueType::Vec3, res0, 1);
+    int z = generate_extract(instructions, current_register, ValueType::Vec3, res0, 2);
+    int res1 = generate_length(instructions, current_register, ValueType::Vec2, generate_pack(instructions, current_register, glm::ivec2(x, z)));
+    int res2 = generate_sub(instructions, current_register, res1, r1);
+    int res3 = generate_length(instructions, current_register, ValueType::Vec2, generate_pack(instructions, current_register, glm::ivec2(res2, y)));
+    registers = {generate_sub(instructions, current_register, res3, r2)};
+}
+
+void TorusNode::hash_parameters(size_t &seed) const {
+    hash_combine(seed, m_major_r);
+    hash_combine(seed, m_minor_r);
+    hash_combine(seed, m_center);
 }
 
 void BoxNode::draw() {
@@ -192,7 +249,7 @@ void BoxNode::draw() {
     ImNodes::BeginNode(m_node_id);
 
     ImNodes::BeginNodeTitleBar();
-    ImGui::TextUnformatted("Box");
+    ImGui::TextUnformatted(title());
     ImNodes::EndNodeTitleBar();
 
     ImGui::Dummy(ImVec2(120.0f, 0.0f)); // Adjust width here
@@ -225,39 +282,48 @@ void BoxNode::draw() {
     ImGui::PopItemWidth();
 }
 
-std::vector<int>
-BoxNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
-                               std::map<int, double> &constants) {
+void BoxNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                                    std::map<int, double> &constants, std::vector<int> &registers) {
     Node *node_input = m_editor->find_node(m_node_id, 0);
     Node *node_center = m_editor->find_node(m_node_id, 1);
-    std::vector<int> input;
+    glm::ivec3 input;
     if (node_input) {
-        input = node_input->generate_instructions(instructions, current_register, constants);
+        const std::vector<int> &size = m_editor->input_registers(m_node_id, 0);
+        input = glm::ivec3(size[0], size[1], size[2]);
     } else {
         auto cx = generate_constant(constants, current_register, m_size.x);
         auto cy = generate_constant(constants, current_register, m_size.y);
         auto cz = generate_constant(constants, current_register, m_size.z);
-        input = {cx, cy, cz};
+        input = glm::ivec3(cx, cy, cz);
     }
-    std::vector<int> center;
+    glm::ivec3 center;
     if (node_center) {
-        center = node_center->generate_instructions(instructions, current_register, constants);
+        const std::vector<int> &position = m_editor->input_registers(m_node_id, 1);
+        center = glm::ivec3(position[0], position[1], position[2]);
     } else {
         auto cx = generate_constant(constants, current_register, m_center.x);
         auto cy = generate_constant(constants, current_register, m_center.y);
         auto cz = generate_constant(constants, current_register, m_center.z);
-        center = {cx, cy, cz};
+        center = glm::ivec3(cx, cy, cz);
     }
-    glm::ivec3 res0 = generate_sub(instructions, current_register, {0, 1, 2}, {center[0], center[1], center[2]});
-    glm::ivec3 res1 = generate_abs(instructions, current_register, res0);
-    glm::ivec3 res2 = generate_sub(instructions, current_register, res1, {input[0], input[1], input[2]});
-    int res3 = generate_max_element(instructions, current_register, res2);
-    int zero = current_register++;
-    constants[zero] = 0;
+    int p = generate_pack(instructions, current_register, m_editor->point_registers());
+    int c = generate_pack(instructions, current_register, center);
+    int size = generate_pack(instructions, current_register, input);
+    int res0 = generate_op(instructions, current_register, Operation::Sub, ValueType::Vec3, p, c);
+    int res1 = generate_op(instructions, current_register, Operation::Abs, ValueType::Vec3, res0);
+    int res2 = generate_op(instructions, current_register, Operation::Sub, ValueType::Vec3, res1, size);
+    int res3 = generate_max_element(instructions, current_register, ValueType::Vec3, res2);
+    int zero = generate_constant(constants, current_register, 0);
     int res4 = generate_min(instructions, current_register, res3, zero);
-    glm::ivec3 res5 = generate_max(instructions, current_register, res2, {zero, zero, zero});
-    int res6 = generate_length(instructions, current_register, res5);
-    return {generate_add(instructions, current_register, res4, res6)};
+    int zeros = generate_splat(instructions, current_register, ValueType::Vec3, zero);
+    int res5 = generate_op(instructions, current_register, Operation::Max, ValueType::Vec3, res2, zeros);
+    int res6 = generate_length(instructions, current_register, ValueType::Vec3, res5);
+    registers = {generate_add(instructions, current_register, res4, res6)};
+}
+
+void BoxNode::hash_parameters(size_t &seed) const {
+    hash_combine(seed, m_center);
+    hash_combine(seed, m_size);
 }
 
 void CylinderNode::draw() {
@@ -265,7 +331,7 @@ void CylinderNode::draw() {
     ImNodes::BeginNode(m_node_id);
 
     ImNodes::BeginNodeTitleBar();
-    ImGui::TextUnformatted("Cylinder");
+    ImGui::TextUnformatted(title());
     ImNodes::EndNodeTitleBar();
 
     ImGui::Dummy(ImVec2(120.0f, 0.0f)); // Adjust width here
@@ -307,50 +373,63 @@ void CylinderNode::draw() {
     ImGui::PopItemWidth();
 }
 
-std::vector<int>
-CylinderNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
-                                    std::map<int, double> &constants) {
+void CylinderNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                                         std::map<int, double> &constants, std::vector<int> &registers) {
     Node *node_height = m_editor->find_node(m_node_id, 0);
     Node *node_radius = m_editor->find_node(m_node_id, 1);
     Node *node_center = m_editor->find_node(m_node_id, 2);
-    std::vector<int> height;
+    int height;
     if (node_height) {
-        height = node_height->generate_instructions(instructions, current_register, constants);
+        height = m_editor->input_registers(m_node_id, 0)[0];
     } else {
-        height = {generate_constant(constants, current_register, m_height)};
+        height = generate_constant(constants, current_register, m_height);
     }
-    std::vector<int> radius;
+    int radius;
     if (node_radius) {
-        radius = node_radius->generate_instructions(instructions, current_register, constants);
+        radius = m_editor->input_registers(m_node_id, 1)[0];
     } else {
-        radius = {generate_constant(constants, current_register, m_radius)};
+        radius = generate_constant(constants, current_register, m_radius);
     }
-    std::vector<int> center;
+    glm::ivec3 center;
     if (node_center) {
-        center = node_center->generate_instructions(instructions, current_register, constants);
+        const std::vector<int> &input = m_editor->input_registers(m_node_id, 2);
+        center = glm::ivec3(input[0], input[1], input[2]);
     } else {
         auto cx = generate_constant(constants, current_register, m_center.x);
         auto cy = generate_constant(constants, current_register, m_center.y);
         auto cz = generate_constant(constants, current_register, m_center.z);
-        center = {cx, cy, cz};
+        center = glm::ivec3(cx, cy, cz);
     }
-    glm::ivec3 res0 = generate_sub(instructions, current_register, {0, 1, 2}, {center[0], center[1], center[2]});
-    int res1 = generate_length(instructions, current_register, {res0.x, res0.z});
-    glm::ivec2 res2 = generate_abs(instructions, current_register, {res1, res0.y});
-    glm::ivec2 res3 = generate_sub(instructions, current_register, res2, {radius[0], height[0]});
-    int res4 = generate_max_element(instructions, current_register, res3);
+    int p = generate_pack(instructions, current_register, m_editor->point_registers());
+    int c = generate_pack(instructions, current_register, center);
+    int res0 = generate_op(instructions, current_register, Operation::Sub, ValueType::Vec3, p, c);
+    int x = generate_extract(instructions, current_register, ValueType::Vec3, res0, 0);
+    int y = generate_extract(instructions, current_register, ValueType::Vec3, res0, 1);
+    int z = generate_extract(instructions, current_register, ValueType::Vec3, res0, 2);
+    int res1 = generate_length(instructions, current_register, ValueType::Vec2, generate_pack(instructions, current_register, glm::ivec2(x, z)));
+    int res2 = generate_op(instructions, current_register, Operation::Abs, ValueType::Vec2, generate_pack(instructions, current_register, glm::ivec2(res1, y)));
+    int size = generate_pack(instructions, current_register, glm::ivec2(radius, height));
+    int res3 = generate_op(instructions, current_register, Operation::Sub, ValueType::Vec2, res2, size);
+    int res4 = generate_max_element(instructions, current_register, ValueType::Vec2, res3);
     int zero = generate_constant(constants, current_register, 0);
     int res5 = generate_min(instructions, current_register, res4, zero);
-    glm::ivec2 res6 = generate_max(instructions, current_register, res3, {zero, zero});
-    int res7 = generate_length(instructions, current_register, res6);
-    return {generate_add(instructions, current_register, res5, res7)};
+    int zeros = generate_splat(instructions, current_register, ValueType::Vec2, zero);
+    int res6 = generate_op(instructions, current_register, Operation::Max, ValueType::Vec2, res3, zeros);
+    int res7 = generate_length(instructions, current_register, ValueType::Vec2, res6);
+    registers = {generate_add(instructions, current_register, res5, res7)};
+}
+
+void CylinderNode::hash_parameters(size_t &seed) const {
+    hash_combine(seed, m_center);
+    hash_combine(seed, m_height);
+    hash_combine(seed, m_radius);
 }
 
 void ScalarNode::draw() {
     ImGui::PushItemWidth(120);
     ImNodes::BeginNode(m_node_id);
     ImNodes::BeginNodeTitleBar();
-    ImGui::TextUnformatted("Scalar");
+    ImGui::TextUnformatted(title());
     ImNodes::EndNodeTitleBar();
 
     assert(m_num_inputs == 0);
@@ -364,18 +443,21 @@ void ScalarNode::draw() {
     ImGui::PopItemWidth();
 }
 
-std::vector<int>
-ScalarNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
-                                  std::map<int, double> &constants) {
+void ScalarNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                                       std::map<int, double> &constants, std::vector<int> &registers) {
     constants[current_register] = value;
-    return {current_register++};
+    registers = {current_register++};
+}
+
+void ScalarNode::hash_parameters(size_t &seed) const {
+    hash_combine(seed, value);
 }
 
 void PointNode::draw() {
     ImGui::PushItemWidth(240);
     ImNodes::BeginNode(m_node_id);
     ImNodes::BeginNodeTitleBar();
-    ImGui::TextUnformatted("Point");
+    ImGui::TextUnformatted(title());
     ImNodes::EndNodeTitleBar();
 
     ImGui::Dummy(ImVec2(180.0f, 0.0f));
@@ -403,41 +485,42 @@ void PointNode::draw() {
     ImGui::PopItemWidth();
 }
 
-std::vector<int>
-PointNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
-                                 std::map<int, double> &constants) {
+void PointNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                                      std::map<int, double> &constants, std::vector<int> &registers) {
     Node *node_x = m_editor->find_node(m_node_id, 0);
     Node *node_y = m_editor->find_node(m_node_id, 1);
     Node *node_z = m_editor->find_node(m_node_id, 2);
 
-    std::vector<int> value(3);
+    registers.resize(3);
     if (node_x) {
-        value[0] = node_x->generate_instructions(instructions, current_register, constants)[0];
+        registers[0] = m_editor->input_registers(m_node_id, 0)[0];
     } else {
-        value[0] = generate_constant(constants, current_register, this->value.x);
+        registers[0] = generate_constant(constants, current_register, this->value.x);
     }
     if (node_y) {
-        value[1] = node_y->generate_instructions(instructions, current_register, constants)[0];
+        registers[1] = m_editor->input_registers(m_node_id, 1)[0];
     } else {
-        value[1] = generate_constant(constants, current_register, this->value.y);
+        registers[1] = generate_constant(constants, current_register, this->value.y);
     }
     if (node_z) {
-        value[2] = node_z->generate_instructions(instructions, current_register, constants)[0];
+        registers[2] = m_editor->input_registers(m_node_id, 2)[0];
     } else {
-        value[2] = generate_constant(constants, current_register, this->value.z);
+        registers[2] = generate_constant(constants, current_register, this->value.z);
     }
-    return value;
+}
+
+void PointNode::hash_parameters(size_t &seed) const {
+    hash_combine(seed, value);
 }
 
 void TimeNode::draw() {
     ImGui::PushItemWidth(240);
     ImNodes::BeginNode(m_node_id);
     ImNodes::BeginNodeTitleBar();
-    ImGui::TextUnformatted("Time");
+    ImGui::TextUnformatted(title());
     ImNodes::EndNodeTitleBar();
 
     assert(m_num_inputs == 0);
-    m_editor->m_remesh = true;
 
     ImNodes::BeginOutputAttribute(m_editor->get_output_attribute_id(m_node_id));
     ImNodes::EndOutputAttribute();
@@ -445,10 +528,10 @@ void TimeNode::draw() {
     ImGui::PopItemWidth();
 }
 
-std::vector<int>
-TimeNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
-                                std::map<int, double> &constants) {
-    return {generate_constant(constants, current_register, ImGui::GetTime())};
+void TimeNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                                     std::map<int, double> &constants, std::vector<int> &registers) {
+    // The time is an argument of the compiled function, so animated graphs are compiled only once
+    registers = {TIME_REGISTER};
 }
 
 void UnionNode::draw() {
@@ -456,7 +539,7 @@ void UnionNode::draw() {
     ImNodes::BeginNode(m_node_id);
 
     ImNodes::BeginNodeTitleBar();
-    ImGui::TextUnformatted("Union");
+    ImGui::TextUnformatted(title());
     ImNodes::EndNodeTitleBar();
 
     ImGui::Dummy(ImVec2(120.0f, 0.0f));
@@ -474,14 +557,11 @@ void UnionNode::draw() {
     ImGui::PopItemWidth();
 }
 
-std::vector<int>
-UnionNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
-                                 std::map<int, double> &constants) {
-    Node *node_input1 = m_editor->find_node(m_node_id, 0);
-    Node *node_input2 = m_editor->find_node(m_node_id, 1);
-    std::vector<int> v1 = node_input1->generate_instructions(instructions, current_register, constants);
-    std::vector<int> v2 = node_input2->generate_instructions(instructions, current_register, constants);
-    return {generate_min(instructions, current_register, v1[0], v2[0])};
+void UnionNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                                      std::map<int, double> &constants, std::vector<int> &registers) {
+    int v1 = m_editor->input_registers(m_node_id, 0)[0];
+    int v2 = m_editor->input_registers(m_node_id, 1)[0];
+    registers = {generate_min(instructions, current_register, v1, v2)};
 }
 
 void SmoothUnionNode::draw() {
@@ -489,7 +569,7 @@ void SmoothUnionNode::draw() {
     ImNodes::BeginNode(m_node_id);
 
     ImNodes::BeginNodeTitleBar();
-    ImGui::TextUnformatted("Smooth Union");
+    ImGui::TextUnformatted(title());
     ImNodes::EndNodeTitleBar();
 
     ImGui::Dummy(ImVec2(120.0f, 0.0f));
@@ -517,27 +597,29 @@ void SmoothUnionNode::draw() {
     ImGui::PopItemWidth();
 }
 
-std::vector<int> SmoothUnionNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
-                                                        std::map<int, double> &constants) {
-    Node *node_input1 = m_editor->find_node(m_node_id, 0);
-    Node *node_input2 = m_editor->find_node(m_node_id, 1);
+void SmoothUnionNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                                            std::map<int, double> &constants, std::vector<int> &registers) {
     Node *node_input3 = m_editor->find_node(m_node_id, 2);
-    std::vector<int> v1 = node_input1->generate_instructions(instructions, current_register, constants);
-    std::vector<int> v2 = node_input2->generate_instructions(instructions, current_register, constants);
-    std::vector<int> r;
+    int v1 = m_editor->input_registers(m_node_id, 0)[0];
+    int v2 = m_editor->input_registers(m_node_id, 1)[0];
+    int r;
     if (node_input3) {
-        r = node_input3->generate_instructions(instructions, current_register, constants);
+        r = m_editor->input_registers(m_node_id, 2)[0];
     } else {
-        r = {generate_constant(constants, current_register, m_rounding)};
+        r = generate_constant(constants, current_register, m_rounding);
     }
-    glm::ivec2 res1 = generate_sub(instructions, current_register, {r[0], r[0]}, {v1[0], v2[0]});
+    glm::ivec2 res1 = generate_sub(instructions, current_register, {r, r}, {v1, v2});
     int zero = current_register++;
     constants[zero] = 0;
     glm::ivec2 res2 = generate_max(instructions, current_register, res1, {zero, zero});
-    int res3 = generate_min(instructions, current_register, v1[0], v2[0]);
-    int res4 = generate_max(instructions, current_register, res3, r[0]);
+    int res3 = generate_min(instructions, current_register, v1, v2);
+    int res4 = generate_max(instructions, current_register, res3, r);
     int res5 = generate_length(instructions, current_register, res2);
-    return {generate_sub(instructions, current_register, res4, res5)};
+    registers = {generate_sub(instructions, current_register, res4, res5)};
+}
+
+void SmoothUnionNode::hash_parameters(size_t &seed) const {
+    hash_combine(seed, m_rounding);
 }
 
 void UnaryOpNode::draw() {
@@ -545,7 +627,7 @@ void UnaryOpNode::draw() {
     ImNodes::BeginNode(m_node_id);
 
     ImNodes::BeginNodeTitleBar();
-    ImGui::TextUnformatted(return_op_name(m_op));
+    ImGui::TextUnformatted(title());
     ImNodes::EndNodeTitleBar();
 
     ImGui::Dummy(ImVec2(120.0f, 0.0f));
@@ -560,20 +642,333 @@ void UnaryOpNode::draw() {
     ImGui::PopItemWidth();
 }
 
-std::vector<int> UnaryOpNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
-                                                    std::map<int, double> &constants) {
-    Node *node_input = m_editor->find_node(m_node_id, 0);
-    std::vector<int> input = node_input->generate_instructions(instructions, current_register, constants);
+void UnaryOpNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                                        std::map<int, double> &constants, std::vector<int> &registers) {
+    int input = m_editor->input_registers(m_node_id, 0)[0];
     switch (m_op) {
         case Operation::Sqrt:
-            return {generate_sqrt(instructions, current_register, input[0])};
+            registers = {generate_sqrt(instructions, current_register, input)};
+            break;
         case Operation::Abs:
-            return {generate_abs(instructions, current_register, input[0])};
+            registers = {generate_abs(instructions, current_register, input)};
+            break;
         case Operation::Sin:
-            return {generate_sin(instructions, current_register, input[0])};
+            registers = {generate_sin(instructions, current_register, input)};
+            break;
         case Operation::Cos:
-            return {generate_cos(instructions, current_register, input[0])};
+            registers = {generate_cos(instructions, current_register, input)};
+            break;
         default:
             assert(false);
     }
 }
+
+void UnaryOpNode::hash_parameters(size_t &seed) const {
+    hash_combine(seed, (size_t) m_op);
+}
+
+void RepeatNode::draw() {
+    ImGui::PushItemWidth(120);
+    ImNodes::BeginNode(m_node_id);
+
+    ImNodes::BeginNodeTitleBar();
+    ImGui::TextUnformatted(title());
+    ImNodes::EndNodeTitleBar();
+
+    ImGui::Dummy(ImVec2(120.0f, 0.0f));
+    assert(m_num_inputs == 1);
+    const char *modes[] = {"grid", "radial"};
+    if (ImGui::Combo("mode", &m_mode, modes, 2)) {
+        m_editor->m_remesh = true;
+    }
+    if (m_mode == Grid) {
+        if (ImGui::InputFloat3("spacing", &m_spacing.x, "%.2f")) {
+            m_spacing = glm::max(m_spacing, glm::vec3(1e-3f));
+            m_editor->m_remesh = true;
+        }
+        if (ImGui::InputInt3("count", &m_count.x)) {
+            m_count = glm::max(m_count, glm::ivec3(0));
+            m_editor->m_remesh = true;
+        }
+    } else {
+        if (ImGui::InputInt("count", &m_radial_count)) {
+            m_radial_count = std::max(m_radial_count, 1);
+            m_editor->m_remesh = true;
+        }
+    }
+    if (ImGui::Checkbox("neighbors", &m_neighbors)) {
+        m_editor->m_remesh = true;
+    }
+    ImNodes::BeginInputAttribute(m_editor->get_input_attribute_id(m_node_id, 0));
+    ImGui::Text("Implicit");
+    ImNodes::EndInputAttribute();
+
+    ImNodes::BeginOutputAttribute(m_editor->get_output_attribute_id(m_node_id));
+    ImNodes::EndOutputAttribute();
+    ImNodes::EndNode();
+    ImGui::PopItemWidth();
+}
+
+std::vector<int> RepeatNode::generate_domains(std::vector<Instruction> &instructions, int &current_register,
+                                              std::map<int, double> &constants) {
+    glm::ivec3 p = m_editor->point_registers();
+    std::vector<int> domains;
+    if (m_mode == Radial) {
+        // rotate the point back into the sector around the y axis
+        int angle = generate_atan2(instructions, current_register, p.z, p.x);
+        int sector = generate_constant(constants, current_register, 2.0 * M_PI / m_radial_count);
+        int t = generate_div(instructions, current_register, angle, sector);
+        std::vector<int> ids;
+        if (m_neighbors) {
+            int id = generate_floor(instructions, current_register, t);
+            ids = {id, generate_add(instructions, current_register, id, generate_constant(constants, current_register, 1))};
+        } else {
+            ids = {generate_round(instructions, current_register, t)};
+        }
+        for (int id: ids) {
+            int a = generate_mul(instructions, current_register, id, sector);
+            int c = generate_cos(instructions, current_register, a);
+            int s = generate_sin(instructions, current_register, a);
+            int x = generate_add(instructions, current_register, generate_mul(instructions, current_register, c, p.x),
+                                 generate_mul(instructions, current_register, s, p.z));
+            int z = generate_sub(instructions, current_register, generate_mul(instructions, current_register, c, p.z),
+                                 generate_mul(instructions, current_register, s, p.x));
+            domains.push_back(m_editor->add_context({x, p.y, z}));
+        }
+        return domains;
+    }
+
+    // For every axis the candidate coordinates relative to the cell centers. With neighbors these are the two
+    // cells enclosing the point, otherwise only the closest one.
+    std::vector<int> coordinates[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        if (m_count[axis] == 1) {
+            coordinates[axis] = {p[axis]};
+            continue;
+        }
+        int spacing = generate_constant(constants, current_register, m_spacing[axis]);
+        int t = generate_div(instructions, current_register, p[axis], spacing);
+        std::vector<int> ids;
+        if (m_neighbors) {
+            int id = generate_floor(instructions, current_register, t);
+            ids = {id, generate_add(instructions, current_register, id, generate_constant(constants, current_register, 1))};
+        } else {
+            ids = {generate_round(instructions, current_register, t)};
+        }
+        for (int id: ids) {
+            // bounded repetition clamps the cell index to the copies that exist
+            if (m_count[axis] > 0) {
+                id = generate_max(instructions, current_register, id, generate_constant(constants, current_register, 0));
+                id = generate_min(instructions, current_register, id,
+                                  generate_constant(constants, current_register, m_count[axis] - 1));
+            }
+            int offset = generate_mul(instructions, current_register, id, spacing);
+            coordinates[axis].push_back(generate_sub(instructions, current_register, p[axis], offset));
+        }
+    }
+    for (int x: coordinates[0]) {
+        for (int y: coordinates[1]) {
+            for (int z: coordinates[2]) {
+                domains.push_back(m_editor->add_context({x, y, z}));
+            }
+        }
+    }
+    return domains;
+}
+
+void RepeatNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                                       std::map<int, double> &constants, std::vector<int> &registers) {
+    // union of the copies in all evaluated cells
+    int result = -1;
+    for (int domain: m_editor->m_domains) {
+        int value = m_editor->input_registers(m_node_id, 0, domain)[0];
+        result = result == -1 ? value : generate_min(instructions, current_register, result, value);
+    }
+    registers = {result};
+}
+
+void RepeatNode::hash_parameters(size_t &seed) const {
+    hash_combine(seed, (size_t) m_mode);
+    hash_combine(seed, m_spacing);
+    for (int i = 0; i < 3; ++i) {
+        hash_combine(seed, (size_t) m_count[i]);
+    }
+    hash_combine(seed, (size_t) m_radial_count);
+    hash_combine(seed, (size_t) m_neighbors);
+}
+
+void ScatterNode::draw() {
+    ImGui::PushItemWidth(120);
+    ImNodes::BeginNode(m_node_id);
+
+    ImNodes::BeginNodeTitleBar();
+    ImGui::TextUnformatted(title());
+    ImNodes::EndNodeTitleBar();
+
+    ImGui::Dummy(ImVec2(120.0f, 0.0f));
+    assert(m_num_inputs == 0);
+    if (ImGui::Checkbox("from file", &m_from_file)) {
+        m_editor->m_remesh = true;
+    }
+    if (m_from_file) {
+        ImGui::InputText("path", m_path, sizeof(m_path));
+        if (ImGui::Button("Load")) {
+            try {
+                m_file_instances = read_instances(m_path);
+                m_file_hash = m_file_instances.size();
+                for (const auto &instance: m_file_instances) {
+                    hash_combine(m_file_hash, (size_t) instance.primitive);
+                    hash_combine(m_file_hash, glm::vec3(instance.position));
+                    hash_combine(m_file_hash, glm::vec3(instance.size));
+                    for (int i = 0; i < 3; ++i) {
+                        hash_combine(m_file_hash, glm::vec3(instance.rotation[i]));
+                    }
+                }
+            } catch (const std::exception &e) {
+                printf("%s\n", e.what());
+            }
+            m_editor->m_remesh = true;
+        }
+        ImGui::Text("%d instances", (int) m_file_instances.size());
+    } else {
+        const char *primitives[] = {"spheres", "boxes", "both"};
+        if (ImGui::Combo("primitives", &m_primitives, primitives, 3)) {
+            m_editor->m_remesh = true;
+        }
+        if (m_primitives != 0 && ImGui::Checkbox("rotate boxes", &m_rotated)) {
+            m_editor->m_remesh = true;
+        }
+        if (ImGui::InputInt("count", &m_count)) {
+            m_count = std::max(m_count, 0);
+            m_editor->m_remesh = true;
+        }
+        if (ImGui::InputInt("seed", &m_seed)) {
+            m_editor->m_remesh = true;
+        }
+        if (ImGui::InputFloat3("extent", &m_extent.x, "%.2f")) {
+            m_editor->m_remesh = true;
+        }
+        if (ImGui::InputFloat("min size", &m_min_size, 0.01f, 0.1f, "%.3f")) {
+            m_editor->m_remesh = true;
+        }
+        if (ImGui::InputFloat("max size", &m_max_size, 0.01f, 0.1f, "%.3f")) {
+            m_editor->m_remesh = true;
+        }
+    }
+
+    ImNodes::BeginOutputAttribute(m_editor->get_output_attribute_id(m_node_id));
+    ImNodes::EndOutputAttribute();
+    ImNodes::EndNode();
+    ImGui::PopItemWidth();
+}
+
+void ScatterNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                                        std::map<int, double> &constants, std::vector<int> &registers) {
+    size_t hash = parameter_hash();
+    if (!m_set || hash != m_set_hash) {
+        std::vector<ScatterInstance> instances = m_from_file ? m_file_instances :
+                random_instances(m_count, m_seed, m_extent, m_min_size, m_max_size, m_primitives != 1, m_primitives != 0,
+                                 m_rotated);
+        m_set = std::make_shared<const ScatterSet>(build_scatter_set(std::move(instances)));
+        m_set_hash = hash;
+    }
+    int scatter = m_editor->add_scatter_set(m_set);
+    registers = {generate_scatter(instructions, current_register, m_editor->point_registers(), scatter)};
+}
+
+void ScatterNode::hash_parameters(size_t &seed) const {
+    hash_combine(seed, (size_t) m_from_file);
+    if (m_from_file) {
+        hash_combine(seed, m_file_hash);
+        return;
+    }
+    hash_combine(seed, (size_t) m_count);
+    hash_combine(seed, (size_t) m_seed);
+    hash_combine(seed, m_extent);
+    hash_combine(seed, m_min_size);
+    hash_combine(seed, m_max_size);
+    hash_combine(seed, (size_t) m_primitives);
+    hash_combine(seed, (size_t) m_rotated);
+}
+
+void BakeNode::draw() {
+    ImGui::PushItemWidth(120);
+    ImNodes::BeginNode(m_node_id);
+
+    ImNodes::BeginNodeTitleBar();
+    ImGui::TextUnformatted(title());
+    ImNodes::EndNodeTitleBar();
+
+    ImGui::Dummy(ImVec2(120.0f, 0.0f));
+    assert(m_num_inputs == 1);
+    if (ImGui::InputFloat3("lower", &m_lower.x, "%.2f")) {
+        m_editor->m_remesh = true;
+    }
+    if (ImGui::InputFloat3("upper", &m_upper.x, "%.2f")) {
+        m_upper = glm::max(m_upper, m_lower + glm::vec3(1e-3f));
+        m_editor->m_remesh = true;
+    }
+    if (ImGui::InputInt("resolution", &m_resolution)) {
+        m_resolution = std::clamp(m_resolution, 1, 1024);
+        m_editor->m_remesh = true;
+    }
+    if (ImGui::InputFloat("band", &m_band, 0.5f, 1.0f, "%.1f")) {
+        m_band = std::max(m_band, 0.0f);
+        m_editor->m_remesh = true;
+    }
+    if (m_volume) {
+        ImGui::Text("%d bricks stored", (int) (m_volume->samples.size() / BRICK_SAMPLES));
+    }
+    ImNodes::BeginInputAttribute(m_editor->get_input_attribute_id(m_node_id, 0));
+    ImGui::Text("Implicit");
+    ImNodes::EndInputAttribute();
+
+    ImNodes::BeginOutputAttribute(m_editor->get_output_attribute_id(m_node_id));
+    ImNodes::EndOutputAttribute();
+    ImNodes::EndNode();
+    ImGui::PopItemWidth();
+}
+
+void BakeNode::prepare() {
+    if (m_baking) {
+        throw std::runtime_error("Bake node " + std::to_string(m_node_id) + " depends on itself");
+    }
+    int input_id = m_editor->m_inputs[m_node_id][0].node_id;
+    if (input_id == -1) {
+        throw std::runtime_error("Input 0 of node " + std::to_string(m_node_id) + " is not connected");
+    }
+    // The input subgraph is part of the key, so any change upstream bakes the volume again
+    size_t hash = parameter_hash();
+    hash_combine(hash, m_editor->subgraph_hash(input_id));
+    if (m_volume && hash == m_volume_hash) {
+        return;
+    }
+    m_baking = true;
+    try {
+        Program program = m_editor->generate_program(input_id);
+        if (depends_on_time(program)) {
+            throw std::runtime_error("The input of bake node " + std::to_string(m_node_id) + " is animated");
+        }
+        Kernel kernel = compile_kernel(program);
+        m_volume = std::make_shared<const SparseVolume>(
+                bake_volume(kernel, 0.0, m_lower, m_upper, m_resolution, m_band));
+    } catch (...) {
+        m_baking = false;
+        throw;
+    }
+    m_baking = false;
+    m_volume_hash = hash;
+}
+
+void BakeNode::generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                                     std::map<int, double> &constants, std::vector<int> &registers) {
+    int volume = m_editor->add_volume(m_volume);
+    registers = {generate_volume(instructions, current_register, m_editor->point_registers(), volume)};
+}
+
+void BakeNode::hash_parameters(size_t &seed) const {
+    hash_combine(seed, m_lower);
+    hash_combine(seed, m_upper);
+    hash_combine(seed, (size_t) m_resolution);
+    hash_combine(seed, m_band);
+}
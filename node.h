@@ -6,6 +6,8 @@
 #include <vector>
 #include <glm/vec3.hpp>
 #include <map>
+#include <cstddef>
+#include <memory>
 
 #include "compiler.h"
 
@@ -17,6 +19,13 @@ enum class Type {
 
 struct Editor;
 
+// Mix the hash of a value into seed (same scheme as boost::hash_combine)
+void hash_combine(size_t &seed, size_t value);
+
+void hash_combine(size_t &seed, float value);
+
+void hash_combine(size_t &seed, glm::vec3 value);
+
 class Node {
 public:
     Node(Editor *editor, int node_id, int num_inputs);
@@ -30,14 +39,45 @@ public:
     // Draw the node
     virtual void draw() = 0;
 
-    // Returns the register id(s) of the output of the node
+    // Name of the node type shown in its title bar
+    virtual const char *title() const = 0;
+
+    // Writes the register id(s) of the output of the node to registers, its slot in the register table of the editor.
+    // The slot is empty and keeps its memory between programs. The inputs have already been lowered by
+    // Editor::generate_program, their registers are available through Editor::input_registers.
+    virtual void generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                                       std::map<int, double> &constants, std::vector<int> &registers) = 0;
+
+    // Called before the inputs are lowered. A node that evaluates its inputs at transformed points emits the
+    // transformation here and returns one context per point (see Editor::add_context), an empty vector keeps
+    // the current context.
     virtual std::vector<int>
-    generate_instructions(std::vector<Instruction> &instructions, int &current_register, std::map<int, double> &constants) = 0;
+    generate_domains(std::vector<Instruction> &instructions, int &current_register, std::map<int, double> &constants) {
+        return {};
+    }
+
+    // Called by Editor::generate_program for every node of the graph before anything is lowered, nodes can
+    // update caches here that need programs of their own
+    virtual void prepare() {}
+
+    // Whether generate_program lowers the inputs of the node into the program
+    virtual bool evaluates_inputs() const { return true; }
+
+    // Hash of the node type and its parameters, the inputs are combined by the editor
+    size_t parameter_hash() const;
+
+protected:
+    // Mix all parameters that influence the generated instructions into seed
+    virtual void hash_parameters(size_t &seed) const {}
 };
 
+// Node 0 is the output that is meshed. Further output nodes are evaluated by the same kernel and either
+// meshed as separate surfaces or sampled at the vertices as a field, e.g. a material id.
 class OutputNode : public Node {
 public:
     constexpr static Type InputType[] = {Type::Scalar};
+    bool m_surface = true;
+    char m_name[32] = "field";
 
     OutputNode(Editor *editor, int node_id) : Node(editor, node_id, 1) {
         m_output_type = Type::None;
@@ -45,8 +85,12 @@ public:
 
     void draw() override;
 
-    std::vector<int>
-    generate_instructions(std::vector<Instruction> &instructions, int &current_register, std::map<int, double> &constants) override;
+    const char *title() const override { return "Output"; }
+
+    void generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                               std::map<int, double> &constants, std::vector<int> &registers) override;
+
+    void hash_parameters(size_t &seed) const override;
 };
 
 class SphereNode : public Node {
@@ -62,8 +106,12 @@ public:
 
     void draw() override;
 
-    std::vector<int>
-    generate_instructions(std::vector<Instruction> &instructions, int &current_register, std::map<int, double> &constants) override;
+    const char *title() const override { return "Sphere"; }
+
+    void generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                               std::map<int, double> &constants, std::vector<int> &registers) override;
+
+    void hash_parameters(size_t &seed) const override;
 };
 
 class TorusNode : public Node {
@@ -79,8 +127,12 @@ public:
 
     void draw() override;
 
-    std::vector<int>
-    generate_instructions(std::vector<Instruction> &instructions, int &current_register, std::map<int, double> &constants) override;
+    const char *title() const override { return "Torus"; }
+
+    void generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                               std::map<int, double> &constants, std::vector<int> &registers) override;
+
+    void hash_parameters(size_t &seed) const override;
 };
 
 class BoxNode : public Node {
@@ -95,8 +147,12 @@ public:
 
     void draw() override;
 
-    std::vector<int>
-    generate_instructions(std::vector<Instruction> &instructions, int &current_register, std::map<int, double> &constants) override;
+    const char *title() const override { return "Box"; }
+
+    void generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                               std::map<int, double> &constants, std::vector<int> &registers) override;
+
+    void hash_parameters(size_t &seed) const override;
 };
 
 class CylinderNode : public Node {
@@ -112,8 +168,12 @@ public:
 
     void draw() override;
 
-    std::vector<int>
-    generate_instructions(std::vector<Instruction> &instructions, int &current_register, std::map<int, double> &constants) override;
+    const char *title() const override { return "Cylinder"; }
+
+    void generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                               std::map<int, double> &constants, std::vector<int> &registers) override;
+
+    void hash_parameters(size_t &seed) const override;
 };
 
 class ScalarNode : public Node {
@@ -127,8 +187,12 @@ public:
 
     void draw() override;
 
-    std::vector<int>
-    generate_instructions(std::vector<Instruction> &instructions, int &current_register, std::map<int, double> &constants) override;
+    const char *title() const override { return "Scalar"; }
+
+    void generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                               std::map<int, double> &constants, std::vector<int> &registers) override;
+
+    void hash_parameters(size_t &seed) const override;
 };
 
 class PointNode : public Node {
@@ -142,8 +206,12 @@ public:
 
     void draw() override;
 
-    std::vector<int>
-    generate_instructions(std::vector<Instruction> &instructions, int &current_register, std::map<int, double> &constants) override;
+    const char *title() const override { return "Point"; }
+
+    void generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                               std::map<int, double> &constants, std::vector<int> &registers) override;
+
+    void hash_parameters(size_t &seed) const override;
 };
 
 class TimeNode : public Node {
@@ -155,8 +223,10 @@ public:
 
     void draw() override;
 
-    std::vector<int>
-    generate_instructions(std::vector<Instruction> &instructions, int &current_register, std::map<int, double> &constants) override;
+    const char *title() const override { return "Time"; }
+
+    void generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                               std::map<int, double> &constants, std::vector<int> &registers) override;
 };
 
 class UnionNode : public Node {
@@ -168,8 +238,10 @@ public:
 
     void draw() override;
 
-    std::vector<int>
-    generate_instructions(std::vector<Instruction> &instructions, int &current_register, std::map<int, double> &constants) override;
+    const char *title() const override { return "Union"; }
+
+    void generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                               std::map<int, double> &constants, std::vector<int> &registers) override;
 };
 
 class SmoothUnionNode : public Node {
@@ -183,8 +255,12 @@ public:
 
     void draw() override;
 
-    std::vector<int>
-    generate_instructions(std::vector<Instruction> &instructions, int &current_register, std::map<int, double> &constants) override;
+    const char *title() const override { return "Smooth Union"; }
+
+    void generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                               std::map<int, double> &constants, std::vector<int> &registers) override;
+
+    void hash_parameters(size_t &seed) const override;
 };
 
 class UnaryOpNode : public Node {
@@ -199,7 +275,123 @@ public:
 
     void draw() override;
 
+    const char *title() const override { return return_op_name(m_op); }
+
+    void generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                               std::map<int, double> &constants, std::vector<int> &registers) override;
+
+    void hash_parameters(size_t &seed) const override;
+};
+
+// Repeats its input in a grid or around the y axis by folding the point into a single cell, so the cost doesn't
+// depend on the number of copies. The distance is only exact if the shape stays inside its cell, with
+// m_neighbors the closest neighboring cells are evaluated as well which keeps it correct for shapes reaching
+// into the adjacent cell.
+class RepeatNode : public Node {
+public:
+    constexpr static Type InputType[] = {Type::Scalar};
+    enum Mode {
+        Grid = 0,
+        Radial = 1
+    };
+    int m_mode = Grid;
+    glm::vec3 m_spacing = {0.5, 0.5, 0.5};
+    // Number of copies along each axis starting at the origin, 0 repeats infinitely
+    glm::ivec3 m_count = {4, 1, 1};
+    // Number of copies around the y axis
+    int m_radial_count = 8;
+    bool m_neighbors = true;
+
+    RepeatNode(Editor *editor, int node_id) : Node(editor, node_id, 1) {
+        m_output_type = Type::Scalar;
+    }
+
+    void draw() override;
+
+    const char *title() const override { return "Repeat"; }
+
     std::vector<int>
-    generate_instructions(std::vector<Instruction> &instructions, int &current_register, std::map<int, double> &constants) override;
+    generate_domains(std::vector<Instruction> &instructions, int &current_register, std::map<int, double> &constants) override;
+
+    void generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                               std::map<int, double> &constants, std::vector<int> &registers) override;
+
+    void hash_parameters(size_t &seed) const override;
+};
+
+// Union of many spheres and boxes placed randomly or read from a file, boxes can be rotated. The instances are
+// stored in a BVH which is baked into the kernel, so the cost per sample grows logarithmically with the number of
+// instances.
+class ScatterNode : public Node {
+public:
+    constexpr static Type InputType[] = {};
+    int m_count = 1000;
+    int m_seed = 1;
+    glm::vec3 m_extent = {1, 1, 1};
+    float m_min_size = 0.02;
+    float m_max_size = 0.06;
+    // 0: spheres, 1: boxes, 2: both
+    int m_primitives = 0;
+    // Random boxes get a random orientation
+    bool m_rotated = false;
+    // Instances read from a file replace the random ones
+    char m_path[256] = "instances.txt";
+    std::vector<ScatterInstance> m_file_instances;
+    bool m_from_file = false;
+
+    ScatterNode(Editor *editor, int node_id) : Node(editor, node_id, 0) {
+        m_output_type = Type::Scalar;
+    }
+
+    void draw() override;
+
+    const char *title() const override { return "Scatter"; }
+
+    void generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                               std::map<int, double> &constants, std::vector<int> &registers) override;
+
+    void hash_parameters(size_t &seed) const override;
+
+private:
+    // The set is rebuilt only if the parameters changed
+    std::shared_ptr<const ScatterSet> m_set;
+    size_t m_set_hash = 0;
+    size_t m_file_hash = 0;
 };
 
+// Samples its input once into a sparse volume and replaces it with a trilinear lookup, so an expensive subgraph
+// that doesn't change isn't evaluated again at every sample. The volume is baked again whenever the parameters
+// or the input subgraph change. Outside of the bounds the distance to the bounds is added to the closest value.
+class BakeNode : public Node {
+public:
+    constexpr static Type InputType[] = {Type::Scalar};
+    glm::vec3 m_lower = {-1, -1, -1};
+    glm::vec3 m_upper = {1, 1, 1};
+    // Cells along each axis, rounded up to whole bricks
+    int m_resolution = 64;
+    // Width of the stored band around the surface in cells
+    float m_band = 2;
+
+    BakeNode(Editor *editor, int node_id) : Node(editor, node_id, 1) {
+        m_output_type = Type::Scalar;
+    }
+
+    void draw() override;
+
+    const char *title() const override { return "Bake"; }
+
+    void prepare() override;
+
+    bool evaluates_inputs() const override { return false; }
+
+    void generate_instructions(std::vector<Instruction> &instructions, int &current_register,
+                               std::map<int, double> &constants, std::vector<int> &registers) override;
+
+    void hash_parameters(size_t &seed) const override;
+
+private:
+    std::shared_ptr<const SparseVolume> m_volume;
+    size_t m_volume_hash = 0;
+    // Set while the input is baked, a bake node reached again depends on itself
+    bool m_baking = false;
+};
@@ -0,0 +1,43 @@
+//
+// Created by elisabeth on 12.03.24.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Number of threads parallel_for runs count iterations on, at most one per core
+inline int parallel_thread_count(int count) {
+    return std::min(count, std::max(1, (int) std::thread::hardware_concurrency()));
+}
+
+// Run body(state, i) for i < count on all cores, the calling thread works as well. Every thread creates its own
+// state with make_state() before taking indices, which are handed out one at a time in increasing order.
+template<class MakeState, class Body>
+void parallel_for(int count, MakeState make_state, Body body) {
+    std::atomic<int> next{0};
+    auto worker = [&]() {
+        auto state = make_state();
+        for (int i = next++; i < count; i = next++) {
+            body(state, i);
+        }
+    };
+    int num_threads = parallel_thread_count(count);
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread: threads) {
+        thread.join();
+    }
+}
+
+// Run body(i) for i < count on all cores
+template<class Body>
+void parallel_for(int count, Body body) {
+    parallel_for(count, []() { return 0; }, [&](int, int i) { body(i); });
+}
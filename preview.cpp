@@ -0,0 +1,151 @@
+//
+// Created by elisabeth on 02.03.24.
+//
+
+#include "preview.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <glm/glm.hpp>
+
+// Number of rays traced together, the batch function is called with all rays of a packet that are still active
+constexpr int PACKET_SIZE = 64;
+
+// Rays start at the meshing domain and stop when they leave it
+constexpr double DOMAIN_EXTENT = 3.0;
+
+// Step size of the central differences used for the normals
+constexpr double GRADIENT_STEP = 1e-4;
+
+// Structure of arrays of the rays of a packet and the points evaluated by the kernel
+struct Packet {
+    std::array<glm::dvec3, PACKET_SIZE> direction;
+    std::array<double, PACKET_SIZE> t;
+    std::array<double, PACKET_SIZE> t_far;
+    std::array<bool, PACKET_SIZE> hit;
+    // indices of the rays that are still marching
+    std::array<int, PACKET_SIZE> active;
+
+    // six points per ray for the central differences
+    std::array<double, 6 * PACKET_SIZE> x;
+    std::array<double, 6 * PACKET_SIZE> y;
+    std::array<double, 6 * PACKET_SIZE> z;
+    std::array<double, 6 * PACKET_SIZE> values;
+};
+
+// Intersect the ray with the domain, returns false if the ray misses it
+static bool intersect_domain(glm::dvec3 origin, glm::dvec3 direction, double &t_near, double &t_far) {
+    glm::dvec3 inverse = 1.0 / direction;
+    glm::dvec3 t0 = (glm::dvec3(-DOMAIN_EXTENT) - origin) * inverse;
+    glm::dvec3 t1 = (glm::dvec3(DOMAIN_EXTENT) - origin) * inverse;
+    glm::dvec3 lower = glm::min(t0, t1);
+    glm::dvec3 upper = glm::max(t0, t1);
+    t_near = std::max({lower.x, lower.y, lower.z, 0.0});
+    t_far = std::min({upper.x, upper.y, upper.z});
+    return t_near <= t_far;
+}
+
+static void write_pixel(std::vector<unsigned char> &image, int pixel, glm::dvec3 color) {
+    color = glm::clamp(color, 0.0, 1.0);
+    image[4 * pixel + 0] = (unsigned char) std::lround(color.x * 255.0);
+    image[4 * pixel + 1] = (unsigned char) std::lround(color.y * 255.0);
+    image[4 * pixel + 2] = (unsigned char) std::lround(color.z * 255.0);
+    image[4 * pixel + 3] = 255;
+}
+
+void PreviewRenderer::render(const Kernel &kernel, double time, const PreviewCamera &camera, int width, int height) {
+    m_width = std::max(1, width);
+    m_height = std::max(1, height);
+    m_image.resize(4 * (size_t) m_width * m_height);
+
+    double tan_half_fov = std::tan(glm::radians(camera.fov) / 2.0);
+    double aspect = (double) m_width / m_height;
+    int pixel_count = m_width * m_height;
+    int packet_count = (pixel_count + PACKET_SIZE - 1) / PACKET_SIZE;
+    const glm::dvec3 background(0.18, 0.18, 0.2);
+    const glm::dvec3 base_color(0.85, 0.7, 0.5);
+
+    // Packets are consecutive pixels of a row, such that the rays of a packet are coherent
+    parallel_for(packet_count, []() { return Packet(); }, [&](Packet &packet, int p) {
+        int first = p * PACKET_SIZE;
+        int count = std::min(PACKET_SIZE, pixel_count - first);
+
+        // Set up the rays and clip them against the domain
+        int active_count = 0;
+        for (int i = 0; i < count; ++i) {
+            int pixel = first + i;
+            double u = (2.0 * (pixel % m_width + 0.5) / m_width - 1.0) * tan_half_fov * aspect;
+            double v = (1.0 - 2.0 * (pixel / m_width + 0.5) / m_height) * tan_half_fov;
+            packet.direction[i] = glm::normalize(camera.look + u * camera.right + v * camera.up);
+            packet.hit[i] = false;
+            if (intersect_domain(camera.position, packet.direction[i], packet.t[i], packet.t_far[i])) {
+                packet.active[active_count++] = i;
+            }
+        }
+
+        // March all active rays at once and drop the rays that hit the surface or left the domain
+        for (int step = 0; step < m_max_steps && active_count > 0; ++step) {
+            for (int j = 0; j < active_count; ++j) {
+                int i = packet.active[j];
+                glm::dvec3 point = camera.position + packet.t[i] * packet.direction[i];
+                packet.x[j] = point.x;
+                packet.y[j] = point.y;
+                packet.z[j] = point.z;
+            }
+            kernel.batch(packet.x.data(), packet.y.data(), packet.z.data(), time, packet.values.data(), active_count);
+            int remaining = 0;
+            for (int j = 0; j < active_count; ++j) {
+                int i = packet.active[j];
+                double distance = packet.values[j];
+                // negative values mean that the ray started inside or stepped over a thin feature
+                if (distance < m_epsilon * std::max(packet.t[i], 1.0)) {
+                    packet.hit[i] = true;
+                    continue;
+                }
+                packet.t[i] += distance;
+                if (packet.t[i] <= packet.t_far[i]) {
+                    packet.active[remaining++] = i;
+                }
+            }
+            active_count = remaining;
+        }
+
+        // Evaluate the central differences at all hits with a single batch
+        int hit_count = 0;
+        for (int i = 0; i < count; ++i) {
+            if (!packet.hit[i]) {
+                write_pixel(m_image, first + i, background);
+                continue;
+            }
+            glm::dvec3 point = camera.position + packet.t[i] * packet.direction[i];
+            for (int axis = 0; axis < 3; ++axis) {
+                for (int side = 0; side < 2; ++side) {
+                    glm::dvec3 offset(0.0);
+                    offset[axis] = side == 0 ? GRADIENT_STEP : -GRADIENT_STEP;
+                    int k = 6 * hit_count + 2 * axis + side;
+                    packet.x[k] = point.x + offset.x;
+                    packet.y[k] = point.y + offset.y;
+                    packet.z[k] = point.z + offset.z;
+                }
+            }
+            packet.active[hit_count++] = i;
+        }
+        if (hit_count == 0) {
+            return;
+        }
+        kernel.batch(packet.x.data(), packet.y.data(), packet.z.data(), time, packet.values.data(), 6 * hit_count);
+
+        // Head light with a small ambient term
+        for (int j = 0; j < hit_count; ++j) {
+            int i = packet.active[j];
+            const double *values = packet.values.data() + 6 * j;
+            glm::dvec3 gradient(values[0] - values[1], values[2] - values[3], values[4] - values[5]);
+            double length = glm::length(gradient);
+            glm::dvec3 normal = length > 0.0 ? gradient / length : -packet.direction[i];
+            double diffuse = std::abs(glm::dot(normal, packet.direction[i]));
+            write_pixel(m_image, first + i, base_color * (0.15 + 0.85 * diffuse));
+        }
+    });
+}
@@ -0,0 +1,46 @@
+//
+// Created by elisabeth on 02.03.24.
+//
+
+#pragma once
+
+#include <vector>
+#include <glm/vec3.hpp>
+
+#include "compiler.h"
+
+// Pinhole camera of the preview, the directions are normalized and fov is the vertical field of view in degrees
+struct PreviewCamera {
+    glm::dvec3 position;
+    glm::dvec3 look;
+    glm::dvec3 up;
+    glm::dvec3 right;
+    double fov = 45.0;
+
+    bool operator==(const PreviewCamera &other) const = default;
+};
+
+// Renders the zero level set of a compiled kernel by sphere tracing, without meshing. The image is split into
+// packets of neighbouring rays that are distributed over all cores. Every step of a packet evaluates the
+// remaining rays with a single call of the vectorized batch function, hits are shaded with the gradient.
+class PreviewRenderer {
+public:
+    // Trace the meshing domain [-3, 3]^3 into a width x height RGBA8 image, the first row is the top row
+    void render(const Kernel &kernel, double time, const PreviewCamera &camera, int width, int height);
+
+    const std::vector<unsigned char> &image() const { return m_image; }
+
+    int width() const { return m_width; }
+
+    int height() const { return m_height; }
+
+    // Rays that haven't hit the surface after this many steps are treated as misses
+    int m_max_steps = 128;
+    // A ray hits the surface once the distance is below epsilon times the distance travelled
+    double m_epsilon = 2e-4;
+
+private:
+    std::vector<unsigned char> m_image;
+    int m_width = 0;
+    int m_height = 0;
+};
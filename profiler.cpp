@@ -0,0 +1,165 @@
+//
+// Created by elisabeth on 11.03.24.
+//
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+
+// Number of sampled points the kernel is timed at
+constexpr size_t TIMING_SAMPLES = 1 << 16;
+
+// Rough cost of an instruction in additions. Vector operations count every component.
+static double instruction_cost(const Instruction &instr, const Program &program, TrigAccuracy accuracy) {
+    double lanes = instr.type == ValueType::Vec3 ? 3.0 : instr.type == ValueType::Vec2 ? 2.0 : 1.0;
+    switch (instr.operation) {
+        case Operation::Div:
+            return 4.0 * lanes;
+        case Operation::Sqrt:
+            return 6.0 * lanes;
+        case Operation::Sin:
+        case Operation::Cos:
+            return (accuracy == TrigAccuracy::Libm ? 40.0 : accuracy == TrigAccuracy::Precise ? 20.0 : 10.0) * lanes;
+        case Operation::Atan2:
+            return 40.0;
+        case Operation::Dot:
+            return 2.0 * lanes;
+        case Operation::Length:
+            return 2.0 * lanes + 6.0;
+        case Operation::Scatter: {
+            // a traversal visits a few leaves per level of the BVH
+            size_t count = program.scatters[instr.data]->instances.size();
+            return 30.0 * (std::log2((double) std::max<size_t>(count, 1)) + 1.0);
+        }
+        case Operation::Volume:
+            return 25.0;
+        case Operation::Pack:
+        case Operation::Splat:
+        case Operation::ExtractX:
+        case Operation::ExtractY:
+        case Operation::ExtractZ:
+            return 0.5;
+        default:
+            return lanes;
+    }
+}
+
+GraphProfile profile_program(const Program &program, const MeshingOptions &options, TrigAccuracy accuracy,
+                             double time) {
+    if (program.sources.size() != program.instructions.size()) {
+        throw std::runtime_error("The program doesn't record the nodes of its instructions");
+    }
+    Kernel kernel = compile_kernel(program, accuracy);
+    GraphProfile profile;
+
+    // Time a regular remesh first, the counting evaluator below is slower
+    MeshingContext context;
+    QuadMesh mesh;
+    auto start = std::chrono::steady_clock::now();
+    mesh_generator(context, KernelEvaluator{kernel.eval, time}, options, mesh);
+    profile.remesh_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Count the kernel calls of the same remesh and keep some of the points for timing
+    std::vector<glm::dvec3> points;
+    points.reserve(TIMING_SAMPLES);
+    int64_t calls = 0;
+    std::function<double(glm::dvec3)> counting = [&](glm::dvec3 p) {
+        // later points overwrite earlier ones, such that all stages of the mesher are represented
+        if (points.size() < TIMING_SAMPLES) {
+            points.push_back(p);
+        } else if (calls % 64 == 0) {
+            points[calls / 64 % TIMING_SAMPLES] = p;
+        }
+        calls++;
+        return kernel.eval(p.x, p.y, p.z, time);
+    };
+    mesh_generator(context, counting, options, mesh);
+    profile.kernel_calls = calls;
+
+    volatile double sink = 0.0;
+    if (!points.empty()) {
+        start = std::chrono::steady_clock::now();
+        for (glm::dvec3 p: points) {
+            sink = sink + kernel.eval(p.x, p.y, p.z, time);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        profile.kernel_seconds = std::min(profile.remesh_seconds, seconds / (double) points.size() * (double) calls);
+    }
+
+    // Time the nodes at the same points, the counters of every node hold the overhead of timing its runs
+    ProfilingKernel profiling = compile_profiling_kernel(program, accuracy);
+    for (glm::dvec3 p: points) {
+        sink = sink + profiling.eval(p.x, p.y, p.z, time);
+    }
+    std::map<int, double> cycles;
+    double total_cycles = 0.0;
+    if (!points.empty()) {
+        double overhead = (double) profiling.cycles[profiling.nodes.size()];
+        for (size_t k = 0; k < profiling.nodes.size(); ++k) {
+            double node_cycles = std::max(0.0, (double) profiling.cycles[k] - profiling.runs[k] * overhead);
+            cycles[profiling.nodes[k]] = node_cycles / (double) points.size();
+            total_cycles += node_cycles / (double) points.size();
+        }
+    }
+
+    // Attribute the instructions of the main output to their nodes
+    std::vector<bool> live = live_instructions(program, {program.output});
+    std::map<int, NodeProfile> nodes;
+    std::map<int, std::set<int>> contexts;
+    double total_cost = 0.0;
+    for (size_t i = 0; i < program.instructions.size(); ++i) {
+        if (!live[i]) {
+            continue;
+        }
+        const InstructionSource &source = program.sources[i];
+        NodeProfile &node = nodes[source.node_id];
+        node.node_id = source.node_id;
+        node.instructions++;
+        double cost = instruction_cost(program.instructions[i], program, accuracy);
+        node.cost += cost;
+        total_cost += cost;
+        contexts[source.node_id].insert(source.context);
+    }
+    double kernel_share = profile.remesh_seconds > 0.0 ? profile.kernel_seconds / profile.remesh_seconds : 0.0;
+    for (auto &element: nodes) {
+        NodeProfile &node = element.second;
+        node.contexts = (int) contexts[node.node_id].size();
+        node.evaluations = calls * node.contexts;
+        node.cycles = cycles[node.node_id];
+        if (total_cycles > 0.0) {
+            node.time_share = kernel_share * node.cycles / total_cycles;
+        } else {
+            node.time_share = total_cost > 0.0 ? kernel_share * node.cost / total_cost : 0.0;
+        }
+        profile.nodes.push_back(node);
+    }
+    std::sort(profile.nodes.begin(), profile.nodes.end(), [](const NodeProfile &a, const NodeProfile &b) {
+        return a.time_share > b.time_share;
+    });
+    return profile;
+}
+
+void write_profile(const GraphProfile &profile, const std::string &path) {
+    std::unique_ptr<FILE, int (*)(FILE *)> file(fopen(path.c_str(), "w"), &fclose);
+    if (!file) {
+        throw std::runtime_error("Could not open " + path);
+    }
+    fprintf(file.get(), "# kernel calls %lld, remesh %.6f s, kernel %.6f s\n", (long long) profile.kernel_calls,
+            profile.remesh_seconds, profile.kernel_seconds);
+    fprintf(file.get(), "node_id,name,instructions,contexts,evaluations,cost,cycles,time_share\n");
+    for (const NodeProfile &node: profile.nodes) {
+        fprintf(file.get(), "%d,\"%s\",%d,%d,%lld,%.1f,%.1f,%.6f\n", node.node_id, node.name.c_str(),
+                node.instructions, node.contexts, (long long) node.evaluations, node.cost, node.cycles,
+                node.time_share);
+    }
+    if (fflush(file.get()) != 0) {
+        throw std::runtime_error("Could not write " + path);
+    }
+}
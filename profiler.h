@@ -0,0 +1,53 @@
+//
+// Created by elisabeth on 11.03.24.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "compiler.h"
+#include "implicit_meshing.h"
+
+// Cost of the instructions a single node of the graph contributes to the kernel
+struct NodeProfile {
+    int node_id = -1;
+    // Title of the node, filled in by the editor
+    std::string name;
+    // Instructions of the node the meshed output depends on, summed over all contexts
+    int instructions = 0;
+    // Number of point contexts the node was lowered in, e.g. the cells of a Repeat node
+    int contexts = 0;
+    // How often the instructions of the node were run during the remesh: kernel calls times contexts
+    int64_t evaluations = 0;
+    // Estimated cost of the node per kernel call, in units of an addition
+    double cost = 0.0;
+    // Measured cycles of the node per kernel call, without the overhead of the timing
+    double cycles = 0.0;
+    // Share of the remesh time spent in the node
+    double time_share = 0.0;
+};
+
+struct GraphProfile {
+    // Nodes with live instructions, most expensive first
+    std::vector<NodeProfile> nodes;
+    // Kernel calls of the remesh, i.e. the samples left after culling plus root finding and gradients
+    int64_t kernel_calls = 0;
+    double remesh_seconds = 0.0;
+    // Time of the kernel calls, estimated from timing the kernel at the points the remesh sampled
+    double kernel_seconds = 0.0;
+    // Value of Editor::output_hash for the profiled graph
+    size_t graph_hash = 0;
+};
+
+// Compile the program, mesh it once with the options and attribute the kernel time to the nodes in
+// program.sources. The time share of a node is its share of the cycles measured by compile_profiling_kernel at
+// points of the remesh, scaled by the fraction of the remesh spent in the kernel. Without a cycle counter the
+// share of the summed instruction cost estimates is used instead. Only the main output is profiled.
+GraphProfile profile_program(const Program &program, const MeshingOptions &options, TrigAccuracy accuracy,
+                             double time = 0.0);
+
+// Write the profile as CSV with one line per node, throws std::runtime_error if the file can't be written
+void write_profile(const GraphProfile &profile, const std::string &path);
@@ -0,0 +1,166 @@
+//
+// Created by elisabeth on 24.02.24.
+//
+
+#include "scatter.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <stdexcept>
+#include <limits>
+
+// Rotation matrix of the quaternion w + xi + yj + zk, which is normalized first
+static glm::dmat3 quaternion_rotation(double w, double x, double y, double z) {
+    double norm = std::sqrt(w * w + x * x + y * y + z * z);
+    w /= norm;
+    x /= norm;
+    y /= norm;
+    z /= norm;
+    glm::dmat3 rotation;
+    rotation[0] = {1.0 - 2.0 * (y * y + z * z), 2.0 * (x * y + w * z), 2.0 * (x * z - w * y)};
+    rotation[1] = {2.0 * (x * y - w * z), 1.0 - 2.0 * (x * x + z * z), 2.0 * (y * z + w * x)};
+    rotation[2] = {2.0 * (x * z + w * y), 2.0 * (y * z - w * x), 1.0 - 2.0 * (x * x + y * y)};
+    return rotation;
+}
+
+// Half extents of the axis aligned bounding box of the instance around its position
+static glm::dvec3 instance_extent(const ScatterInstance &instance) {
+    if (instance.primitive == ScatterPrimitive::Sphere) {
+        return glm::dvec3(instance.size.x);
+    }
+    glm::dvec3 extent(0.0);
+    for (int axis = 0; axis < 3; ++axis) {
+        extent += glm::abs(instance.rotation[axis]) * instance.size[axis];
+    }
+    return extent;
+}
+
+ScatterSet build_scatter_set(std::vector<ScatterInstance> instances, int max_leaf_size) {
+    ScatterSet set;
+    set.instances = std::move(instances);
+    if (set.instances.empty()) {
+        return set;
+    }
+    set.nodes.reserve(2 * set.instances.size() / max_leaf_size + 1);
+    set.nodes.push_back({});
+
+    // (node, begin, end) ranges that still have to be split, children are stored next to each other
+    struct Range {
+        int node;
+        int begin;
+        int end;
+    };
+    std::vector<Range> stack = {{0, 0, (int) set.instances.size()}};
+    while (!stack.empty()) {
+        Range range = stack.back();
+        stack.pop_back();
+        glm::dvec3 lower(std::numeric_limits<double>::max());
+        glm::dvec3 upper(-std::numeric_limits<double>::max());
+        glm::dvec3 center_lower = lower;
+        glm::dvec3 center_upper = upper;
+        for (int i = range.begin; i < range.end; ++i) {
+            const ScatterInstance &instance = set.instances[i];
+            lower = glm::min(lower, instance.position - instance_extent(instance));
+            upper = glm::max(upper, instance.position + instance_extent(instance));
+            center_lower = glm::min(center_lower, instance.position);
+            center_upper = glm::max(center_upper, instance.position);
+        }
+        BVHNode &node = set.nodes[range.node];
+        node.lower = lower;
+        node.upper = upper;
+        if (range.end - range.begin <= max_leaf_size) {
+            node.first = range.begin;
+            node.count = range.end - range.begin;
+            continue;
+        }
+        glm::dvec3 diagonal = center_upper - center_lower;
+        int axis = diagonal.x >= diagonal.y && diagonal.x >= diagonal.z ? 0 : (diagonal.y >= diagonal.z ? 1 : 2);
+        int middle = (range.begin + range.end) / 2;
+        std::nth_element(set.instances.begin() + range.begin, set.instances.begin() + middle,
+                         set.instances.begin() + range.end, [axis](const auto &a, const auto &b) {
+                    return a.position[axis] < b.position[axis];
+                });
+        int left = (int) set.nodes.size();
+        node.first = left;
+        node.count = 0;
+        // node is invalidated here
+        set.nodes.emplace_back();
+        set.nodes.emplace_back();
+        stack.push_back({left, range.begin, middle});
+        stack.push_back({left + 1, middle, range.end});
+    }
+    return set;
+}
+
+std::vector<ScatterInstance> random_instances(int count, unsigned seed, glm::dvec3 extent, double min_size,
+                                              double max_size, bool spheres, bool boxes, bool rotated) {
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::vector<ScatterInstance> instances(count);
+    for (auto &instance: instances) {
+        bool sphere = spheres && (!boxes || unit(generator) < 0.5);
+        instance.primitive = sphere ? ScatterPrimitive::Sphere : ScatterPrimitive::Box;
+        instance.position = glm::dvec3(unit(generator), unit(generator), unit(generator)) * 2.0 * extent - extent;
+        for (int i = 0; i < 3; ++i) {
+            instance.size[i] = min_size + (max_size - min_size) * unit(generator);
+        }
+        if (rotated && !sphere) {
+            // uniformly distributed unit quaternion
+            double u1 = unit(generator);
+            double u2 = 2.0 * M_PI * unit(generator);
+            double u3 = 2.0 * M_PI * unit(generator);
+            instance.rotation = quaternion_rotation(std::sqrt(u1) * std::cos(u3), std::sqrt(1.0 - u1) * std::sin(u2),
+                                                    std::sqrt(1.0 - u1) * std::cos(u2), std::sqrt(u1) * std::sin(u3));
+        }
+    }
+    return instances;
+}
+
+std::vector<ScatterInstance> read_instances(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Could not open " + path);
+    }
+    std::vector<ScatterInstance> instances;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream stream(line);
+        std::string type;
+        if (!(stream >> type) || type[0] == '#') {
+            continue;
+        }
+        ScatterInstance instance{};
+        stream >> instance.position.x >> instance.position.y >> instance.position.z;
+        if (type == "sphere") {
+            instance.primitive = ScatterPrimitive::Sphere;
+            stream >> instance.size.x;
+        } else if (type == "box") {
+            instance.primitive = ScatterPrimitive::Box;
+            stream >> instance.size.x >> instance.size.y >> instance.size.z;
+        } else {
+            throw std::runtime_error("Unknown primitive " + type + " in " + path);
+        }
+        auto parse_error = [&]() {
+            return std::runtime_error("Could not parse line \"" + line + "\" in " + path);
+        };
+        if (!stream) {
+            throw parse_error();
+        }
+        // optional rotation
+        double w, x, y, z;
+        if (stream >> w) {
+            if (!(stream >> x >> y >> z) || w * w + x * x + y * y + z * z == 0.0) {
+                throw parse_error();
+            }
+            instance.rotation = quaternion_rotation(w, x, y, z);
+        } else if (!stream.eof()) {
+            throw parse_error();
+        }
+        instances.push_back(instance);
+    }
+    return instances;
+}
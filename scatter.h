@@ -0,0 +1,55 @@
+//
+// Created by elisabeth on 24.02.24.
+//
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <glm/vec3.hpp>
+#include <glm/mat3x3.hpp>
+
+enum class ScatterPrimitive {
+    Sphere = 0,
+    Box = 1
+};
+
+// Primitive placed at position and rotated around it, it is evaluated at transpose(rotation) * (p - position).
+// Boxes are scaled non-uniformly by their half extents, spheres only have a radius since a stretched sphere
+// wouldn't be a distance field.
+struct ScatterInstance {
+    ScatterPrimitive primitive;
+    glm::dvec3 position;
+    // radius of a sphere in x, half extents of a box
+    glm::dvec3 size;
+    glm::dmat3 rotation{1.0};
+};
+
+// Node of a bounding volume hierarchy. Inner nodes have count == 0 and their children at first and first + 1,
+// leaves contain the instances first, ..., first + count - 1.
+struct BVHNode {
+    glm::dvec3 lower;
+    glm::dvec3 upper;
+    int first;
+    int count;
+};
+
+// Instances sorted into the order of the BVH leaves, nodes[0] is the root
+struct ScatterSet {
+    std::vector<ScatterInstance> instances;
+    std::vector<BVHNode> nodes;
+};
+
+// Build a BVH by splitting the instance centers at the median of the longest axis until at most
+// max_leaf_size instances are left
+ScatterSet build_scatter_set(std::vector<ScatterInstance> instances, int max_leaf_size = 4);
+
+// Random instances inside the box [-extent, extent] with sizes in [min_size, max_size], boxes get a random
+// orientation if rotated is set
+std::vector<ScatterInstance> random_instances(int count, unsigned seed, glm::dvec3 extent, double min_size,
+                                              double max_size, bool spheres, bool boxes, bool rotated = false);
+
+// Read instances from a text file with one "sphere x y z r" or "box x y z hx hy hz" line per instance. A line
+// may end with the rotation as a quaternion "qw qx qy qz", which is normalized. Throws std::runtime_error if the
+// file can't be read.
+std::vector<ScatterInstance> read_instances(const std::string &path);
@@ -0,0 +1,306 @@
+//
+// Created by elisabeth on 05.03.24.
+//
+
+#include "tiled_meshing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+constexpr char TILE_JOB_MAGIC[4] = {'R', 'K', 'T', 'J'};
+constexpr char MESH_TILE_MAGIC[4] = {'R', 'K', 'M', 'T'};
+constexpr uint32_t TILE_VERSION = 1;
+
+using FilePointer = std::unique_ptr<FILE, int (*)(FILE *)>;
+
+static FilePointer open_file(const std::string &path, const char *mode) {
+    FilePointer file(fopen(path.c_str(), mode), &fclose);
+    if (!file) {
+        throw std::runtime_error("Could not open " + path);
+    }
+    return file;
+}
+
+static void write_data(FILE *file, const void *data, size_t size, const std::string &path) {
+    if (size != 0 && fwrite(data, 1, size, file) != size) {
+        throw std::runtime_error("Could not write " + path);
+    }
+}
+
+static void read_data(FILE *file, void *data, size_t size, const std::string &path) {
+    if (size != 0 && fread(data, 1, size, file) != size) {
+        throw std::runtime_error("Unexpected end of " + path);
+    }
+}
+
+static void write_header(FILE *file, const char (&magic)[4], const std::string &path) {
+    write_data(file, magic, 4, path);
+    write_data(file, &TILE_VERSION, sizeof(TILE_VERSION), path);
+}
+
+static void read_header(FILE *file, const char (&magic)[4], const std::string &path) {
+    char file_magic[4];
+    uint32_t version;
+    read_data(file, file_magic, 4, path);
+    read_data(file, &version, sizeof(version), path);
+    if (std::string(file_magic, 4) != std::string(magic, 4) || version != TILE_VERSION) {
+        throw std::runtime_error(path + " has an unexpected format");
+    }
+}
+
+void write_tile_job(const TileJob &job, const std::string &path) {
+    FilePointer file = open_file(path, "wb");
+    auto write = [&](const auto &value) { write_data(file.get(), &value, sizeof(value), path); };
+    const MeshingOptions &options = job.options;
+    write_header(file.get(), TILE_JOB_MAGIC, path);
+    for (int axis = 0; axis < 3; ++axis) {
+        write(options.lower[axis]);
+        write(options.upper[axis]);
+        write((int32_t) options.resolution[axis]);
+        write((int32_t) job.lower[axis]);
+        write((int32_t) job.upper[axis]);
+    }
+    write((int32_t) options.mode);
+    write(options.culling_factor);
+    write((int32_t) options.root_iterations);
+    write(options.root_tolerance);
+    write(options.gradient_step);
+    write(options.position_sigma);
+    write(options.normal_sigma);
+    write((int32_t) job.accuracy);
+    write(job.time);
+    if (fflush(file.get()) != 0) {
+        throw std::runtime_error("Could not write " + path);
+    }
+}
+
+TileJob read_tile_job(const std::string &path) {
+    FilePointer file = open_file(path, "rb");
+    auto read = [&](auto &value) { read_data(file.get(), &value, sizeof(value), path); };
+    auto read_int = [&]() {
+        int32_t value;
+        read(value);
+        return (int) value;
+    };
+    TileJob job;
+    MeshingOptions &options = job.options;
+    read_header(file.get(), TILE_JOB_MAGIC, path);
+    for (int axis = 0; axis < 3; ++axis) {
+        read(options.lower[axis]);
+        read(options.upper[axis]);
+        options.resolution[axis] = read_int();
+        job.lower[axis] = read_int();
+        job.upper[axis] = read_int();
+    }
+    options.mode = (MeshingMode) read_int();
+    read(options.culling_factor);
+    options.root_iterations = read_int();
+    read(options.root_tolerance);
+    read(options.gradient_step);
+    read(options.position_sigma);
+    read(options.normal_sigma);
+    job.accuracy = (TrigAccuracy) read_int();
+    read(job.time);
+    return job;
+}
+
+void write_mesh_tile(const MeshTile &tile, const std::string &path) {
+    FilePointer file = open_file(path, "wb");
+    write_header(file.get(), MESH_TILE_MAGIC, path);
+    uint64_t num_vertices = tile.vertices.size();
+    uint64_t num_faces = tile.faces.size();
+    write_data(file.get(), &num_vertices, sizeof(num_vertices), path);
+    write_data(file.get(), &num_faces, sizeof(num_faces), path);
+    write_data(file.get(), tile.voxel_ids.data(), num_vertices * sizeof(int64_t), path);
+    write_data(file.get(), tile.vertices.data(), num_vertices * sizeof(glm::dvec3), path);
+    write_data(file.get(), tile.faces.data(), num_faces * sizeof(std::array<int64_t, 4>), path);
+    if (fflush(file.get()) != 0) {
+        throw std::runtime_error("Could not write " + path);
+    }
+}
+
+// Read only the voxel ids of a tile written by write_mesh_tile
+static std::vector<int64_t> read_voxel_ids(const std::string &path) {
+    FilePointer file = open_file(path, "rb");
+    read_header(file.get(), MESH_TILE_MAGIC, path);
+    uint64_t num_vertices, num_faces;
+    read_data(file.get(), &num_vertices, sizeof(num_vertices), path);
+    read_data(file.get(), &num_faces, sizeof(num_faces), path);
+    std::vector<int64_t> voxel_ids(num_vertices);
+    read_data(file.get(), voxel_ids.data(), num_vertices * sizeof(int64_t), path);
+    return voxel_ids;
+}
+
+MeshTile read_mesh_tile(const std::string &path) {
+    FilePointer file = open_file(path, "rb");
+    read_header(file.get(), MESH_TILE_MAGIC, path);
+    uint64_t num_vertices, num_faces;
+    read_data(file.get(), &num_vertices, sizeof(num_vertices), path);
+    read_data(file.get(), &num_faces, sizeof(num_faces), path);
+    MeshTile tile;
+    tile.voxel_ids.resize(num_vertices);
+    tile.vertices.resize(num_vertices);
+    tile.faces.resize(num_faces);
+    read_data(file.get(), tile.voxel_ids.data(), num_vertices * sizeof(int64_t), path);
+    read_data(file.get(), tile.vertices.data(), num_vertices * sizeof(glm::dvec3), path);
+    read_data(file.get(), tile.faces.data(), num_faces * sizeof(std::array<int64_t, 4>), path);
+    return tile;
+}
+
+void run_tile_worker(const std::string &program_path, const std::string &job_path, const std::string &output_path) {
+    Program program = read_program(program_path);
+    TileJob job = read_tile_job(job_path);
+    Kernel kernel = compile_kernel(program, job.accuracy);
+    MeshingContext context;
+    MeshTile tile;
+    mesh_tile(context, KernelEvaluator{kernel.eval, job.time}, job.options, job.lower, job.upper, tile);
+    write_mesh_tile(tile, output_path);
+}
+
+// Replace all occurrences of pattern in text
+static std::string replace_all(std::string text, const std::string &pattern, const std::string &replacement) {
+    for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + replacement.size())) {
+        text.replace(pos, pattern.size(), replacement);
+    }
+    return text;
+}
+
+StreamingStats mesh_tiled(const Program &program, const MeshingOptions &options, TrigAccuracy accuracy, double time,
+                          glm::ivec3 tile_counts, const std::string &command, int max_processes,
+                          const std::string &directory, const std::string &output_path,
+                          const std::function<void(int, int)> &progress) {
+    namespace fs = std::filesystem;
+    fs::create_directories(directory);
+    std::string program_path = (fs::path(directory) / "program.rkp").string();
+    write_program(program, program_path);
+
+    // Split the voxels as evenly as possible, the tiles share the samples on their boundaries
+    glm::ivec3 n = options.resolution;
+    tile_counts = glm::clamp(tile_counts, glm::ivec3(1), n);
+    int num_tiles = tile_counts.x * tile_counts.y * tile_counts.z;
+    std::vector<std::string> job_paths(num_tiles);
+    std::vector<std::string> output_paths(num_tiles);
+    for (int t = 0; t < num_tiles; ++t) {
+        glm::ivec3 tile{t / (tile_counts.y * tile_counts.z), t / tile_counts.z % tile_counts.y, t % tile_counts.z};
+        TileJob job;
+        job.options = options;
+        job.accuracy = accuracy;
+        job.time = time;
+        job.lower = tile * n / tile_counts;
+        job.upper = (tile + 1) * n / tile_counts;
+        job_paths[t] = (fs::path(directory) / ("tile_" + std::to_string(t) + ".job")).string();
+        output_paths[t] = (fs::path(directory) / ("tile_" + std::to_string(t) + ".rkmt")).string();
+        write_tile_job(job, job_paths[t]);
+    }
+
+    // Every thread starts one worker process after the other
+    std::atomic<int> next_tile{0};
+    std::atomic<int> finished_tiles{0};
+    std::mutex error_mutex;
+    std::string error;
+    auto run = [&]() {
+        for (int t = next_tile++; t < num_tiles; t = next_tile++) {
+            std::string tile_command = replace_all(command, "{program}", program_path);
+            tile_command = replace_all(tile_command, "{job}", job_paths[t]);
+            tile_command = replace_all(tile_command, "{output}", output_paths[t]);
+            if (std::system(tile_command.c_str()) != 0) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                error = "Worker for tile " + std::to_string(t) + " failed: " + tile_command;
+            }
+            int finished = ++finished_tiles;
+            if (progress) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                progress(finished, 2 * num_tiles);
+            }
+        }
+    };
+    int num_threads = std::min(num_tiles, std::max(1, max_processes));
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; ++i) {
+        threads.emplace_back(run);
+    }
+    run();
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+
+    // Every vertex is written by the tile that contains its voxel, the halo copies of the neighbours are skipped.
+    // A vertex has the index offset of its tile + rank of its voxel id among the ids of that tile.
+    auto owner = [&](int64_t id) {
+        glm::ivec3 voxel{(int) (id / ((int64_t) n.y * n.z)), (int) (id / n.z % n.y), (int) (id % n.z)};
+        glm::ivec3 tile;
+        for (int axis = 0; axis < 3; ++axis) {
+            tile[axis] = (int) (((int64_t) voxel[axis] + 1) * tile_counts[axis] - 1) / n[axis];
+        }
+        return (tile.x * tile_counts.y + tile.y) * tile_counts.z + tile.z;
+    };
+    std::vector<std::vector<int64_t>> owned_ids(num_tiles);
+    std::vector<int64_t> offsets(num_tiles + 1, 0);
+    for (int t = 0; t < num_tiles; ++t) {
+        std::vector<int64_t> voxel_ids = read_voxel_ids(output_paths[t]);
+        for (int64_t id: voxel_ids) {
+            if (owner(id) == t) {
+                owned_ids[t].push_back(id);
+            }
+        }
+        offsets[t + 1] = offsets[t] + (int64_t) owned_ids[t].size();
+    }
+    auto vertex_index = [&](int64_t id) -> int64_t {
+        if (id == -1) {
+            return -1;
+        }
+        int t = owner(id);
+        auto it = std::lower_bound(owned_ids[t].begin(), owned_ids[t].end(), id);
+        return it != owned_ids[t].end() && *it == id ? offsets[t] + (it - owned_ids[t].begin()) : -1;
+    };
+
+    // the buffer has to outlive the file, which is flushed into it when it is closed
+    std::vector<char> file_buffer(1 << 24);
+    FilePointer file = open_file(output_path, "w");
+    setvbuf(file.get(), file_buffer.data(), _IOFBF, file_buffer.size());
+    StreamingStats stats;
+    stats.num_vertices = offsets[num_tiles];
+    // OBJ needs all vertices before the faces, so the tiles are read twice
+    for (int t = 0; t < num_tiles; ++t) {
+        MeshTile tile = read_mesh_tile(output_paths[t]);
+        for (size_t v = 0; v < tile.voxel_ids.size(); ++v) {
+            if (owner(tile.voxel_ids[v]) == t) {
+                const glm::dvec3 &p = tile.vertices[v];
+                fprintf(file.get(), "v %.9g %.9g %.9g\n", p.x, p.y, p.z);
+            }
+        }
+    }
+    for (int t = 0; t < num_tiles; ++t) {
+        MeshTile tile = read_mesh_tile(output_paths[t]);
+        for (const auto &face: tile.faces) {
+            int64_t a = vertex_index(face[0]);
+            int64_t b = vertex_index(face[1]);
+            int64_t c = vertex_index(face[2]);
+            int64_t d = vertex_index(face[3]);
+            // faces at the border of the domain can reference voxels without a vertex
+            if (a == -1 || b == -1 || c == -1 || d == -1) {
+                continue;
+            }
+            fprintf(file.get(), "f %lld %lld %lld %lld\n", (long long) a + 1, (long long) b + 1, (long long) c + 1,
+                    (long long) d + 1);
+            stats.num_quads++;
+        }
+        if (progress) {
+            progress(num_tiles + t + 1, 2 * num_tiles);
+        }
+    }
+    if (fflush(file.get()) != 0) {
+        throw std::runtime_error("Could not write " + output_path);
+    }
+    return stats;
+}
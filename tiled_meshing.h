@@ -0,0 +1,49 @@
+//
+// Created by elisabeth on 05.03.24.
+//
+
+#pragma once
+
+#include <string>
+#include <functional>
+#include <glm/vec3.hpp>
+
+#include "implicit_meshing.h"
+#include "compiler.h"
+
+// One tile of the grid, meshed by a worker process
+struct TileJob {
+    MeshingOptions options;
+    TrigAccuracy accuracy = TrigAccuracy::Precise;
+    double time = 0.0;
+    // voxel range [lower, upper) of the tile
+    glm::ivec3 lower{0};
+    glm::ivec3 upper{0};
+};
+
+// Binary files exchanged with the workers, numbers are stored in the native byte order. All functions throw
+// std::runtime_error if a file can't be written or read.
+void write_tile_job(const TileJob &job, const std::string &path);
+
+TileJob read_tile_job(const std::string &path);
+
+void write_mesh_tile(const MeshTile &tile, const std::string &path);
+
+MeshTile read_mesh_tile(const std::string &path);
+
+// Entry point of a worker process: compile the program, mesh the tile of the job and write it to output_path
+void run_tile_worker(const std::string &program_path, const std::string &job_path, const std::string &output_path);
+
+// Split the grid of options into tile_counts tiles, mesh every tile in a separate worker process and merge the
+// tiles into the OBJ file output_path. The merge reads one tile after the other and only keeps the voxel ids of
+// the vertices in memory. The result has the vertices and faces of mesh_generator, ordered by tile, without the
+// faces at the border of the domain that miss a vertex. For every tile, command is run through the shell after
+// replacing {program}, {job} and {output} with the paths of the files in directory. At most max_processes
+// commands run at once. If directory is shared, the command can start the worker on another machine, e.g.
+// ssh host implicit_meshing --mesh-tile {program} {job} {output}. progress is called with the number of
+// finished and total steps, every tile is one step of meshing and one of merging. Throws std::runtime_error if a
+// worker fails or the output can't be written.
+StreamingStats mesh_tiled(const Program &program, const MeshingOptions &options, TrigAccuracy accuracy, double time,
+                          glm::ivec3 tile_counts, const std::string &command, int max_processes,
+                          const std::string &directory, const std::string &output_path,
+                          const std::function<void(int, int)> &progress = nullptr);
@@ -0,0 +1,121 @@
+//
+// Created by elisabeth on 07.03.24.
+//
+
+#include "volume.h"
+#include "compiler.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <glm/glm.hpp>
+
+static glm::ivec3 brick_coordinates(const SparseVolume &volume, int brick) {
+    return {brick / (volume.bricks.y * volume.bricks.z), brick / volume.bricks.z % volume.bricks.y,
+            brick % volume.bricks.z};
+}
+
+SparseVolume bake_volume(const Kernel &kernel, double time, glm::dvec3 lower, glm::dvec3 upper, int resolution,
+                         double band) {
+    if (!kernel) {
+        throw std::runtime_error("Cannot bake a volume without a kernel");
+    }
+    if (resolution < 1 || !(lower.x < upper.x && lower.y < upper.y && lower.z < upper.z)) {
+        throw std::runtime_error("The bake volume is empty");
+    }
+    SparseVolume volume;
+    volume.lower = lower;
+    volume.upper = upper;
+    int brick_count = (resolution + BRICK_SIZE - 1) / BRICK_SIZE;
+    volume.bricks = glm::ivec3(brick_count);
+    volume.spacing = (upper - lower) / (double) (brick_count * BRICK_SIZE);
+    int num_bricks = brick_count * brick_count * brick_count;
+
+    // Pass 1: a brick can only contain the surface if the value at its center is within half its diagonal plus
+    // the band, assuming the field is a distance bound
+    glm::dvec3 brick_size = volume.spacing * (double) BRICK_SIZE;
+    double radius = 0.5 * glm::length(brick_size) + band * std::max({volume.spacing.x, volume.spacing.y,
+                                                                      volume.spacing.z});
+    std::vector<double> centers(num_bricks);
+    parallel_for(brick_count * brick_count, [&](int row) {
+        std::vector<double> x(brick_count), y(brick_count), z(brick_count);
+        for (int k = 0; k < brick_count; ++k) {
+            glm::dvec3 center = lower + (glm::dvec3(brick_coordinates(volume, row * brick_count + k)) + 0.5) * brick_size;
+            x[k] = center.x;
+            y[k] = center.y;
+            z[k] = center.z;
+        }
+        kernel.batch(x.data(), y.data(), z.data(), time, centers.data() + row * brick_count, brick_count);
+    });
+
+    // Bricks are numbered in order, so the layout doesn't depend on the scheduling
+    volume.brick_index.resize(num_bricks);
+    volume.brick_values.resize(num_bricks);
+    int num_stored = 0;
+    double half_diagonal = 0.5 * glm::length(brick_size);
+    for (int b = 0; b < num_bricks; ++b) {
+        double value = centers[b];
+        if (std::abs(value) <= radius || std::isnan(value)) {
+            volume.brick_index[b] = num_stored++;
+            volume.brick_values[b] = 0.0f;
+        } else {
+            volume.brick_index[b] = -1;
+            volume.brick_values[b] = (float) std::copysign(std::abs(value) - half_diagonal, value);
+        }
+    }
+
+    // Pass 2: sample the stored bricks including the shared boundary samples
+    volume.samples.resize((size_t) std::max(num_stored, 1) * BRICK_SAMPLES, 0.0f);
+    parallel_for(num_bricks, [&](int b) {
+        int index = volume.brick_index[b];
+        if (index < 0) {
+            return;
+        }
+        glm::dvec3 origin = lower + glm::dvec3(brick_coordinates(volume, b) * BRICK_SIZE) * volume.spacing;
+        double x[BRICK_SAMPLES], y[BRICK_SAMPLES], z[BRICK_SAMPLES], values[BRICK_SAMPLES];
+        int s = 0;
+        for (int i = 0; i <= BRICK_SIZE; ++i) {
+            for (int j = 0; j <= BRICK_SIZE; ++j) {
+                for (int k = 0; k <= BRICK_SIZE; ++k, ++s) {
+                    x[s] = origin.x + i * volume.spacing.x;
+                    y[s] = origin.y + j * volume.spacing.y;
+                    z[s] = origin.z + k * volume.spacing.z;
+                }
+            }
+        }
+        kernel.batch(x, y, z, time, values, BRICK_SAMPLES);
+        float *samples = volume.samples.data() + (size_t) index * BRICK_SAMPLES;
+        for (int i = 0; i < BRICK_SAMPLES; ++i) {
+            samples[i] = (float) values[i];
+        }
+    });
+    return volume;
+}
+
+double sample_volume(const SparseVolume &volume, glm::dvec3 point) {
+    glm::dvec3 clamped = glm::clamp(point, volume.lower, volume.upper);
+    double outside = glm::length(point - clamped);
+    glm::ivec3 cells = volume.bricks * BRICK_SIZE;
+    glm::dvec3 grid = (clamped - volume.lower) / volume.spacing;
+    glm::ivec3 cell = glm::min(glm::ivec3(glm::floor(grid)), cells - 1);
+    glm::dvec3 t = grid - glm::dvec3(cell);
+    glm::ivec3 brick = cell / BRICK_SIZE;
+    glm::ivec3 local = cell - brick * BRICK_SIZE;
+    int b = (brick.x * volume.bricks.y + brick.y) * volume.bricks.z + brick.z;
+    int index = volume.brick_index[b];
+    if (index < 0) {
+        return volume.brick_values[b] + outside;
+    }
+    const float *samples = volume.samples.data() + (size_t) index * BRICK_SAMPLES;
+    auto sample = [&](int i, int j, int k) {
+        return (double) samples[((local.x + i) * (BRICK_SIZE + 1) + local.y + j) * (BRICK_SIZE + 1) + local.z + k];
+    };
+    double c00 = sample(0, 0, 0) + t.z * (sample(0, 0, 1) - sample(0, 0, 0));
+    double c01 = sample(0, 1, 0) + t.z * (sample(0, 1, 1) - sample(0, 1, 0));
+    double c10 = sample(1, 0, 0) + t.z * (sample(1, 0, 1) - sample(1, 0, 0));
+    double c11 = sample(1, 1, 0) + t.z * (sample(1, 1, 1) - sample(1, 1, 0));
+    double c0 = c00 + t.y * (c01 - c00);
+    double c1 = c10 + t.y * (c11 - c10);
+    return c0 + t.x * (c1 - c0) + outside;
+}
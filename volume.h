@@ -0,0 +1,43 @@
+//
+// Created by elisabeth on 07.03.24.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <glm/vec3.hpp>
+
+struct Kernel;
+
+// Number of cells along each edge of a brick, a brick stores (BRICK_SIZE + 1)^3 samples including its boundary
+constexpr int BRICK_SIZE = 8;
+constexpr int BRICK_SAMPLES = (BRICK_SIZE + 1) * (BRICK_SIZE + 1) * (BRICK_SIZE + 1);
+
+// Signed distance field sampled on a regular grid over [lower, upper] that only stores the bricks near the
+// surface. Bricks further than the band from the surface are replaced by a single conservative value.
+struct SparseVolume {
+    glm::dvec3 lower{0.0};
+    glm::dvec3 upper{0.0};
+    // number of bricks along each axis
+    glm::ivec3 bricks{0};
+    // size of a cell along each axis
+    glm::dvec3 spacing{0.0};
+    // For every brick (x major), the index of its samples in samples / BRICK_SAMPLES or -1 if it is empty
+    std::vector<int32_t> brick_index;
+    // For every brick, the value returned for an empty brick. It has the sign of the field and its magnitude is
+    // a lower bound of the distance to the surface.
+    std::vector<float> brick_values;
+    // Samples of the stored bricks, x major within a brick
+    std::vector<float> samples;
+};
+
+// Sample the kernel at time t on a grid with at least resolution cells along each axis, rounded up to whole
+// bricks. Only bricks that may be closer than band cells to the surface store their samples. Both passes are
+// distributed over all cores.
+SparseVolume bake_volume(const Kernel &kernel, double time, glm::dvec3 lower, glm::dvec3 upper, int resolution,
+                         double band);
+
+// Trilinear interpolation of the volume, points outside of it return the value at the closest point plus the
+// distance to it. Matches the lookup compiled for Operation::Volume.
+double sample_volume(const SparseVolume &volume, glm::dvec3 point);